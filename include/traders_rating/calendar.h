@@ -0,0 +1,68 @@
+#ifndef traders_rating_calendar_h
+#define traders_rating_calendar_h
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace traders_rating {
+
+/*
+ * Таблица календарных границ в местном времени. Для каждой недели
+ * хранятся ее начало и конец (местный понедельник 00:00) и смещение
+ * от UTC с моментом перехода на летнее/зимнее время, поэтому границы
+ * минуты и недели находятся за O(1) без localtime_r. Таблица покрывает
+ * около года вокруг запрошенного момента; за ее пределами она
+ * перестраивается (медленный путь под mutex, с localtime_r/mktime) и
+ * публикуется атомарно. Чтение lock-free: старые таблицы не
+ * освобождаются до разрушения объекта.
+ * Часовой пояс фиксируется при построении таблицы; смена TZ во время
+ * работы не поддерживается. Учитывается не более одного перехода
+ * смещения за неделю.
+ */
+class calendar_table {
+ public:
+  calendar_table();
+  calendar_table(const calendar_table&) = delete;
+  calendar_table& operator=(const calendar_table&) = delete;
+
+  std::pair<time_t, time_t> minute_times(time_t ts) const;
+  std::pair<time_t, time_t> week_times(time_t ts) const;
+
+ private:
+  struct week_t {
+    time_t start;
+    time_t finish;
+    // смещение местного времени от UTC до transition и после него
+    int32_t offset;
+    int32_t offset_after;
+    time_t transition;
+  };
+  struct table_t {
+    time_t first_start;
+    std::vector<week_t> weeks;
+  };
+
+ private:
+  const week_t& find_week(time_t ts) const;
+  const table_t& refresh(time_t ts) const;
+
+ private:
+  static const size_t weeks_before = 8;
+  static const size_t weeks_after = 56;
+
+  mutable std::atomic<const table_t*> table_;
+  mutable std::mutex refresh_mt_;
+  mutable std::vector<std::unique_ptr<const table_t>> tables_;
+};
+
+// общая таблица для местного часового пояса процесса
+const calendar_table& local_calendar();
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_calendar_h
@@ -0,0 +1,59 @@
+#ifndef traders_rating_cmd_queue_h
+#define traders_rating_cmd_queue_h
+
+#include <cstddef>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+#include "traders_rating/mpsc_queue.h"
+
+namespace traders_rating {
+
+/*
+ * Очередь команд: mpsc_queue записей cmd_t и буфер имен, параллельный
+ * ячейкам очереди. Строки буфера заранее резервируются под name_capacity
+ * байт, поэтому постановка команды в очередь не выделяет память.
+ */
+class cmd_queue {
+ public:
+  cmd_queue(size_t capacity, size_t name_capacity);
+
+  size_t capacity() const;
+  bool try_push(const cmd_t&);
+  bool try_push(cmd_t, const user_name_t&);
+  // резервирует n подряд идущих ячеек и заполняет их вызовами
+  // fill(i, cmd_t&, user_name_t&) - запись и ее ячейка буфера имен
+  template <typename F>
+  bool try_push_batch(size_t n, F fill) {
+    size_t pos;
+    if (!cmds_.try_claim(pos, n)) {
+      return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      auto name_slot = cmds_.slot_index(pos + i);
+      cmd_t& cmd = cmds_.slot(pos + i);
+      fill(i, cmd, names_[name_slot]);
+      cmd.name_slot = static_cast<uint32_t>(name_slot);
+      cmds_.publish(pos + i);
+    }
+    return true;
+  }
+  const user_name_t& name(const cmd_t& cmd) const {
+    return names_[cmd.name_slot];
+  }
+
+  // только для читателя
+  template <typename F>
+  size_t consume(F f, size_t max) {
+    return cmds_.consume(f, max);
+  }
+  bool empty() const;
+
+ private:
+  mpsc_queue<cmd_t> cmds_;
+  std::vector<user_name_t> names_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_cmd_queue_h
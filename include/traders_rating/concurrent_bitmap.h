@@ -0,0 +1,64 @@
+#ifndef traders_rating_concurrent_bitmap_h
+#define traders_rating_concurrent_bitmap_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace traders_rating {
+
+/*
+ * Битовая карта над плотными индексами (user_index_t) с одним писателем
+ * и читателями без блокировок. Память выделяется сегментами по 2^20 бит
+ * и не освобождается до разрушения карты, поэтому читатель не может
+ * увидеть освобожденный сегмент. В каждом сегменте есть сводка: бит на
+ * 64-битное слово, равный 1, если в слове есть установленные биты.
+ * append_to() обходит только непустые слова - O(установленных +
+ * индексов / 4096). Снимок не атомарен как целое: изменения, сделанные
+ * во время обхода, могут попасть в него частично, но каждый бит читается
+ * либо до, либо после своего изменения.
+ */
+class concurrent_bitmap {
+ public:
+  using index_t = uint32_t;
+
+  concurrent_bitmap();
+  ~concurrent_bitmap();
+  concurrent_bitmap(const concurrent_bitmap&) = delete;
+  concurrent_bitmap& operator=(const concurrent_bitmap&) = delete;
+
+  // только поток-писатель; возвращают, изменился ли бит
+  bool set(index_t);
+  bool reset(index_t);
+
+  // любые потоки
+  bool test(index_t) const;
+  size_t count() const { return count_.load(std::memory_order_relaxed); }
+  // добавляет индексы установленных битов в порядке возрастания
+  void append_to(std::vector<index_t>&) const;
+
+ private:
+  static const size_t segment_bits_log = 20;
+  static const size_t segment_words = (size_t(1) << segment_bits_log) / 64;
+  static const size_t summary_words = segment_words / 64;
+  static const size_t max_segments = (size_t(1) << 32) >> segment_bits_log;
+
+  struct segment_t {
+    std::atomic<uint64_t> summary[summary_words];
+    std::atomic<uint64_t> words[segment_words];
+  };
+
+ private:
+  segment_t* segment(index_t) const;
+
+ private:
+  std::unique_ptr<std::atomic<segment_t*>[]> segments_;
+  std::atomic<size_t> segments_count_;
+  std::atomic<size_t> count_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_concurrent_bitmap_h
@@ -0,0 +1,78 @@
+#ifndef traders_rating_deadline_scheduler_h
+#define traders_rating_deadline_scheduler_h
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <set>
+#include <utility>
+
+namespace traders_rating {
+
+using time_function_t = std::function<time_t(time_t*)>;
+
+/*
+ * Сроки потока: закрытие минуты, публикация, смена недели. Таймеры
+ * упорядочены по (срок, timer_id_t), поэтому таймеры с одним сроком
+ * срабатывают в порядке идентификаторов. Горячий цикл вызывает poll():
+ * часы читаются один раз на check_interval вызовов, наступление срока
+ * проверяется сравнением с закэшированным ближайшим сроком. poll_now()
+ * читает часы сразу - для простоя и редких циклов.
+ * Не потокобезопасен, принадлежит одному потоку.
+ */
+class deadline_scheduler {
+ public:
+  using timer_id_t = uint32_t;
+
+  explicit deadline_scheduler(time_function_t, uint32_t check_interval = 64);
+
+  void schedule(time_t deadline, timer_id_t);
+  void clear();
+  bool empty() const;
+  // время последнего чтения часов
+  time_t now() const { return now_; }
+  // читает часы, не обрабатывая сроки
+  time_t read_clock();
+  time_t next_deadline() const { return next_deadline_; }
+
+  // вызывает fired(timer_id_t, time_t now) для каждого наступившего
+  // срока по порядку; fired может планировать новые таймеры
+  template <typename F>
+  size_t poll(F fired) {
+    if (++polls_ < check_interval_) {
+      return 0;
+    }
+    return poll_now(fired);
+  }
+
+  template <typename F>
+  size_t poll_now(F fired) {
+    polls_ = 0;
+    read_clock();
+    size_t n = 0;
+    while (now_ >= next_deadline_) {
+      auto id = timers_.begin()->second;
+      timers_.erase(timers_.begin());
+      update_next_deadline();
+      fired(id, now_);
+      ++n;
+    }
+    return n;
+  }
+
+ private:
+  void update_next_deadline();
+
+ private:
+  time_function_t time_function_;
+  const uint32_t check_interval_;
+  uint32_t polls_;
+  time_t now_;
+  time_t next_deadline_;
+  std::set<std::pair<time_t, timer_id_t>> timers_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_deadline_scheduler_h
@@ -0,0 +1,83 @@
+#ifndef traders_rating_double_buffer_h
+#define traders_rating_double_buffer_h
+
+#include <atomic>
+#include <cstdint>
+
+#include "traders_rating/utilities.h"
+
+namespace traders_rating {
+
+/*
+ * Два экземпляра T: читатели видят опубликованный, единственный писатель
+ * заполняет второй и публикует его (схема Left-Right). Чтение без
+ * ожиданий и блокировок: читатель отмечается в счетчике текущей эпохи,
+ * читает опубликованный экземпляр и снимает отметку. publish() после
+ * переключения ждет, пока прежний экземпляр дочитают, поэтому следующее
+ * заполнение back() никому не мешает. Читатели не должны задерживаться
+ * в read() надолго: писатель их ждет.
+ */
+template <typename T>
+class double_buffer {
+ public:
+  double_buffer() : current_(0), epoch_(0) {
+    readers_[0].count = 0;
+    readers_[1].count = 0;
+  }
+  double_buffer(const double_buffer&) = delete;
+  double_buffer& operator=(const double_buffer&) = delete;
+
+  // f(const T&) для опубликованного экземпляра
+  template <typename F>
+  void read(F f) const {
+    uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+    readers_[epoch].count.fetch_add(1, std::memory_order_seq_cst);
+    struct depart_t {
+      std::atomic<int64_t>& count;
+      ~depart_t() { count.fetch_sub(1, std::memory_order_release); }
+    } depart{readers_[epoch].count};
+    f(buffers_[current_.load(std::memory_order_seq_cst)]);
+  }
+
+  // для писателя: экземпляр, который никто не читает, и опубликованный
+  T& back() { return buffers_[1 - current_.load(std::memory_order_relaxed)]; }
+  const T& front() const {
+    return buffers_[current_.load(std::memory_order_relaxed)];
+  }
+
+  // делает back() опубликованным; возвращается, когда прежний
+  // опубликованный экземпляр больше никто не читает
+  void publish() {
+    current_.store(1 - current_.load(std::memory_order_relaxed),
+                   std::memory_order_seq_cst);
+    // читатель отмечается до чтения current_: отметившиеся после
+    // ожидания своей эпохи видят новый экземпляр
+    uint32_t epoch = epoch_.load(std::memory_order_relaxed);
+    wait_readers(1 - epoch);
+    epoch_.store(1 - epoch, std::memory_order_seq_cst);
+    wait_readers(epoch);
+  }
+
+ private:
+  void wait_readers(uint32_t epoch) const {
+    while (readers_[epoch].count.load(std::memory_order_acquire) != 0) {
+      yield_thread();
+    }
+  }
+
+  // счетчики эпох на разных кэш-линиях
+  struct counter_t {
+    std::atomic<int64_t> count;
+    char padding[64 - sizeof(std::atomic<int64_t>)];
+  };
+
+ private:
+  T buffers_[2];
+  std::atomic<uint32_t> current_;
+  std::atomic<uint32_t> epoch_;
+  mutable counter_t readers_[2];
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_double_buffer_h
@@ -0,0 +1,108 @@
+#ifndef traders_rating_event_feed_h
+#define traders_rating_event_feed_h
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+
+namespace traders_rating {
+
+/*
+ * Двоичный поток событий. Поток начинается с 8-байтной сигнатуры
+ * event_feed_magic, за ней идут записи: 32-байтный заголовок
+ * event_record_t (little-endian), сразу за ним name_size байт имени
+ * (только user_registered и user_renamed), дополненные нулями до
+ * кратного 8 размера. Записи разбираются на месте, без копирования.
+ */
+enum class event_type_t : uint8_t {
+  user_registered = 1,
+  user_renamed = 2,
+  user_connected = 3,
+  user_disconnected = 4,
+  user_deal_won = 5
+};
+
+struct event_record_t {
+  event_type_t type;
+  uint8_t reserved0;
+  uint16_t name_size;
+  uint32_t reserved1;
+  int64_t ts;
+  uint64_t user_id;
+  double amount;
+};
+
+static_assert(sizeof(event_record_t) == 32, "event_record_t layout");
+
+extern const char event_feed_magic[8];
+const size_t event_feed_magic_size = sizeof(event_feed_magic);
+const size_t event_max_name_size = 0xffff;
+// метка времени записи: 0 - без метки, иначе не позже 2100-01-01;
+// запись вне диапазона считается поврежденной
+const int64_t event_max_ts = 4102444800;
+
+inline const char* event_name(const event_record_t& event) {
+  return reinterpret_cast<const char*>(&event + 1);
+}
+
+inline size_t event_size(const event_record_t& event) {
+  return sizeof(event_record_t) + ((event.name_size + 7U) & ~size_t(7));
+}
+
+cmd_t to_cmd(const event_record_t&);
+
+void append_event_feed_magic(std::vector<char>&);
+void append_event(std::vector<char>&, event_type_t, time_t, user_id_t,
+                  amount_t = 0, const user_name_t& = user_name_t());
+
+// пачка разобранных записей; указатели действительны до возврата из функции
+using event_batch_callback =
+    std::function<void(const event_record_t* const* events, size_t count)>;
+
+// разбирает целые записи из [data, data + size), возвращает число
+// разобранных байт; data должна быть выровнена на 8
+size_t parse_events(const char* data, size_t size, size_t batch_size,
+                    const event_batch_callback&, uint64_t& events);
+
+/*
+ * Чтение потока из файлового дескриптора (stdin, pipe, сокет) в буфер
+ * фиксированного размера.
+ */
+class stream_feed_reader {
+ public:
+  stream_feed_reader(int fd, size_t buffer_size = 1 << 20,
+                     size_t batch_size = 256);
+  // читает до конца потока, возвращает количество событий
+  uint64_t read(const event_batch_callback&);
+
+ private:
+  int fd_;
+  size_t batch_size_;
+  std::vector<uint64_t> buffer_;
+};
+
+/*
+ * Чтение файла, отображенного в память.
+ */
+class mmap_feed_reader {
+ public:
+  explicit mmap_feed_reader(const std::string& path, size_t batch_size = 256);
+  ~mmap_feed_reader();
+  mmap_feed_reader(const mmap_feed_reader&) = delete;
+  mmap_feed_reader& operator=(const mmap_feed_reader&) = delete;
+
+  uint64_t read(const event_batch_callback&);
+
+ private:
+  size_t batch_size_;
+  void* data_;
+  size_t size_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_event_feed_h
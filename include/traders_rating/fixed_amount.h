@@ -0,0 +1,154 @@
+#ifndef traders_rating_fixed_amount_h
+#define traders_rating_fixed_amount_h
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+
+// долей единицы суммы в fixed_amount; задается при сборке
+#ifndef TRADERS_RATING_AMOUNT_SCALE
+#define TRADERS_RATING_AMOUNT_SCALE 10000
+#endif
+
+namespace traders_rating {
+
+/*
+ * Сумма с фиксированной точкой: целое число долей 1/Scale. Значение
+ * double округляется до ближайшей доли один раз - при создании, дальше
+ * сложение и сравнение точные, поэтому равные обороты остаются равными
+ * ключами рейтинга при любом порядке сделок. Диапазон - +-2^63 долей
+ * (около 9.2e14 при Scale = 10000); на значения вне диапазона, NaN и
+ * бесконечности конструктор бросает std::out_of_range (см.
+ * representable), сложение и вычитание насыщаются на границах.
+ * Как и double, конструктор по умолчанию значение не инициализирует.
+ */
+template <int64_t Scale>
+class fixed_amount {
+ public:
+  using units_t = int64_t;
+  static const units_t scale = Scale;
+
+  fixed_amount() = default;
+  fixed_amount(double value) {
+    if (!representable(value)) {
+      throw std::out_of_range("fixed_amount: value is out of range");
+    }
+    units_ = std::llround(value * Scale);
+  }
+
+  // value конечно и после округления помещается в units_t
+  static bool representable(double value) {
+    // 2^63 представимо точно, меньшие double округляются не выше 2^63 - 1
+    return std::isfinite(value) &&
+           std::fabs(value * Scale) < 9223372036854775808.0;
+  }
+
+  static fixed_amount from_units(units_t units) {
+    fixed_amount amount;
+    amount.units_ = units;
+    return amount;
+  }
+
+  units_t units() const { return units_; }
+  double to_double() const { return static_cast<double>(units_) / Scale; }
+  explicit operator double() const { return to_double(); }
+
+  fixed_amount& operator+=(fixed_amount other) {
+    if (__builtin_add_overflow(units_, other.units_, &units_)) {
+      units_ = saturated(other.units_ > 0);
+    }
+    return *this;
+  }
+  fixed_amount& operator-=(fixed_amount other) {
+    if (__builtin_sub_overflow(units_, other.units_, &units_)) {
+      units_ = saturated(other.units_ < 0);
+    }
+    return *this;
+  }
+
+  friend fixed_amount operator+(fixed_amount lhs, fixed_amount rhs) {
+    return lhs += rhs;
+  }
+  friend fixed_amount operator-(fixed_amount lhs, fixed_amount rhs) {
+    return lhs -= rhs;
+  }
+  friend bool operator==(fixed_amount lhs, fixed_amount rhs) {
+    return lhs.units_ == rhs.units_;
+  }
+  friend bool operator!=(fixed_amount lhs, fixed_amount rhs) {
+    return lhs.units_ != rhs.units_;
+  }
+  friend bool operator<(fixed_amount lhs, fixed_amount rhs) {
+    return lhs.units_ < rhs.units_;
+  }
+  friend bool operator>(fixed_amount lhs, fixed_amount rhs) {
+    return lhs.units_ > rhs.units_;
+  }
+  friend bool operator<=(fixed_amount lhs, fixed_amount rhs) {
+    return lhs.units_ <= rhs.units_;
+  }
+  friend bool operator>=(fixed_amount lhs, fixed_amount rhs) {
+    return lhs.units_ >= rhs.units_;
+  }
+  friend std::ostream& operator<<(std::ostream& os, fixed_amount amount) {
+    return os << amount.to_double();
+  }
+
+ private:
+  static units_t saturated(bool positive) {
+    return positive ? std::numeric_limits<units_t>::max()
+                    : std::numeric_limits<units_t>::min();
+  }
+
+ private:
+  units_t units_;
+};
+
+template <int64_t Scale>
+const typename fixed_amount<Scale>::units_t fixed_amount<Scale>::scale;
+
+// TRADERS_RATING_DOUBLE_AMOUNT - прежний режим с суммами в double
+#if defined TRADERS_RATING_DOUBLE_AMOUNT
+using amount_t = double;
+#else
+using amount_t = fixed_amount<TRADERS_RATING_AMOUNT_SCALE>;
+#endif
+
+// сумма из внешнего источника может быть записана в amount_t
+inline bool valid_amount(double value) {
+#if defined TRADERS_RATING_DOUBLE_AMOUNT
+  return std::isfinite(value);
+#else
+  return amount_t::representable(value);
+#endif
+}
+// fixed_amount проверен при создании из double
+template <int64_t Scale>
+bool valid_amount(fixed_amount<Scale>) {
+  return true;
+}
+
+inline double to_double(double amount) { return amount; }
+template <int64_t Scale>
+double to_double(fixed_amount<Scale> amount) {
+  return amount.to_double();
+}
+
+// биты суммы для хешей и отпечатков: равные суммы - равные биты
+inline uint64_t amount_bits(double amount) {
+  uint64_t bits;
+  static_assert(sizeof(bits) == sizeof(amount), "double is 64-bit");
+  std::memcpy(&bits, &amount, sizeof(bits));
+  return bits;
+}
+template <int64_t Scale>
+uint64_t amount_bits(fixed_amount<Scale> amount) {
+  return static_cast<uint64_t>(amount.units());
+}
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_fixed_amount_h
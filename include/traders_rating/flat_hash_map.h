@@ -0,0 +1,318 @@
+#ifndef traders_rating_flat_hash_map_h
+#define traders_rating_flat_hash_map_h
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+namespace traders_rating {
+
+namespace detail {
+
+inline uint64_t& slot_key(uint64_t& slot) { return slot; }
+inline const uint64_t& slot_key(const uint64_t& slot) { return slot; }
+template <typename V>
+uint64_t& slot_key(std::pair<uint64_t, V>& slot) {
+  return slot.first;
+}
+template <typename V>
+const uint64_t& slot_key(const std::pair<uint64_t, V>& slot) {
+  return slot.first;
+}
+
+/*
+ * Хеш-таблица с открытой адресацией для 64-битных ключей (user_id_t):
+ * ячейки (ключ или пара ключ-значение) лежат в одном массиве, коллизии
+ * разрешаются линейным пробированием, удаление - обратным сдвигом, без
+ * надгробий. Пустая ячейка помечается ключом empty_key, сам ключ
+ * empty_key хранится в отдельной ячейке. Емкость - степень двойки,
+ * заполнение не больше 3/4. clear() сохраняет память, поэтому таблицу
+ * можно заранее выделить и переиспользовать.
+ * Вставка и удаление делают итераторы недействительными.
+ */
+template <typename Slot>
+class flat_hash_table {
+ public:
+  using key_type = uint64_t;
+  using value_type = Slot;
+  static const key_type empty_key = ~key_type(0);
+
+  template <typename Table, typename Value>
+  class basic_iterator
+      : public std::iterator<std::forward_iterator_tag, Value> {
+   public:
+    basic_iterator(Table* table, size_t index)
+        : table_(table), index_(index) {
+      skip_empty();
+    }
+    Value& operator*() const { return table_->slot_at(index_); }
+    Value* operator->() const { return &table_->slot_at(index_); }
+    bool operator==(const basic_iterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const basic_iterator& other) const {
+      return index_ != other.index_;
+    }
+    basic_iterator& operator++() {
+      ++index_;
+      skip_empty();
+      return *this;
+    }
+
+   private:
+    void skip_empty() {
+      while (index_ < table_->end_index() && !table_->occupied(index_)) {
+        ++index_;
+      }
+    }
+
+   private:
+    Table* table_;
+    size_t index_;
+  };
+  using iterator = basic_iterator<flat_hash_table, Slot>;
+  using const_iterator = basic_iterator<const flat_hash_table, const Slot>;
+
+ public:
+  explicit flat_hash_table(size_t expected_size)
+      : capacity_(0), mask_(0), shift_(64), size_(0), has_empty_key_(false) {
+    reserve(expected_size);
+  }
+
+  flat_hash_table(const flat_hash_table&) = delete;
+  flat_hash_table& operator=(const flat_hash_table&) = delete;
+
+  size_t size() const { return size_ + (has_empty_key_ ? 1 : 0); }
+  bool empty() const { return size() == 0; }
+  size_t capacity() const { return capacity_; }
+  // байт на ячейку массива
+  static size_t slot_size() { return sizeof(Slot); }
+
+  // готовит таблицу к n элементам без перестроения
+  void reserve(size_t n) {
+    size_t capacity = capacity_ > 0 ? capacity_ : 16;
+    while (capacity * 3 / 4 < n) {
+      capacity <<= 1;
+    }
+    if (capacity != capacity_) {
+      rehash(capacity);
+    }
+  }
+
+  void clear() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (slot_key(slots_[i]) != empty_key) {
+        make_empty(slots_[i]);
+      }
+    }
+    size_ = 0;
+    if (has_empty_key_) {
+      has_empty_key_ = false;
+      empty_key_slot_ = Slot();
+    }
+  }
+
+  iterator find(key_type key) { return iterator(this, find_index(key)); }
+  const_iterator find(key_type key) const {
+    return const_iterator(this, find_index(key));
+  }
+  size_t count(key_type key) const {
+    return find_index(key) != end_index() ? 1 : 0;
+  }
+
+  size_t erase(key_type key) {
+    size_t i = find_index(key);
+    if (i == end_index()) {
+      return 0;
+    }
+    if (i == capacity_) {
+      has_empty_key_ = false;
+      empty_key_slot_ = Slot();
+      return 1;
+    }
+    // обратный сдвиг: ячейки цепочки, чья исходная позиция не попадает
+    // в (i, j], переезжают в освободившуюся ячейку i
+    for (size_t j = (i + 1) & mask_; slot_key(slots_[j]) != empty_key;
+         j = (j + 1) & mask_) {
+      size_t home = home_index(slot_key(slots_[j]));
+      bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (!stays) {
+        slots_[i] = std::move(slots_[j]);
+        i = j;
+      }
+    }
+    make_empty(slots_[i]);
+    --size_;
+    return 1;
+  }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, end_index()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, end_index()); }
+
+ protected:
+  // индекс ячейки ключа, новая ячейка содержит только ключ;
+  // second - вставлен ли ключ
+  std::pair<size_t, bool> emplace_key(key_type key) {
+    if (key == empty_key) {
+      bool inserted = !has_empty_key_;
+      if (inserted) {
+        has_empty_key_ = true;
+        slot_key(empty_key_slot_) = key;
+      }
+      return std::make_pair(capacity_, inserted);
+    }
+    if ((size_ + 1) > capacity_ * 3 / 4) {
+      rehash(capacity_ > 0 ? capacity_ * 2 : 16);
+    }
+    for (size_t i = home_index(key);; i = (i + 1) & mask_) {
+      if (slot_key(slots_[i]) == key) {
+        return std::make_pair(i, false);
+      }
+      if (slot_key(slots_[i]) == empty_key) {
+        slot_key(slots_[i]) = key;
+        ++size_;
+        return std::make_pair(i, true);
+      }
+    }
+  }
+
+  Slot& slot_at(size_t index) {
+    return index < capacity_ ? slots_[index] : empty_key_slot_;
+  }
+  const Slot& slot_at(size_t index) const {
+    return index < capacity_ ? slots_[index] : empty_key_slot_;
+  }
+
+ private:
+  // фибоначчиево хеширование: старшие биты произведения на 2^64/phi,
+  // последовательные user_id расходятся по таблице
+  size_t home_index(key_type key) const {
+    return static_cast<size_t>((key * 0x9e3779b97f4a7c15ULL) >> shift_);
+  }
+
+  static void make_empty(Slot& slot) {
+    slot = Slot();
+    slot_key(slot) = empty_key;
+  }
+
+  // ячейка capacity_ - ключ empty_key, end_index() - конец
+  size_t end_index() const { return capacity_ + 1; }
+  bool occupied(size_t index) const {
+    return index < capacity_ ? slot_key(slots_[index]) != empty_key
+                             : has_empty_key_;
+  }
+
+  size_t find_index(key_type key) const {
+    if (key == empty_key) {
+      return has_empty_key_ ? capacity_ : end_index();
+    }
+    if (capacity_ == 0) {
+      return end_index();
+    }
+    for (size_t i = home_index(key);; i = (i + 1) & mask_) {
+      if (slot_key(slots_[i]) == key) {
+        return i;
+      }
+      if (slot_key(slots_[i]) == empty_key) {
+        return end_index();
+      }
+    }
+  }
+
+  void rehash(size_t capacity) {
+    std::unique_ptr<Slot[]> slots(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+      slot_key(slots[i]) = empty_key;
+    }
+    std::swap(slots, slots_);
+    size_t old_capacity = capacity_;
+    capacity_ = capacity;
+    mask_ = capacity - 1;
+    shift_ = 64;
+    for (size_t c = capacity; c > 1; c >>= 1) {
+      --shift_;
+    }
+    size_ = 0;
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (slot_key(slots[i]) != empty_key) {
+        slots_[emplace_key(slot_key(slots[i])).first] = std::move(slots[i]);
+      }
+    }
+  }
+
+ private:
+  std::unique_ptr<Slot[]> slots_;
+  size_t capacity_;
+  size_t mask_;
+  unsigned shift_;
+  size_t size_;
+  bool has_empty_key_;
+  Slot empty_key_slot_;
+};
+
+template <typename Slot>
+const typename flat_hash_table<Slot>::key_type flat_hash_table<Slot>::empty_key;
+
+}  // namespace detail
+
+/*
+ * Замена std::unordered_map<user_id_t, V> с тем же интерфейсом для
+ * используемых операций; элементы - std::pair<uint64_t, V>.
+ */
+template <typename V>
+class flat_hash_map : public detail::flat_hash_table<std::pair<uint64_t, V>> {
+ private:
+  using table_t = detail::flat_hash_table<std::pair<uint64_t, V>>;
+
+ public:
+  using key_type = typename table_t::key_type;
+  using mapped_type = V;
+  using value_type = typename table_t::value_type;
+  using iterator = typename table_t::iterator;
+
+ public:
+  explicit flat_hash_map(size_t expected_size = 0) : table_t(expected_size) {}
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    auto r = this->emplace_key(value.first);
+    if (r.second) {
+      this->slot_at(r.first).second = value.second;
+    }
+    return std::make_pair(iterator(this, r.first), r.second);
+  }
+
+  V& operator[](key_type key) {
+    return this->slot_at(this->emplace_key(key).first).second;
+  }
+};
+
+/*
+ * Замена std::unordered_set<user_id_t>; ключи только для чтения.
+ */
+class flat_hash_set : public detail::flat_hash_table<uint64_t> {
+ private:
+  using table_t = detail::flat_hash_table<uint64_t>;
+
+ public:
+  using iterator = table_t::const_iterator;
+
+ public:
+  explicit flat_hash_set(size_t expected_size = 0) : table_t(expected_size) {}
+
+  std::pair<iterator, bool> insert(key_type key) {
+    auto r = emplace_key(key);
+    return std::make_pair(iterator(this, r.first), r.second);
+  }
+
+  iterator find(key_type key) const { return table_t::find(key); }
+  iterator begin() const { return table_t::begin(); }
+  iterator end() const { return table_t::end(); }
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_flat_hash_map_h
@@ -0,0 +1,137 @@
+#ifndef traders_rating_mpsc_queue_h
+#define traders_rating_mpsc_queue_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace traders_rating {
+
+/*
+ * Ограниченная lock-free очередь: много писателей, один читатель.
+ * Кольцевой буфер, у каждой ячейки свой номер последовательности.
+ * Писатель резервирует позицию (try_claim), заполняет slot(pos) и
+ * публикует ее (publish). Читатель забирает опубликованные ячейки
+ * пачками (consume). Емкость округляется вверх до степени двойки.
+ */
+template <typename T>
+class mpsc_queue {
+ public:
+  explicit mpsc_queue(size_t capacity)
+      : capacity_(round_capacity(capacity)),
+        mask_(capacity_ - 1),
+        cells_(new cell_t[capacity_]),
+        enqueue_pos_(0),
+        dequeue_pos_(0) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  mpsc_queue(const mpsc_queue&) = delete;
+  mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+  size_t capacity() const { return capacity_; }
+
+  // индекс ячейки для позиции - для параллельных массивов при очереди
+  size_t slot_index(size_t pos) const { return pos & mask_; }
+
+  // резервирует n подряд идущих позиций, первая возвращается в pos;
+  // false - если в очереди нет n свободных ячеек
+  bool try_claim(size_t& pos, size_t n = 1) {
+    if (n == 0 || n > capacity_) {
+      return false;
+    }
+    pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      // читатель освобождает ячейки по порядку, поэтому достаточно
+      // проверить последнюю из резервируемых
+      size_t last = pos + n - 1;
+      size_t sequence =
+          cells_[last & mask_].sequence.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(last);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + n,
+                                               std::memory_order_relaxed)) {
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  T& slot(size_t pos) { return cells_[pos & mask_].data; }
+
+  void publish(size_t pos) {
+    cells_[pos & mask_].sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  bool try_push(T&& value) {
+    size_t pos;
+    if (!try_claim(pos)) {
+      return false;
+    }
+    slot(pos) = std::move(value);
+    publish(pos);
+    return true;
+  }
+
+  // вызывает f(T&) не более чем для max опубликованных элементов подряд,
+  // возвращает количество обработанных; только для читателя
+  template <typename F>
+  size_t consume(F f, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+      cell_t& cell = cells_[dequeue_pos_ & mask_];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      if (sequence != dequeue_pos_ + 1) {
+        break;
+      }
+      f(cell.data);
+      cell.sequence.store(dequeue_pos_ + capacity_, std::memory_order_release);
+      ++dequeue_pos_;
+      ++n;
+    }
+    return n;
+  }
+
+  bool empty() const {
+    size_t sequence = cells_[dequeue_pos_ & mask_].sequence.load(
+        std::memory_order_acquire);
+    return sequence != dequeue_pos_ + 1;
+  }
+
+ private:
+  struct cell_t {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+  static const size_t cache_line_size = 64;
+
+  static size_t round_capacity(size_t capacity) {
+    size_t result = 2;
+    while (result < capacity) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+ private:
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<cell_t[]> cells_;
+  char pad0_[cache_line_size];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[cache_line_size - sizeof(std::atomic<size_t>)];
+  size_t dequeue_pos_;
+  char pad2_[cache_line_size - sizeof(size_t)];
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_mpsc_queue_h
@@ -0,0 +1,142 @@
+#ifndef traders_rating_rating_index_h
+#define traders_rating_rating_index_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+
+namespace traders_rating {
+
+/*
+ * Упорядоченный индекс рейтинга с подсчетом размеров поддеревьев
+ * (order statistic tree). Ключ - пара (amount по убыванию, user_id по
+ * возрастанию), поэтому у каждого пользователя своя позиция и пользователи
+ * с одинаковым оборотом упорядочены детерминированно.
+ * Позиции 0-based: позиция 0 - первое место в рейтинге.
+ * rank/at/insert/erase - O(log n), range - O(log n + k).
+ *
+ * Устроен как B+ дерево: записи лежат подряд в листьях по leaf_capacity,
+ * листья связаны по порядку; во внутренних узлах для каждого потомка
+ * хранятся разделитель (нижняя граница ключей) и число записей в его
+ * поддереве. Поиск проходит несколько узлов, каждый из которых читается
+ * последовательно, и на пользователя приходится около 16 байт записи плюс
+ * незаполненная часть листа. Узлы при удалении сливаются с соседями,
+ * когда заполнены меньше чем на четверть.
+ */
+class rating_index {
+ public:
+  struct entry_t {
+    amount_t amount;
+    user_id_t user_id;
+  };
+
+  rating_index();
+
+  void insert(amount_t, user_id_t);
+  bool erase(amount_t, user_id_t);
+  void update(user_id_t, amount_t prev_amount, amount_t new_amount);
+  void clear();
+  // заменяет содержимое total записями, уже упорядоченными по рейтингу
+  // (см. before), за O(total); узлы заполняются на три четверти, чтобы
+  // следующие вставки не сразу делили их
+  void assign_sorted(const entry_t* entries, size_t total);
+  void swap(rating_index&);
+  size_t size() const;
+  bool empty() const;
+  // байт памяти под узлы, включая свободные
+  size_t memory_bytes() const;
+
+  // количество записей, стоящих в рейтинге перед ключом (amount, user_id);
+  // для присутствующего ключа - его позиция
+  size_t rank(amount_t, user_id_t) const;
+  entry_t at(size_t position) const;
+
+  // вызывает f(position, entry) для позиций [first, last)
+  template <typename F>
+  void range(size_t first, size_t last, F f) const {
+    if (last > size()) {
+      last = size();
+    }
+    if (first >= last) {
+      return;
+    }
+    size_t offset;
+    node_id_t n = find_leaf(first, offset);
+    for (size_t position = first; position < last; ++offset, ++position) {
+      while (offset == leaves_[n].size) {
+        n = leaves_[n].next;
+        offset = 0;
+      }
+      f(position, leaves_[n].entries[offset]);
+    }
+  }
+
+  static bool before(amount_t, user_id_t, amount_t, user_id_t);
+
+ private:
+  using node_id_t = uint32_t;
+  static const node_id_t nil = ~node_id_t(0);
+  static const uint32_t leaf_capacity = 64;
+  static const uint32_t inner_capacity = 64;
+  // высота дерева из узлов, заполненных хотя бы на четверть, для 2^32
+  // записей
+  static const size_t max_height = 16;
+
+  // лишняя ячейка в узлах - для вставки перед делением
+  struct leaf_t {
+    uint32_t size;
+    node_id_t next;
+    entry_t entries[leaf_capacity + 1];
+  };
+
+  // keys[0] не используется: ключи потомка i не меньше keys[i] и
+  // меньше keys[i + 1]
+  struct inner_t {
+    uint32_t size;
+    entry_t keys[inner_capacity + 1];
+    node_id_t children[inner_capacity + 1];
+    uint32_t counts[inner_capacity + 1];
+  };
+
+  struct path_t {
+    node_id_t node;
+    uint32_t slot;
+  };
+
+ private:
+  static bool before(const entry_t&, const entry_t&);
+  static uint32_t child_slot(const inner_t&, const entry_t&);
+  static uint32_t lower_bound(const leaf_t&, const entry_t&);
+
+  node_id_t allocate_leaf();
+  node_id_t allocate_inner();
+  void release_leaf(node_id_t);
+  void release_inner(node_id_t);
+
+  // лист с позицией position и смещение в нем
+  node_id_t find_leaf(size_t position, size_t& offset) const;
+  // записей в поддереве узла уровня level (0 - листья)
+  size_t count(size_t level, node_id_t) const;
+  uint32_t node_size(size_t level, node_id_t) const;
+  // делит переполненный узел path[level], правая половина добавляется в
+  // родителя или в новый корень
+  void split(path_t* path, size_t level);
+  // сливает узел path[level] с соседом, если они помещаются в один
+  void merge(path_t* path, size_t level);
+
+ private:
+  std::vector<leaf_t> leaves_;
+  std::vector<inner_t> inners_;
+  std::vector<node_id_t> free_leaves_;
+  std::vector<node_id_t> free_inners_;
+  node_id_t root_;
+  // 0 - корень лист
+  size_t height_;
+  size_t size_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_rating_index_h
@@ -0,0 +1,156 @@
+#ifndef traders_rating_rating_result_h
+#define traders_rating_rating_result_h
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+
+namespace traders_rating {
+
+// секции сообщения рейтинга; разностное сообщение содержит только
+// изменившиеся с прошлого сообщения пользователю
+enum rating_section_t : uint32_t {
+  // amount и rank
+  section_user = 1,
+  section_top = 2,
+  section_above = 4,
+  section_below = 8,
+  section_all = 15
+};
+
+/*
+ *
+ */
+struct rating_result_t {
+  using user_set_t = std::set<user_id_t>;
+  using rating_t = std::map<amount_t, user_set_t, std::greater<amount_t>>;
+  // топ рейтинга один на все сообщения одной публикации
+  using top_users_t = std::shared_ptr<const rating_t>;
+
+  time_t ts;
+  user_id_t user_id;
+  amount_t amount;
+  // позиция пользователя в рейтинге, начиная с 1
+  uint64_t rank;
+  // rating_section_t; топ отсутствующей секции - nullptr,
+  // соседи - пустые
+  uint32_t sections;
+
+  top_users_t top_users;
+  rating_t above_users;
+  rating_t below_users;
+};
+
+using upload_result_callback = std::function<void(const rating_result_t&)>;
+
+/*
+ * Плоское сообщение рейтинга: секции - массивы фиксированной емкости,
+ * записи в них упорядочены по позиции. Не выделяет память, один объект
+ * переиспользуется для всех сообщений публикации.
+ */
+struct rating_entry_t {
+  // позиция в рейтинге, начиная с 1
+  uint64_t rank;
+  user_id_t user_id;
+  amount_t amount;
+};
+
+struct flat_rating_result_t {
+  static const size_t top_capacity = 10;
+  static const size_t neighbours_capacity = 10;
+  using top_t = std::array<rating_entry_t, top_capacity>;
+  using neighbours_t = std::array<rating_entry_t, neighbours_capacity>;
+
+  time_t ts;
+  user_id_t user_id;
+  amount_t amount;
+  uint64_t rank;
+  // rating_section_t: секции, которые есть в сообщении; размер
+  // отсутствующей секции 0, ее значения прежние у получателя
+  uint32_t sections;
+
+  uint32_t top_size;
+  uint32_t above_size;
+  uint32_t below_size;
+  top_t top;
+  neighbours_t above;
+  neighbours_t below;
+};
+
+using upload_flat_result_callback =
+    std::function<void(const flat_rating_result_t&)>;
+// results[0..count) действительны только до возврата из функции
+using upload_batch_callback =
+    std::function<void(const flat_rating_result_t* results, size_t count)>;
+
+void to_rating_result(const flat_rating_result_t&, rating_result_t&);
+// накладывает сообщение (полное или разностное) на последнее состояние
+// рейтинга пользователя, позиции соседей пересчитываются от rank
+void apply_rating_result(const flat_rating_result_t& res,
+                         flat_rating_result_t& state);
+
+// отпечаток секции для разностной рассылки, никогда не равен 0;
+// позиции записей не учитываются: записи секции идут подряд, и их
+// позиции следуют из позиции пользователя (топ - с первой)
+uint64_t fingerprint(const rating_entry_t* entries, uint32_t size);
+uint64_t fingerprint(amount_t amount, uint64_t rank);
+
+/*
+ * Получатель сообщений рейтинга. Сообщение заполняется прямо в буфере
+ * получателя: next() возвращает место под очередное сообщение, commit()
+ * отмечает его готовым, flush() в конце публикации отдает остаток.
+ * upload_batch_callback получает сообщения пачками по batch_size
+ * (0 - вся публикация одной пачкой), upload_flat_result_callback -
+ * по одному как есть, upload_result_callback - по одному,
+ * преобразованными в rating_result_t; блок топа при этом строится
+ * заново только когда топ изменился.
+ * upload(results, count) отдает готовые сообщения из чужого буфера:
+ * upload_batch_callback получает их одной пачкой без копирования.
+ * Получатель не потокобезопасен; копии одного получателя можно
+ * использовать из разных потоков, если задать им общий callback_mutex:
+ * под ним вызывается только функция получателя, а сборка сообщений в
+ * буфере копии идет без блокировок.
+ */
+class rating_sink {
+ public:
+  explicit rating_sink(upload_result_callback);
+  explicit rating_sink(upload_flat_result_callback);
+  rating_sink(upload_batch_callback, size_t batch_size);
+
+  flat_rating_result_t& next();
+  void commit();
+  void flush();
+  void upload(const flat_rating_result_t&);
+  void upload(const flat_rating_result_t* results, size_t count);
+  // nullptr - без блокировки; mutex должен пережить получателя
+  void set_callback_mutex(std::mutex*);
+
+ private:
+  upload_result_callback upload_result_callback_;
+  upload_flat_result_callback upload_flat_result_callback_;
+  upload_batch_callback upload_batch_callback_;
+  size_t batch_size_;
+  std::vector<flat_rating_result_t> results_;
+  size_t size_;
+
+  rating_result_t result_;
+  flat_rating_result_t::top_t top_;
+  uint32_t top_size_;
+  std::mutex* callback_mt_;
+
+ private:
+  std::unique_lock<std::mutex> lock_callback();
+  void upload_converted(const flat_rating_result_t&);
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_rating_result_h
@@ -0,0 +1,76 @@
+#ifndef traders_rating_rating_snapshot_h
+#define traders_rating_rating_snapshot_h
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+#include "traders_rating/flat_hash_map.h"
+#include "traders_rating/rating_index.h"
+#include "traders_rating/rating_result.h"
+#include "traders_rating/user_directory.h"
+
+namespace traders_rating {
+
+/*
+ * Неизменяемый снимок недельного рейтинга: записи подряд по местам и
+ * ключ каждого пользователя по плотному индексу. Поток недели заполняет
+ * снимок после свертки минуты и публикует его (см. double_buffer.h),
+ * после этого снимок только читается, из любого числа потоков.
+ * Место пользователя - двоичный поиск его ключа, O(log n); топ и
+ * соседи - последовательное чтение массива.
+ */
+class rating_snapshot {
+ public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  rating_snapshot();
+
+  // номер снимка с начала недели, 0 - снимков не было
+  uint64_t version() const { return version_; }
+  // конец последней свернутой минуты
+  time_t ts() const { return ts_; }
+  size_t size() const { return entries_.size(); }
+
+  // индекс пользователя с оборотом за неделю или user_directory::npos;
+  // читателям без доступа к user_directory сервиса
+  user_index_t find(user_id_t) const;
+  // позиция пользователя (0 - первое место) или npos, если у него нет
+  // оборота за неделю
+  size_t position(user_index_t) const;
+  // ключ пользователя с оборотом; false - его нет в снимке
+  bool key(user_index_t, rating_index::entry_t&) const;
+  // количество записей, стоящих перед ключом (amount, user_id)
+  size_t rank(amount_t, user_id_t) const;
+  const rating_index::entry_t& at(size_t position) const {
+    return entries_[position];
+  }
+  // записи мест [first, last) в out, возвращает их количество
+  size_t range(size_t first, size_t last, rating_entry_t* out) const;
+  // сообщение как при рассылке: топ, пользователь и соседи, все
+  // секции; false - пользователя нет в рейтинге
+  bool get_result(user_index_t, time_t, flat_rating_result_t&) const;
+
+  // для потока недели: заполняет снимок по индексу и суммам недели
+  void assign(uint64_t version, time_t ts, const rating_index&,
+              const std::vector<amount_t>& amounts,
+              const std::vector<user_id_t>& user_ids,
+              const std::vector<uint8_t>& has_amount);
+
+ private:
+  uint64_t version_;
+  time_t ts_;
+  std::vector<rating_index::entry_t> entries_;
+  // ключ пользователя по user_index_t, amount не задан у пользователей
+  // без оборота
+  std::vector<rating_index::entry_t> users_;
+  std::vector<uint8_t> ranked_;
+  // user_id -> user_index_t пользователей с оборотом
+  flat_hash_map<user_index_t> indices_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_rating_snapshot_h
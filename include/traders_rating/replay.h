@@ -0,0 +1,96 @@
+#ifndef traders_rating_replay_h
+#define traders_rating_replay_h
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+#include "traders_rating/event_feed.h"
+#include "traders_rating/rating_result.h"
+#include "traders_rating/service.h"
+#include "traders_rating/user_directory.h"
+
+namespace traders_rating {
+
+/*
+ * Статистика одной минуты воспроизведения.
+ */
+struct replay_minute_t {
+  time_t minute_ts = 0;
+  // событий с меткой времени внутри минуты
+  uint64_t events = 0;
+  // результатов в публикации этой минуты
+  uint64_t results = 0;
+  // время свертки минуты в недельный рейтинг и публикации
+  uint64_t fold_ns = 0;
+  uint64_t publish_ns = 0;
+};
+
+struct replay_report_t {
+  uint64_t events = 0;
+  uint64_t results = 0;
+  uint64_t elapsed_ns = 0;
+  std::vector<replay_minute_t> minutes;
+
+  double events_per_second() const;
+};
+
+/*
+ * Детерминированное воспроизведение записанного потока событий в одном
+ * потоке. Часы модели продвигаются метками времени событий; конвейер
+ * минута -> неделя -> публикация тот же, что в service: минута
+ * сворачивается в недельный рейтинг по ее окончании, рейтинг публикуется
+ * через секунду, неделя сменяется после последней публикации. Пропуски
+ * в потоке проходятся поминутно, поэтому каждая минута публикуется;
+ * недели без событий целиком пропускаются, поэтому число шагов до
+ * далекой метки времени не больше недели минут.
+ * Ожиданий нет, воспроизведение идет с максимальной скоростью.
+ */
+class replay {
+ public:
+  explicit replay(const rating_sink&);
+  replay(const replay&) = delete;
+  replay& operator=(const replay&) = delete;
+
+  void on_events(const event_record_t* const* events, size_t count);
+  // досчитывает открытую минуту и публикует ее
+  void finish();
+  // текущее время модели
+  time_t now() const;
+  const replay_report_t& report() const;
+
+ private:
+  void init(time_t ts);
+  void start_week(time_t ts);
+  void advance(time_t ts);
+  void close_minute();
+  void publish();
+  void handle_event(const event_record_t&);
+  void get_connected_users(std::vector<user_index_t>&);
+
+ private:
+  rating_sink rating_sink_;
+  time_t now_;
+  bool started_;
+  std::pair<time_t, time_t> minute_times_;
+  minute_rating_uptr minute_rating_;
+  week_rating_uptr week_rating_;
+  // публикация через секунду после конца минуты
+  bool publish_pending_;
+  time_t publish_ts_;
+  size_t publish_minute_;
+  user_directory users_;
+  replay_report_t report_;
+};
+
+// воспроизводит поток событий из файла или дескриптора (path == "-")
+replay_report_t replay_feed(const std::string& path, const rating_sink&);
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_replay_h
@@ -1,8 +1,6 @@
 #ifndef traders_rating_service_h
 #define traders_rating_service_h
 
-#include <unordered_map>
-#include <unordered_set>
 #include <string>
 #include <map>
 #include <set>
@@ -13,120 +11,376 @@
 #include <atomic>
 #include <thread>
 #include <iterator>
+#include <functional>
+#include <vector>
 
 #include "traders_rating/cmds.h"
+#include "traders_rating/rating_index.h"
+#include "traders_rating/rating_result.h"
+#include "traders_rating/rating_snapshot.h"
+#include "traders_rating/cmd_queue.h"
+#include "traders_rating/deadline_scheduler.h"
+#include "traders_rating/double_buffer.h"
+#include "traders_rating/event_feed.h"
+#include "traders_rating/flat_hash_map.h"
+#include "traders_rating/user_directory.h"
+#include "traders_rating/wait_strategy.h"
+#include "traders_rating/worker_pool.h"
 
 namespace traders_rating {
 
 /*
  *
  */
-class minute_rating {
- private:
-  using user_won_amount_t = std::unordered_map<user_id_t, amount_t>;
-  using value_type = std::pair<user_id_t, amount_t>;
+class minute_rating;
+class minute_rating_pool;
+
+// возвращает минуту в пул, если она из пула, иначе удаляет
+struct minute_rating_deleter {
+  std::shared_ptr<minute_rating_pool> pool;
+  void operator()(minute_rating*) const;
+};
 
+class minute_rating {
  public:
-  class iterator : public std::iterator<std::input_iterator_tag, value_type> {
-   public:
-    explicit iterator(user_won_amount_t::const_iterator itr) : itr_(itr) {}
-    const value_type operator*() const { return *itr_; }
-    bool operator!=(iterator other) const { return itr_ != other.itr_; }
-    iterator& operator++() {
-      ++itr_;
-      return *this;
-    }
-
-   private:
-    user_won_amount_t::const_iterator itr_;
+  struct entry_t {
+    user_index_t index;
+    user_id_t user_id;
+    amount_t amount;
   };
+  using iterator = std::vector<entry_t>::const_iterator;
 
  public:
-  minute_rating(time_t start, time_t finish);
-  void on_user_deal_won(time_t, user_id_t, amount_t);
+  // expected_users - под сколько пользователей выделить память сразу
+  minute_rating(time_t start, time_t finish, size_t expected_users = 0);
+  // index - плотный индекс user_id (см. user_directory.h); сумма вне
+  // диапазона (см. valid_amount) - std::invalid_argument
+  void on_user_deal_won(time_t, user_index_t, user_id_t, amount_t);
+  // начинает новую минуту; очищаются только записи прошлой минуты,
+  // память сохраняется
+  void reset(time_t start, time_t finish);
+  // упорядочивает записи по index; вызывается после закрытия минуты
+  // потоком недельного рейтинга, а не потоком приема сделок
+  void sort_by_index();
   time_t start_ts() const;
   time_t finish_ts() const;
-  iterator begin() const { return iterator(user_won_amount_.begin()); }
-  iterator end() const { return iterator(user_won_amount_.end()); }
+  size_t size() const { return entries_.size(); }
+  size_t capacity() const { return entries_.capacity(); }
+  // по записи на пользователя в порядке первой сделки за минуту или
+  // по возрастанию index после sort_by_index
+  iterator begin() const { return entries_.begin(); }
+  iterator end() const { return entries_.end(); }
 
  private:
+  friend class minute_rating_pool;
   time_t start_ts_;
   time_t finish_ts_;
-  user_won_amount_t user_won_amount_;
+  // позиция записи пользователя в entries_ + 1 по user_index_t,
+  // 0 - сделок за минуту не было
+  std::vector<uint32_t> position_;
+  std::vector<entry_t> entries_;
 };
-using minute_rating_uptr = std::unique_ptr<minute_rating>;
+using minute_rating_uptr =
+    std::unique_ptr<minute_rating, minute_rating_deleter>;
+
+/*
+ * Пул минутных рейтингов. Поток сервиса берет минуту из пула, недельный
+ * рейтинг после update_week_rating просто освобождает ее - deleter
+ * очищает минуту в потоке недельного рейтинга и возвращает ее в пул.
+ * Память минут выделена заранее и не освобождается, поэтому в
+ * установившемся режиме смена минуты не выделяет память.
+ */
+class minute_rating_pool
+    : public std::enable_shared_from_this<minute_rating_pool> {
+ public:
+  static std::shared_ptr<minute_rating_pool> create(size_t expected_users,
+                                                    size_t max_free = 4);
+  minute_rating_pool(const minute_rating_pool&) = delete;
+  minute_rating_pool& operator=(const minute_rating_pool&) = delete;
 
-struct rating_result_t {
-  using user_set_t = std::set<user_id_t>;
-  using rating_t = std::map<amount_t, user_set_t, std::greater<amount_t>>;
+  minute_rating_uptr acquire(time_t start, time_t finish);
+  // сколько минут создано пулом и сколько из них сейчас свободно
+  size_t allocated() const;
+  size_t free_size() const;
 
-  time_t ts;
-  user_id_t user_id;
-  amount_t amount;
+ private:
+  friend struct minute_rating_deleter;
+  minute_rating_pool(size_t expected_users, size_t max_free);
+  void release(minute_rating*);
 
-  rating_t top_users;
-  rating_t above_users;
-  rating_t below_users;
+ private:
+  const size_t expected_users_;
+  const size_t max_free_;
+  mutable std::mutex mt_;
+  std::vector<std::unique_ptr<minute_rating>> free_;
+  size_t allocated_;
 };
 
-using upload_result_callback = std::function<void(const rating_result_t&)>;
-
 /*
  *
  */
-using get_connected_callback = std::function<void(std::vector<user_id_t>&)>;
-using time_function_t = std::function<time_t(time_t*)>;
+// заполняет плотные индексы подключенных пользователей
+using get_connected_callback =
+    std::function<void(std::vector<user_index_t>&)>;
+
+struct delivery_config_t {
+  // на сколько секунд растягивается рассылка каждой минуты (не больше
+  // 59), 0 - всем сразу через секунду после конца минуты
+  uint32_t window = 0;
+  // разностный режим: для каждого пользователя хранятся отпечатки
+  // секций последнего сообщения; сообщение без изменений не
+  // отправляется, иначе в нем только изменившиеся секции. После
+  // подключения пользователь получает полное сообщение
+  bool delta = false;
+  // исполнителей сборки сообщений, включая поток week_rating; при
+  // workers > 1 подключенные делятся на части по fanout_chunk
+  // пользователей, части собираются пулом потоков
+  uint32_t workers = 1;
+  // после каждой свертки минуты публикуется снимок рейтинга для чтения
+  // из других потоков (см. week_rating::read_snapshot); снимок - копия
+  // рейтинга, O(пользователей) на каждую минуту. Подключившимся рейтинг
+  // отправляется по снимку сразу, без потока недели
+  bool snapshots = false;
+};
+
+// рассылка рейтинга за одну минуту и с начала недели
+struct delivery_stats_t {
+  // публикаций (минут) и сообщений с начала недели
+  uint64_t minutes = 0;
+  uint64_t messages = 0;
+  // сообщений, пропущенных в разностном режиме без изменений, и
+  // отправленных записей rating_entry_t (топ и соседи)
+  uint64_t unchanged = 0;
+  uint64_t entries = 0;
+  // сообщений, отправленных сразу после подключения (в messages не
+  // входят)
+  uint64_t connect_messages = 0;
+  // последняя публикация: сообщений и наибольшее число за секунду
+  uint64_t last_messages = 0;
+  uint64_t last_peak = 0;
+  // наибольшее число сообщений за секунду с начала недели
+  uint64_t max_peak = 0;
+  // пик к среднему за минуту для последней публикации: 60 - вся
+  // рассылка за одну секунду, около 1 - равномерно по всей минуте
+  double peak_to_average() const {
+    return last_messages > 0 ? last_peak * 60.0 / last_messages : 0;
+  }
+};
 
 class week_rating {
  public:
   week_rating(time_t start, time_t finish, get_connected_callback,
               upload_result_callback, time_function_t = &time);
+  week_rating(time_t start, time_t finish, get_connected_callback,
+              upload_flat_result_callback, time_function_t = &time);
+  week_rating(time_t start, time_t finish, get_connected_callback,
+              const rating_sink&, time_function_t = &time,
+              const wait_config_t& = wait_config_t(),
+              const delivery_config_t& = delivery_config_t());
   void start();
   void stop();
   void on_minute(minute_rating_uptr);
+  // вызывается до того, как пользователь попадет в снимок подключенных.
+  // Поток недели отправляет пользователю полный рейтинг по текущему
+  // индексу, не дожидаясь конца минуты: запросы проверяются перед
+  // сверткой каждой минуты, между частями рассылки и при простое.
+  // Цель - до 50 мкс до сообщения, если поток недели свободен (см.
+  // BM_ConnectRating). Со снимками рейтинг отправляется по последнему
+  // снимку в потоке вызывающего и не ждет свертки минуты; поток недели
+  // отвечает только тем, кого еще нет в снимке
+  void on_user_connected(user_index_t);
   time_t start_ts() const;
+  time_t finish_ts() const;
   bool started() const;
   bool finished() const;
 
+  // синхронный режим без start(): минуты и публикации задает вызывающий
+  // (см. replay.h); минута упорядочивается по index
+  void update_week_rating(minute_rating& mr);
+  // отправляет рейтинг всем подключенным сразу, возвращает количество
+  // отправленных результатов
+  size_t send_rating();
+  // отправляет рейтинг подключившимся после прошлого вызова, возвращает
+  // количество отправленных; без start() вызывается вручную
+  size_t send_connected();
+  delivery_stats_t delivery_stats() const;
+
+  // f(const rating_snapshot&) для последнего опубликованного снимка; из
+  // любого потока без ожиданий, пока поток недели сворачивает следующую
+  // минуту. До первого снимка version() == 0 и рейтинг пуст
+  template <typename F>
+  void read_snapshot(F f) const {
+    snapshots_.read(f);
+  }
+
  private:
   void execute();
+  void fold_minute(minute_rating& mr);
+  void publish_snapshot(time_t ts);
+  // полный рейтинг подключившемуся по снимку; false - его нет в снимке
+  bool send_snapshot_rating(user_index_t);
+  // снимок подключенных, разбиение пользователей на slices частей
+  void prepare_delivery(uint32_t slices);
+  size_t send_slice(uint32_t slice);
+  // top_ и top_fingerprint_ по текущему индексу
+  void take_top();
+  // false - в разностном режиме сообщение не нужно
+  bool build_result(user_index_t, time_t, flat_rating_result_t& res);
+  // все секции, кроме топа
+  void fill_result(user_index_t, time_t, flat_rating_result_t& res) const;
+  // оставляет в res только изменившиеся секции, false - изменений нет
+  bool make_delta(user_index_t, uint64_t top_fingerprint,
+                  flat_rating_result_t& res);
+
+  struct delivery_counts_t {
+    uint64_t messages = 0;
+    uint64_t unchanged = 0;
+    uint64_t entries = 0;
+  };
+  // сборка delivery_users_[first, last) пулом потоков
+  void send_parallel(size_t first, size_t last, time_t,
+                     delivery_counts_t& counts);
+  // пул создается при первом использовании
+  worker_pool& workers();
+  // упорядочивает ключи по рейтингу; при workers > 1 большие массивы
+  // сортируются пулом по частям не меньше sort_chunk
+  void sort_by_rating(std::vector<rating_index::entry_t>&);
 
  private:
-  using same_amount_users_t = std::unordered_set<user_id_t>;
-  using rating_by_amount_t =
-      std::map<amount_t, same_amount_users_t, std::greater<amount_t>>;
   using minute_ratings_t = std::queue<minute_rating_uptr>;
-  using user_won_amount_t = std::unordered_map<user_id_t, amount_t>;
 
  private:
   time_t start_ts_;
   time_t finish_ts_;
   std::mutex mt_;
-  std::condition_variable cv_;
+  idle_waiter waiter_;
   std::thread th_;
   std::atomic_bool finish_thread_;
   minute_ratings_t minute_ratings_;
-  rating_by_amount_t rating_by_amount_;
-  user_won_amount_t user_won_amount_;
+  std::atomic_bool minutes_pending_;
+  rating_index rating_index_;
+  // свертка минуты: прежние и новые ключи индекса, упорядоченные по
+  // рейтингу, чтобы соседние изменения попадали в соседние листья;
+  // так сворачиваются минуты, в которых изменен хотя бы каждый
+  // fold_batch_density-й ключ индекса. Если изменен хотя бы каждый
+  // fold_rebuild_density-й, индекс строится заново из всех сумм
+  static const size_t fold_batch_density = 32;
+  static const size_t fold_rebuild_density = 3;
+  static const size_t sort_chunk = 1 << 14;
+  std::vector<rating_index::entry_t> fold_erased_;
+  std::vector<rating_index::entry_t> fold_inserted_;
+  std::vector<rating_index::entry_t> fold_scratch_;
+  // недельные суммы по user_index_t
+  std::vector<amount_t> amounts_;
+  std::vector<user_id_t> user_ids_;
+  std::vector<uint8_t> has_amount_;
   get_connected_callback get_connected_callback_;
-  upload_result_callback upload_result_callback_;
+  rating_sink rating_sink_;
   time_function_t time_function_;
   std::atomic_bool thread_started_;
   std::atomic_bool thread_finished_;
 
  private:
-  void update_week_rating(const minute_rating& mr);
-  void send_rating();
+  // буферы публикации, переиспользуются между вызовами send_rating;
+  // топ берется заново для каждой части рассылки
+  std::vector<user_index_t> connected_users_;
+  flat_rating_result_t::top_t top_;
+  uint32_t top_size_;
+
+  // рассылка по частям: часть i - пользователи с index % slices_ == i,
+  // delivery_users_[slice_offsets_[i], slice_offsets_[i + 1])
+  const delivery_config_t delivery_config_;
+  std::vector<user_index_t> delivery_users_;
+  std::vector<size_t> slice_offsets_;
+  std::vector<size_t> slice_positions_;
+  uint32_t slices_;
+  uint32_t next_slice_;
+
+  // отпечатки секций последнего сообщения по user_index_t,
+  // 0 - сообщений еще не было
+  struct delivered_t {
+    uint64_t user;
+    uint64_t top;
+    uint64_t above;
+    uint64_t below;
+  };
+  std::vector<delivered_t> delivered_;
+  uint64_t top_fingerprint_;
+  // подключившиеся после прошлого send_connected, защищен mt_
+  std::vector<user_index_t> connected_since_;
+  std::atomic_bool connects_pending_;
+  std::vector<user_index_t> connect_users_;
+  // получившие рейтинг по снимку после прошлого send_connected и
+  // отпечатки ответа, защищен mt_; только в разностном режиме, отпечатки
+  // переносит в delivered_ поток недели
+  struct answered_t {
+    user_index_t index;
+    delivered_t delivered;
+  };
+  std::vector<answered_t> answered_since_;
+  std::vector<answered_t> answered_users_;
+
+  // параллельная сборка: пока поток week_rating ждет пул, индекс и
+  // суммы не меняются, и исполнители читают их без блокировок; каждый
+  // собирает часть в свой буфер и отдает его rating_sink_ под sink_mt_.
+  // Вне пула rating_sink_ использует только поток недели
+  static const size_t fanout_chunk = 512;
+  struct fanout_buffer_t {
+    std::vector<flat_rating_result_t> results;
+    delivery_counts_t counts;
+  };
+  std::unique_ptr<worker_pool> pool_;
+  std::vector<fanout_buffer_t> fanout_;
+  std::mutex sink_mt_;
+  // ответы по снимку из потока сервиса: своя копия получателя, с
+  // rating_sink_ у нее общий только callback_mt_, который держится лишь
+  // на время вызова функции получателя, а не сборки части рассылки
+  rating_sink connect_sink_;
+  std::mutex callback_mt_;
+
+  double_buffer<rating_snapshot> snapshots_;
+
+  mutable std::mutex stats_mt_;
+  delivery_stats_t stats_;
+  time_t stats_second_;
+  uint64_t stats_second_messages_;
 };
 
 using week_rating_uptr = std::unique_ptr<week_rating>;
+using week_rating_sptr = std::shared_ptr<week_rating>;
 
 /*
  *
  */
+struct service_config_t {
+  // емкость очереди команд, округляется до степени двойки
+  size_t cmd_queue_capacity = 1 << 16;
+  // сколько команд поток сервиса обрабатывает между проверками времени
+  size_t cmd_batch_size = 256;
+  // байт, зарезервированных под имя в каждой ячейке буфера имен
+  size_t cmd_name_capacity = 64;
+  // размер пачки для upload_batch_callback, 0 - вся публикация
+  size_t upload_batch_size = 1024;
+  // ожидание потоков сервиса и недельного рейтинга, когда работы нет
+  wait_config_t wait;
+  // итераций цикла с командами между чтениями часов
+  uint32_t clock_check_interval = 64;
+  // ожидаемое число пользователей с выигрышами за минуту; под него
+  // заранее выделяется память минутных рейтингов
+  size_t minute_expected_users = 1 << 12;
+  delivery_config_t delivery;
+};
+
 class service {
  public:
-  service(upload_result_callback, time_function_t = &time);
+  service(upload_result_callback, time_function_t = &time,
+          const service_config_t& = service_config_t());
+  service(upload_flat_result_callback, time_function_t = &time,
+          const service_config_t& = service_config_t());
+  service(upload_batch_callback, time_function_t = &time,
+          const service_config_t& = service_config_t());
+  service(const rating_sink&, time_function_t = &time,
+          const service_config_t& = service_config_t());
   void start();
   void stop();
 
@@ -134,56 +388,73 @@ class service {
   void on_user_renamed(user_id_t, const user_name_t&);
   void on_user_connected(user_id_t);
   void on_user_disconnected(user_id_t);
+  // сумма вне диапазона (см. valid_amount) - std::invalid_argument, как
+  // и сделка с такой суммой в on_events; команда тогда не ставится
   void on_user_deal_won(time_t, user_id_t, amount_t);
+  // пачка записей двоичного потока событий, см. event_feed.h
+  void on_events(const event_record_t* const* events, size_t count);
 
   bool is_user_registered(user_id_t) const;
   bool is_user_connected(user_id_t) const;
   uint64_t processed_cmds() const;
+  // статистика рассылки текущей недели
+  delivery_stats_t delivery_stats() const;
+  // рейтинг пользователя по последнему снимку текущей недели (нужен
+  // config.delivery.snapshots); false - пользователя нет в рейтинге.
+  // Из любого потока без блокировок сервиса
+  bool get_rating(user_id_t, flat_rating_result_t&) const;
 
  private:
-  using optional_cmd_t = std::pair<bool, cmd_uptr>;
-  using archive_week_ratings_t = std::map<time_t, week_rating_uptr>;
-  using registered_users_t = std::unordered_map<user_id_t, user_name_t>;
-  using connected_users_t = std::unordered_set<user_id_t>;
+  using archive_week_ratings_t = std::map<time_t, week_rating_sptr>;
 
  private:
-  std::atomic_flag lock;
-  std::queue<cmd_uptr> cmds_;
+  service_config_t config_;
+  cmd_queue cmds_;
+  idle_waiter waiter_;
   std::thread th_;
   std::atomic_bool finish_thread_;
   time_function_t time_function_;
+  // сроки потока сервиса; минута закрывается раньше смены недели
+  // с тем же сроком
+  enum : deadline_scheduler::timer_id_t { minute_close, week_rollover };
+  deadline_scheduler timers_;
 
   mutable std::mutex mt_;
   std::condition_variable cv_;
 
-  week_rating_uptr this_week_rating_;
+  // заменяется потоком сервиса под mt_
+  week_rating_sptr this_week_rating_;
+  // для get_rating: та же неделя, читается и заменяется только через
+  // std::atomic_load и std::atomic_store. Читатель держит свою ссылку,
+  // поэтому замененная неделя освобождается после последнего читателя
+  week_rating_sptr current_week_;
   minute_rating_uptr this_minute_rating_;
+  // прошедшие недели, пока их потоки досылают рейтинг; завершившиеся
+  // удаляются при смене недели и в конце потока сервиса
   archive_week_ratings_t archive_week_ratings_;
 
-  user_registered_callback user_registered_callback_;
-  user_renamed_callback user_renamed_callback_;
-  user_connected_callback user_connected_callback_;
-  user_disconnected_callback user_disconnected_callback_;
-  user_deal_won_callback user_deal_won_callback_;
   get_connected_callback get_connected_callback_;
+  std::shared_ptr<minute_rating_pool> minute_pool_;
 
-  registered_users_t registered_users_;
-  connected_users_t connected_users_;
+  // читается потоком сервиса без mt_, изменяется им же под mt_
+  user_directory users_;
 
-  upload_result_callback upload_result_callback_;
+  rating_sink rating_sink_;
 
   std::atomic_uint_fast64_t processed_cmds_;
 
  private:
   void execute();
-  void add_cmd(cmd_uptr);
-  optional_cmd_t get_cmd();
+  void on_deadline(deadline_scheduler::timer_id_t, time_t);
+  void add_cmd(const cmd_t&);
+  void add_cmd(const cmd_t&, const user_name_t&);
+  void handle_cmd(const cmd_t&);
   void process_user_registered(user_id_t, const user_name_t&);
   void process_user_renamed(user_id_t, const user_name_t&);
   void process_user_connected(user_id_t);
   void process_user_disconnected(user_id_t);
   void process_user_deal_won(time_t, user_id_t, amount_t);
-  void get_connected_users(std::vector<user_id_t>&);
+  void get_connected_users(std::vector<user_index_t>&);
 };
 }
 
@@ -0,0 +1,144 @@
+#ifndef traders_rating_sharded_service_h
+#define traders_rating_sharded_service_h
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "traders_rating/cmd_queue.h"
+#include "traders_rating/rating_index.h"
+#include "traders_rating/rating_snapshot.h"
+#include "traders_rating/service.h"
+#include "traders_rating/user_directory.h"
+#include "traders_rating/wait_strategy.h"
+
+namespace traders_rating {
+
+/*
+ * Шардированный режим сервиса: пользователи распределяются по шардам
+ * по user_id, у каждого шарда свой поток, своя очередь команд и свои
+ * минутный и недельный рейтинги. Поток публикации раз в минуту сливает
+ * упорядоченные индексы шардов в общий рейтинг: топ-10, позицию и
+ * +-10 соседей каждого подключенного пользователя.
+ */
+struct sharded_service_config_t : service_config_t {
+  size_t shards = 4;
+};
+
+class rating_shard {
+ public:
+  // folded - будится после каждой свертки минуты шардом
+  rating_shard(const sharded_service_config_t&, time_function_t,
+               idle_waiter* folded = nullptr);
+  void start();
+  void stop();
+  // будит поток шарда, чтобы он сразу проверил часы
+  void wake();
+  void add_cmd(const cmd_t&);
+  void add_cmd(const cmd_t&, const user_name_t&);
+
+  bool is_user_registered(user_id_t) const;
+  bool is_user_connected(user_id_t) const;
+  uint64_t processed_cmds() const;
+  // конец последней минуты, учтенной в недельном рейтинге шарда
+  time_t folded_until() const;
+
+  // для потока публикации: копирует недельный рейтинг шарда, свертка
+  // ждет только саму копию
+  void copy_rating(rating_snapshot&) const;
+  // добавляет плотные индексы подключенных пользователей шарда
+  void get_connected_users(std::vector<user_index_t>&) const;
+
+ private:
+ private:
+  sharded_service_config_t config_;
+  cmd_queue cmds_;
+  idle_waiter waiter_;
+  std::thread th_;
+  std::atomic_bool finish_thread_;
+  time_function_t time_function_;
+  enum : deadline_scheduler::timer_id_t { minute_close };
+  deadline_scheduler timers_;
+
+  mutable std::mutex mt_;
+  // поиск без mt_ - только в потоке шарда, изменения под mt_
+  user_directory users_;
+
+  minute_rating_uptr this_minute_rating_;
+  std::pair<time_t, time_t> this_week_times_;
+  std::atomic<time_t> folded_until_;
+  idle_waiter* folded_waiter_;
+
+  mutable std::mutex index_mt_;
+  // недельные суммы по user_index_t
+  std::vector<amount_t> amounts_;
+  std::vector<user_id_t> user_ids_;
+  std::vector<uint8_t> has_amount_;
+  rating_index rating_index_;
+
+  std::atomic_uint_fast64_t processed_cmds_;
+
+ private:
+  void execute();
+  void handle_cmd(const cmd_t&);
+  void close_minute(time_t);
+  void fold_minute(const minute_rating&);
+};
+
+using rating_shard_uptr = std::unique_ptr<rating_shard>;
+
+class sharded_service {
+ public:
+  sharded_service(upload_result_callback, time_function_t = &time,
+                  const sharded_service_config_t& = sharded_service_config_t());
+  sharded_service(upload_flat_result_callback, time_function_t = &time,
+                  const sharded_service_config_t& = sharded_service_config_t());
+  sharded_service(upload_batch_callback, time_function_t = &time,
+                  const sharded_service_config_t& = sharded_service_config_t());
+  sharded_service(const rating_sink&, time_function_t = &time,
+                  const sharded_service_config_t& = sharded_service_config_t());
+  void start();
+  void stop();
+
+  void on_user_registered(user_id_t, const user_name_t&);
+  void on_user_renamed(user_id_t, const user_name_t&);
+  void on_user_connected(user_id_t);
+  void on_user_disconnected(user_id_t);
+  // сумма вне диапазона (см. valid_amount) - std::invalid_argument
+  void on_user_deal_won(time_t, user_id_t, amount_t);
+
+  bool is_user_registered(user_id_t) const;
+  bool is_user_connected(user_id_t) const;
+  uint64_t processed_cmds() const;
+  size_t shards() const;
+
+ private:
+  sharded_service_config_t config_;
+  std::vector<rating_shard_uptr> shards_;
+  std::thread th_;
+  idle_waiter waiter_;
+  std::atomic_bool finish_thread_;
+  time_function_t time_function_;
+  rating_sink rating_sink_;
+
+  // буферы публикации, переиспользуются между вызовами send_rating;
+  // сообщения собираются по копиям рейтингов шардов без их блокировок
+  std::vector<std::unique_ptr<rating_snapshot>> shard_ratings_;
+  std::vector<user_index_t> connected_users_;
+  std::vector<rating_index::entry_t> top_;
+  std::vector<rating_index::entry_t> above_;
+  std::vector<rating_index::entry_t> below_;
+
+ private:
+  rating_shard& shard(user_id_t) const;
+  void execute();
+  void wait_folded(time_t);
+  void send_rating();
+  void merge_neighbours(flat_rating_result_t&);
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_sharded_service_h
@@ -0,0 +1,66 @@
+#ifndef traders_rating_user_directory_h
+#define traders_rating_user_directory_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "traders_rating/cmds.h"
+#include "traders_rating/concurrent_bitmap.h"
+#include "traders_rating/flat_hash_map.h"
+
+namespace traders_rating {
+
+// плотный внутренний номер пользователя: 0, 1, 2, ... в порядке
+// появления user_id
+using user_index_t = uint32_t;
+
+/*
+ * Отображение разреженных user_id_t в плотные user_index_t и состояние
+ * пользователей в виде структуры массивов, индексированных user_index_t.
+ * Индекс выдается при регистрации (или первой сделке незарегистрированного
+ * пользователя) и не освобождается. Единственный поиск по хешу - find или
+ * insert по user_id; дальше состояние читается из массивов по индексу.
+ * Подключенные пользователи хранятся битовой картой по индексам.
+ * Не потокобезопасен, кроме connected(): карту можно читать из других
+ * потоков без блокировок, пока ее изменяет поток-владелец.
+ */
+class user_directory {
+ public:
+  static const user_index_t npos = ~user_index_t(0);
+
+  explicit user_directory(size_t expected_users = 0);
+  user_directory(const user_directory&) = delete;
+  user_directory& operator=(const user_directory&) = delete;
+
+  // npos, если у пользователя нет индекса
+  user_index_t find(user_id_t) const;
+  // индекс пользователя, новому пользователю выдается следующий
+  user_index_t insert(user_id_t);
+  size_t size() const { return ids_.size(); }
+
+  user_id_t user_id(user_index_t index) const { return ids_[index]; }
+  const user_name_t& name(user_index_t index) const { return names_[index]; }
+
+  // повторная регистрация имя не меняет
+  user_index_t register_user(user_id_t, const user_name_t&);
+  user_name_t* find_name(user_id_t);
+  bool is_registered(user_id_t) const;
+
+  // подключиться может только зарегистрированный пользователь
+  bool connect(user_id_t);
+  void disconnect(user_id_t);
+  bool is_connected(user_id_t) const;
+  const concurrent_bitmap& connected() const { return connected_; }
+
+ private:
+  flat_hash_map<user_index_t> index_;
+  std::vector<user_id_t> ids_;
+  std::vector<user_name_t> names_;
+  std::vector<uint8_t> registered_;
+  concurrent_bitmap connected_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_user_directory_h
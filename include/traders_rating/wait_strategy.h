@@ -0,0 +1,109 @@
+#ifndef traders_rating_wait_strategy_h
+#define traders_rating_wait_strategy_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace traders_rating {
+
+/*
+ * Стратегия ожидания потока-потребителя, когда работы нет:
+ * busy_spin  - крутится на pause, минимальная задержка, занимает ядро;
+ * spin_yield - spin_count итераций pause, затем yield на каждой;
+ * spin_park  - spin_count итераций pause, затем сон на futex (linux)
+ *              до пробуждения производителем или park_timeout;
+ * blocking   - сразу сон на condition_variable.
+ */
+enum class wait_strategy_t : uint8_t {
+  busy_spin,
+  spin_yield,
+  spin_park,
+  blocking
+};
+
+struct wait_config_t {
+  wait_strategy_t strategy = wait_strategy_t::spin_park;
+  uint32_t spin_count = 1000;
+  // наибольшее время сна: спящий поток проверяет время не реже
+  std::chrono::milliseconds park_timeout = std::chrono::milliseconds(100);
+};
+
+/*
+ * Ожидание одного потребителя и пробуждение его производителями.
+ * Потребитель вызывает idle(ready), пока работы нет, и reset(), когда
+ * она нашлась; ready() перепроверяет наличие работы после того, как
+ * поток объявил о засыпании, поэтому пробуждение не теряется.
+ * Производитель вызывает notify() после публикации работы; для
+ * busy_spin и spin_yield это пустая операция.
+ */
+class idle_waiter {
+ public:
+  explicit idle_waiter(const wait_config_t& = wait_config_t());
+  idle_waiter(const idle_waiter&) = delete;
+  idle_waiter& operator=(const idle_waiter&) = delete;
+
+  const wait_config_t& config() const { return config_; }
+
+  template <typename Ready>
+  void idle(Ready ready) {
+    if (config_.strategy == wait_strategy_t::busy_spin) {
+      cpu_relax();
+      return;
+    }
+    if (config_.strategy != wait_strategy_t::blocking &&
+        idle_count_ < config_.spin_count) {
+      ++idle_count_;
+      cpu_relax();
+      return;
+    }
+    if (config_.strategy == wait_strategy_t::spin_yield) {
+      yield();
+      return;
+    }
+    auto wake_seq = wake_seq_.load(std::memory_order_acquire);
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      park(wake_seq);
+    }
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+
+  void reset() { idle_count_ = 0; }
+
+  void notify() {
+    if (config_.strategy < wait_strategy_t::spin_park) {
+      return;
+    }
+    // публикация работы должна стать видна до проверки sleeping_
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      wake();
+    }
+  }
+
+  // число пробуждений спящего потока производителями
+  uint64_t wakeups() const;
+
+ private:
+  static void cpu_relax();
+  static void yield();
+  void park(uint32_t wake_seq);
+  void wake();
+
+ private:
+  const wait_config_t config_;
+  uint32_t idle_count_;
+  std::atomic<uint32_t> wake_seq_;
+  std::atomic_bool sleeping_;
+  std::atomic<uint64_t> wakeups_;
+  std::mutex mt_;
+  std::condition_variable cv_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_wait_strategy_h
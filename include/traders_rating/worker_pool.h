@@ -0,0 +1,72 @@
+#ifndef traders_rating_worker_pool_h
+#define traders_rating_worker_pool_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace traders_rating {
+
+/*
+ * Пул потоков для параллельного выполнения пронумерованных задач с
+ * перехватом работы. run() делит задачи [0, tasks) на непрерывные
+ * диапазоны по одному на исполнителя; исполнитель берет задачи с начала
+ * своего диапазона, а опустев, забирает половину конца чужого. Вызвавший
+ * run() поток - исполнитель 0, поэтому пул из workers исполнителей
+ * создает workers - 1 потоков. Между вызовами run() потоки спят.
+ * run() вызывается из одного потока за раз.
+ */
+class worker_pool {
+ public:
+  using task_t = std::function<void(size_t task, size_t worker)>;
+
+  explicit worker_pool(size_t workers);
+  ~worker_pool();
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+
+  size_t size() const { return queues_.size(); }
+
+  // возвращается, когда выполнены все задачи; первое исключение задачи
+  // пробрасывается вызывающему после завершения остальных
+  void run(size_t tasks, const task_t&);
+
+ private:
+  // диапазон задач исполнителя; заполнитель разносит очереди
+  // соседних исполнителей друг от друга по кэш-линиям
+  struct queue_t {
+    std::mutex mt;
+    size_t begin = 0;
+    size_t end = 0;
+    char padding[64];
+  };
+
+ private:
+  void execute(size_t worker);
+  void work(size_t worker);
+  bool pop(size_t worker, size_t& task);
+  bool steal(size_t worker);
+
+ private:
+  std::vector<std::unique_ptr<queue_t>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mt_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  bool finish_;
+  uint64_t generation_;
+  size_t active_;
+  const task_t* task_;
+  std::exception_ptr error_;
+};
+
+}  // namespace traders_rating
+
+#endif  // traders_rating_worker_pool_h
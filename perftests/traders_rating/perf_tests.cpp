@@ -3,8 +3,27 @@
 #include "traders_rating/service.h"
 #include "traders_rating/cmds.h"
 #include "traders_rating/utilities.h"
+#include "traders_rating/rating_index.h"
+#include "traders_rating/sharded_service.h"
+#include "traders_rating/event_feed.h"
+#include "traders_rating/replay.h"
+#include "traders_rating/wait_strategy.h"
+#include "traders_rating/calendar.h"
+#include "traders_rating/flat_hash_map.h"
+#include "traders_rating/concurrent_bitmap.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+
+#include <time.h>
 
 namespace tr = ::traders_rating;
 
@@ -17,12 +36,822 @@ static void BM_MinuteRatingInsert(benchmark::State& state) {
   tr::user_id_t user_id = 0;
   tr::user_id_t total_users = MAX_TEST_USER_ID;
   while (state.KeepRunning()) {
-    rating.on_user_deal_won(ts, ++user_id % total_users, 1.);
+    user_id = (user_id + 1) % total_users;
+    rating.on_user_deal_won(ts, user_id, user_id, 1.);
   }
 }
 
 BENCHMARK(BM_MinuteRatingInsert);
 
+// смена минуты: новая минута, 10000 пользователей, свертка не
+// измеряется; range(0) - без пула, range(1) - из пула
+static void BM_MinuteRollover(benchmark::State& state) {
+  const tr::user_id_t users = 10000;
+  auto pool = tr::minute_rating_pool::create(users);
+  time_t ts = 0;
+  while (state.KeepRunning()) {
+    tr::minute_rating_uptr rating =
+        state.range(0) != 0
+            ? pool->acquire(ts, ts + 60)
+            : tr::minute_rating_uptr(new tr::minute_rating(ts, ts + 60));
+    for (tr::user_id_t user_id = 0; user_id < users; ++user_id) {
+      rating->on_user_deal_won(ts, user_id, user_id * 31, 1.);
+    }
+    ts += 60;
+  }
+  state.SetItemsProcessed(state.iterations() * users);
+}
+
+BENCHMARK(BM_MinuteRollover)->Arg(0)->Arg(1);
+
+// свертка минуты из range(0) пользователей в недельный рейтинг
+// max(MAX_TEST_USER_ID, range(0)) пользователей, у которых суммы уже
+// есть; пользователи минуты в случайном порядке первой сделки
+static void BM_MinuteFold(benchmark::State& state) {
+  const size_t users = state.range(0);
+  const tr::user_id_t week_users =
+      std::max<tr::user_id_t>(MAX_TEST_USER_ID, users);
+  tr::week_rating week(
+      0, std::numeric_limits<time_t>::max(),
+      [](std::vector<tr::user_index_t>&) {},
+      tr::rating_sink(tr::upload_flat_result_callback(
+          [](const tr::flat_rating_result_t&) {})));
+  tr::minute_rating minute(0, 60, week_users);
+  for (tr::user_id_t user_id = 0; user_id < week_users; ++user_id) {
+    minute.on_user_deal_won(0, user_id, user_id * 31, 1 + user_id % 1000);
+  }
+  week.update_week_rating(minute);
+  std::vector<tr::user_id_t> order(week_users);
+  for (tr::user_id_t user_id = 0; user_id < week_users; ++user_id) {
+    order[user_id] = user_id;
+  }
+  std::mt19937 gen(1);
+  size_t items = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    minute.reset(0, 60);
+    // range(0) разных пользователей
+    for (size_t i = 0; i < users; ++i) {
+      std::swap(order[i], order[i + gen() % (week_users - i)]);
+      minute.on_user_deal_won(0, order[i], order[i] * 31, 1 + gen() % 100);
+    }
+    state.ResumeTiming();
+    week.update_week_rating(minute);
+    items += minute.size();
+  }
+  state.SetItemsProcessed(items);
+}
+
+BENCHMARK(BM_MinuteFold)
+    ->Arg(1000)
+    ->Arg(100000)
+    ->Arg(250000)
+    ->Arg(500000)
+    ->Arg(1000000)
+    ->Arg(5000000)
+    ->Unit(benchmark::kMillisecond);
+
+// снимок range(1) подключенных из MAX_TEST_USER_ID пользователей:
+// range(0) == 0 - копия множества под mutex, как было раньше,
+// range(0) == 1 - обход битовой карты без блокировки
+static void BM_ConnectedSnapshot(benchmark::State& state) {
+  const size_t connected = state.range(1);
+  std::mutex mt;
+  tr::flat_hash_set connected_set;
+  tr::concurrent_bitmap connected_bitmap;
+  for (size_t i = 0; i < connected; ++i) {
+    auto index = static_cast<tr::user_index_t>(
+        i * (MAX_TEST_USER_ID / connected));
+    connected_set.insert(index);
+    connected_bitmap.set(index);
+  }
+  std::vector<tr::user_index_t> users;
+  while (state.KeepRunning()) {
+    users.clear();
+    if (state.range(0) == 0) {
+      std::lock_guard<std::mutex> lk(mt);
+      users.insert(users.end(), connected_set.begin(), connected_set.end());
+    } else {
+      connected_bitmap.append_to(users);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * connected);
+}
+
+BENCHMARK(BM_ConnectedSnapshot)
+    ->Args({0, 10000})
+    ->Args({1, 10000})
+    ->Args({0, 1000000})
+    ->Args({1, 1000000});
+
+// аллокатор, считающий байты, запрошенные контейнером
+template <typename T>
+struct counting_allocator {
+  using value_type = T;
+  explicit counting_allocator(size_t* bytes) : bytes(bytes) {}
+  template <typename U>
+  counting_allocator(const counting_allocator<U>& other)
+      : bytes(other.bytes) {}
+  T* allocate(size_t n) {
+    *bytes += n * sizeof(T);
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t n) {
+    *bytes -= n * sizeof(T);
+    ::operator delete(p);
+  }
+  size_t* bytes;
+};
+
+template <typename T, typename U>
+bool operator==(const counting_allocator<T>& a,
+                const counting_allocator<U>& b) {
+  return a.bytes == b.bytes;
+}
+
+template <typename T, typename U>
+bool operator!=(const counting_allocator<T>& a,
+                const counting_allocator<U>& b) {
+  return a.bytes != b.bytes;
+}
+
+using counted_amount_map_t = std::unordered_map<
+    tr::user_id_t, tr::amount_t, std::hash<tr::user_id_t>,
+    std::equal_to<tr::user_id_t>,
+    counting_allocator<std::pair<const tr::user_id_t, tr::amount_t>>>;
+using counted_user_set_t =
+    std::unordered_set<tr::user_id_t, std::hash<tr::user_id_t>,
+                       std::equal_to<tr::user_id_t>,
+                       counting_allocator<tr::user_id_t>>;
+
+// байт на пользователя для range(0) пользователей; без накладных
+// расходов malloc, которые у узловых контейнеров еще больше
+static void BM_UserMapMemory(benchmark::State& state) {
+  const tr::user_id_t users = state.range(0);
+  double unordered_map_bytes = 0, flat_map_bytes = 0;
+  double unordered_set_bytes = 0, flat_set_bytes = 0;
+  while (state.KeepRunning()) {
+    size_t map_bytes = 0, set_bytes = 0;
+    counted_amount_map_t map(0, std::hash<tr::user_id_t>(),
+                             std::equal_to<tr::user_id_t>(),
+                             counted_amount_map_t::allocator_type(&map_bytes));
+    counted_user_set_t set(0, std::hash<tr::user_id_t>(),
+                           std::equal_to<tr::user_id_t>(),
+                           counted_user_set_t::allocator_type(&set_bytes));
+    tr::flat_hash_map<tr::amount_t> flat_map;
+    tr::flat_hash_set flat_set;
+    for (tr::user_id_t user_id = 0; user_id < users; ++user_id) {
+      map[user_id * 31] = 1.;
+      set.insert(user_id * 31);
+      flat_map[user_id * 31] = 1.;
+      flat_set.insert(user_id * 31);
+    }
+    unordered_map_bytes = map_bytes;
+    unordered_set_bytes = set_bytes;
+    flat_map_bytes = flat_map.capacity() * flat_map.slot_size();
+    flat_set_bytes = flat_set.capacity() * flat_set.slot_size();
+  }
+  state.counters["unordered_map"] = unordered_map_bytes / users;
+  state.counters["flat_map"] = flat_map_bytes / users;
+  state.counters["unordered_set"] = unordered_set_bytes / users;
+  state.counters["flat_set"] = flat_set_bytes / users;
+}
+
+BENCHMARK(BM_UserMapMemory)->Arg(100000)->Arg(1000000)->Iterations(1);
+
+// поиск суммы существующего пользователя в случайном порядке среди
+// range(0) пользователей, как в send_rating
+template <typename Map>
+static void BM_UserMapLookup(benchmark::State& state) {
+  const size_t users = state.range(0);
+  Map map;
+  std::vector<tr::user_id_t> keys(users);
+  for (size_t i = 0; i < users; ++i) {
+    keys[i] = i * 31;
+    map[keys[i]] = 1.;
+  }
+  std::srand(1);
+  for (size_t i = users - 1; i > 0; --i) {
+    std::swap(keys[i], keys[std::rand() % (i + 1)]);
+  }
+  size_t i = 0;
+  tr::amount_t sum = 0;
+  while (state.KeepRunning()) {
+    sum += map.find(keys[i])->second;
+    if (++i == users) {
+      i = 0;
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_UserMapLookup,
+                   std::unordered_map<tr::user_id_t, tr::amount_t>)
+    ->Arg(10000)
+    ->Arg(1000000);
+BENCHMARK_TEMPLATE(BM_UserMapLookup, tr::flat_hash_map<tr::amount_t>)
+    ->Arg(10000)
+    ->Arg(1000000);
+
+static void fill_rating_index(tr::rating_index& index,
+                              std::vector<tr::amount_t>& amounts) {
+  amounts.resize(MAX_TEST_USER_ID);
+  for (tr::user_id_t user_id = 0; user_id < MAX_TEST_USER_ID; ++user_id) {
+    amounts[user_id] = 1 + std::rand() % 100000;
+    index.insert(amounts[user_id], user_id);
+  }
+}
+
+static void BM_RatingIndexUpdate(benchmark::State& state) {
+  tr::rating_index index;
+  std::vector<tr::amount_t> amounts;
+  fill_rating_index(index, amounts);
+  while (state.KeepRunning()) {
+    tr::user_id_t user_id = std::rand() % MAX_TEST_USER_ID;
+    tr::amount_t prev_amount = amounts[user_id];
+    amounts[user_id] += 1 + std::rand() % 100;
+    index.update(user_id, prev_amount, amounts[user_id]);
+  }
+}
+
+BENCHMARK(BM_RatingIndexUpdate);
+
+static void BM_RatingIndexRank(benchmark::State& state) {
+  tr::rating_index index;
+  std::vector<tr::amount_t> amounts;
+  fill_rating_index(index, amounts);
+  while (state.KeepRunning()) {
+    tr::user_id_t user_id = std::rand() % MAX_TEST_USER_ID;
+    auto position = index.rank(amounts[user_id], user_id);
+    index.range(position > 10 ? position - 10 : 0, position + 11,
+                [](size_t, const tr::rating_index::entry_t& entry) {
+      benchmark::DoNotOptimize(entry.user_id);
+    });
+  }
+}
+
+BENCHMARK(BM_RatingIndexRank);
+
+using counted_amount_buckets_t = std::map<
+    tr::amount_t, counted_user_set_t, std::greater<tr::amount_t>,
+    counting_allocator<std::pair<const tr::amount_t, counted_user_set_t>>>;
+
+// байт на пользователя в рейтинге из range(0) пользователей с почти
+// уникальными оборотами: индекс и корзины пользователей по суммам
+static void BM_RatingIndexMemory(benchmark::State& state) {
+  const tr::user_id_t users = state.range(0);
+  double index_bytes = 0, buckets_bytes = 0;
+  std::srand(1);
+  while (state.KeepRunning()) {
+    size_t bytes = 0;
+    std::greater<tr::amount_t> greater;
+    counted_amount_buckets_t buckets(
+        greater, counted_amount_buckets_t::allocator_type(&bytes));
+    tr::rating_index index;
+    for (tr::user_id_t user_id = 0; user_id < users; ++user_id) {
+      tr::amount_t amount = 1 + std::rand() % 100000000;
+      index.insert(amount, user_id);
+      auto it = buckets.find(amount);
+      if (it == buckets.end()) {
+        it = buckets
+                 .emplace(amount, counted_user_set_t(
+                                      0, std::hash<tr::user_id_t>(),
+                                      std::equal_to<tr::user_id_t>(),
+                                      counted_user_set_t::allocator_type(
+                                          &bytes)))
+                 .first;
+      }
+      it->second.insert(user_id);
+    }
+    index_bytes = index.memory_bytes();
+    buckets_bytes = bytes;
+  }
+  state.counters["rating_index"] = index_bytes / users;
+  state.counters["amount_buckets"] = buckets_bytes / users;
+}
+
+BENCHMARK(BM_RatingIndexMemory)->Arg(100000)->Arg(1000000)->Iterations(1);
+
+// проверка сроков в горячем цикле: чтение часов на каждой итерации
+// и закэшированный срок с чтением часов раз в 64 итерации
+static void BM_ClockCheck(benchmark::State& state) {
+  tr::time_function_t time_function = &time;
+  auto deadline = tr::get_minute_times(time(nullptr)).second;
+  tr::deadline_scheduler timers(time_function);
+  timers.schedule(deadline, 0);
+  auto fired = [&](tr::deadline_scheduler::timer_id_t id, time_t now) {
+    timers.schedule(tr::get_minute_times(now).second, id);
+  };
+  while (state.KeepRunning()) {
+    if (state.range(0) == 0) {
+      benchmark::DoNotOptimize(time_function(nullptr) >= deadline);
+    } else {
+      benchmark::DoNotOptimize(timers.poll(fired));
+    }
+  }
+}
+
+BENCHMARK(BM_ClockCheck)->Arg(0)->Arg(1);
+
+// границы минуты и недели: localtime_r (0) и таблица границ (1)
+static void BM_MinuteTimes(benchmark::State& state) {
+  const tr::calendar_table& calendar = tr::local_calendar();
+  time_t ts = time(nullptr);
+  while (state.KeepRunning()) {
+    ++ts;
+    if (state.range(0) == 0) {
+      benchmark::DoNotOptimize(tr::get_minute_times(ts));
+    } else {
+      benchmark::DoNotOptimize(calendar.minute_times(ts));
+    }
+  }
+}
+
+BENCHMARK(BM_MinuteTimes)->Arg(0)->Arg(1)->ThreadRange(1, 4);
+
+static void BM_WeekTimes(benchmark::State& state) {
+  const tr::calendar_table& calendar = tr::local_calendar();
+  time_t ts = time(nullptr);
+  while (state.KeepRunning()) {
+    ++ts;
+    if (state.range(0) == 0) {
+      benchmark::DoNotOptimize(tr::get_week_times(ts));
+    } else {
+      benchmark::DoNotOptimize(calendar.week_times(ts));
+    }
+  }
+}
+
+BENCHMARK(BM_WeekTimes)->Arg(0)->Arg(1)->ThreadRange(1, 4);
+
+// получатель, который платит блокировку за каждый вызов
+struct locked_sink_t {
+  void upload(size_t count) {
+    std::lock_guard<std::mutex> lk(mt);
+    delivered += count;
+  }
+  std::mutex mt;
+  uint64_t delivered = 0;
+};
+
+static void BM_RatingSinkUpload(benchmark::State& state) {
+  locked_sink_t locked_sink;
+  std::unique_ptr<tr::rating_sink> sink;
+  if (state.range(0) == 0) {
+    sink.reset(new tr::rating_sink(tr::upload_flat_result_callback(
+        [&](const tr::flat_rating_result_t&) { locked_sink.upload(1); })));
+  } else {
+    sink.reset(new tr::rating_sink(
+        tr::upload_batch_callback(
+            [&](const tr::flat_rating_result_t*, size_t count) {
+              locked_sink.upload(count);
+            }),
+        state.range(0)));
+  }
+  tr::user_id_t user_id = 0;
+  while (state.KeepRunning()) {
+    tr::flat_rating_result_t& res = sink->next();
+    res.user_id = ++user_id;
+    res.sections = tr::section_all;
+    res.top_size = res.above_size = res.below_size = 0;
+    sink->commit();
+  }
+  sink->flush();
+}
+
+// 0 - по одному сообщению за вызов
+BENCHMARK(BM_RatingSinkUpload)->Arg(0)->Arg(64)->Arg(1024);
+
+static void BM_EventFeedParse(benchmark::State& state) {
+  std::vector<char> feed;
+  for (tr::user_id_t user_id = 0; user_id < MAX_TEST_USER_ID; ++user_id) {
+    tr::append_event(feed, tr::event_type_t::user_deal_won, 0, user_id, 1.);
+  }
+  tr::event_batch_callback callback =
+      [](const tr::event_record_t* const* events, size_t count) {
+        benchmark::DoNotOptimize(events[count - 1]->amount);
+      };
+  uint64_t events = 0;
+  while (state.KeepRunning()) {
+    tr::parse_events(feed.data(), feed.size(), state.range(0), callback,
+                     events);
+  }
+  state.SetItemsProcessed(events);
+  state.SetBytesProcessed(state.iterations() * feed.size());
+}
+
+BENCHMARK(BM_EventFeedParse)->Arg(1)->Arg(256);
+
+// час торгов: 100 сделок в секунду, 100k пользователей, 10k подключены
+static void BM_ReplayHour(benchmark::State& state) {
+  const tr::user_id_t users = 100000;
+  const tr::user_id_t connected = 10000;
+  auto week_times = tr::get_week_times(time(nullptr));
+  time_t start_ts = week_times.first + 3600;
+  std::vector<char> feed;
+  tr::append_event_feed_magic(feed);
+  for (tr::user_id_t user_id = 0; user_id < users; ++user_id) {
+    tr::append_event(feed, tr::event_type_t::user_registered, start_ts,
+                     user_id, 0, "user");
+    if (user_id < connected) {
+      tr::append_event(feed, tr::event_type_t::user_connected, start_ts,
+                       user_id);
+    }
+  }
+  std::srand(1);
+  for (time_t ts = start_ts; ts < start_ts + 3600; ++ts) {
+    for (int i = 0; i < 100; ++i) {
+      tr::append_event(feed, tr::event_type_t::user_deal_won, ts,
+                       std::rand() % users, 1 + std::rand() % 100);
+    }
+  }
+  tr::event_batch_callback callback;
+  uint64_t events = 0;
+  uint64_t publish_ns = 0, minutes = 0;
+  while (state.KeepRunning()) {
+    tr::replay replay(tr::rating_sink(
+        tr::upload_batch_callback([](const tr::flat_rating_result_t*,
+                                     size_t) {}),
+        1024));
+    callback = [&replay](const tr::event_record_t* const* records,
+                         size_t count) { replay.on_events(records, count); };
+    tr::parse_events(feed.data() + tr::event_feed_magic_size,
+                     feed.size() - tr::event_feed_magic_size, 256, callback,
+                     events);
+    replay.finish();
+    for (auto& minute : replay.report().minutes) {
+      publish_ns += minute.publish_ns;
+    }
+    minutes += replay.report().minutes.size();
+  }
+  state.SetItemsProcessed(events);
+  state.counters["publish_us"] = minutes > 0 ? publish_ns / minutes / 1e3 : 0;
+}
+
+BENCHMARK(BM_ReplayHour)->Unit(benchmark::kMillisecond);
+
+// рассылка одной минуты 100k подключенным пользователям по модельным
+// часам: всплеск в одну секунду (0) против окна в 10 секунд
+static void BM_PacedDelivery(benchmark::State& state) {
+  const tr::user_index_t users = 100000;
+  tr::delivery_config_t delivery;
+  delivery.window = static_cast<uint32_t>(state.range(0));
+  auto week_times = tr::get_week_times(time(nullptr));
+  auto minute_times = tr::get_minute_times(week_times.first + 3600);
+  std::atomic<size_t> results(0);
+  tr::delivery_stats_t stats;
+  while (state.KeepRunning()) {
+    std::atomic<time_t> now(minute_times.first + 10);
+    results = 0;
+    tr::rating_sink sink(
+        tr::upload_batch_callback(
+            [&](const tr::flat_rating_result_t*, size_t count) {
+              results += count;
+            }),
+        1024);
+    tr::week_rating rating(
+        week_times.first, week_times.second,
+        [&](std::vector<tr::user_index_t>& connected) {
+          for (tr::user_index_t index = 0; index < users; ++index) {
+            connected.push_back(index);
+          }
+        },
+        sink, [&](time_t*) { return now.load(); }, tr::wait_config_t(),
+        delivery);
+    rating.start();
+    while (!rating.started()) {
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    tr::minute_rating_uptr minute(
+        new tr::minute_rating(minute_times.first, minute_times.second));
+    for (tr::user_index_t index = 0; index < users; ++index) {
+      minute->on_user_deal_won(minute_times.first, index, index,
+                               1 + index % 1000);
+    }
+    rating.on_minute(std::move(minute));
+    // модельные секунды идут, пока не доставлены все сообщения
+    for (time_t second = 1; results < users && second <= 60; ++second) {
+      now = minute_times.second + second;
+      for (int i = 0; i < 20 && results < users; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+    rating.stop();
+    stats = rating.delivery_stats();
+  }
+  state.SetItemsProcessed(state.iterations() * users);
+  state.counters["peak_per_second"] = stats.last_peak;
+  state.counters["peak_to_average"] = stats.peak_to_average();
+}
+
+BENCHMARK(BM_PacedDelivery)
+    ->Arg(0)
+    ->Arg(10)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+// публикация 100k подключенным пользователям, за минуту выигрывают
+// range(1) из них: полные сообщения (0) против разностных (1)
+static void BM_DeltaDelivery(benchmark::State& state) {
+  const tr::user_index_t users = 100000;
+  const tr::user_index_t winners = state.range(1);
+  auto week_times = tr::get_week_times(time(nullptr));
+  auto minute_times = tr::get_minute_times(week_times.first + 3600);
+  uint64_t uploaded = 0;
+  tr::delivery_config_t delivery;
+  delivery.delta = state.range(0) != 0;
+  tr::week_rating rating(
+      week_times.first, week_times.second,
+      [&](std::vector<tr::user_index_t>& connected) {
+        for (tr::user_index_t index = 0; index < users; ++index) {
+          connected.push_back(index);
+        }
+      },
+      tr::rating_sink(
+          tr::upload_batch_callback(
+              [&](const tr::flat_rating_result_t*, size_t count) {
+                uploaded += count;
+              }),
+          1024),
+      &time, tr::wait_config_t(), delivery);
+  tr::minute_rating minute(minute_times.first, minute_times.second);
+  for (tr::user_index_t index = 0; index < users; ++index) {
+    minute.on_user_deal_won(minute_times.first, index, index,
+                            1 + index % 1000);
+  }
+  rating.update_week_rating(minute);
+  rating.send_rating();
+  uploaded = 0;
+  auto start = rating.delivery_stats();
+  std::srand(1);
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    minute.reset(minute_times.first, minute_times.second);
+    for (tr::user_index_t i = 0; i < winners; ++i) {
+      tr::user_index_t index = std::rand() % users;
+      minute.on_user_deal_won(minute_times.first, index, index,
+                              1 + std::rand() % 100);
+    }
+    rating.update_week_rating(minute);
+    state.ResumeTiming();
+    rating.send_rating();
+  }
+  auto stats = rating.delivery_stats();
+  state.SetItemsProcessed(state.iterations() * users);
+  state.counters["messages"] = uploaded / state.iterations();
+  state.counters["entries"] =
+      (stats.entries - start.entries) / state.iterations();
+}
+
+BENCHMARK(BM_DeltaDelivery)
+    ->Args({0, 10})
+    ->Args({1, 10})
+    ->Args({0, 1000})
+    ->Args({1, 1000})
+    ->Unit(benchmark::kMillisecond);
+
+// сборка публикации пулом из range(0) исполнителей для range(1)
+// подключенных пользователей
+static void BM_ParallelFanout(benchmark::State& state) {
+  const tr::user_index_t users = state.range(1);
+  auto week_times = tr::get_week_times(time(nullptr));
+  auto minute_times = tr::get_minute_times(week_times.first + 3600);
+  tr::delivery_config_t delivery;
+  delivery.workers = static_cast<uint32_t>(state.range(0));
+  tr::week_rating rating(
+      week_times.first, week_times.second,
+      [&](std::vector<tr::user_index_t>& connected) {
+        for (tr::user_index_t index = 0; index < users; ++index) {
+          connected.push_back(index);
+        }
+      },
+      tr::rating_sink(
+          tr::upload_batch_callback(
+              [](const tr::flat_rating_result_t*, size_t) {}),
+          1024),
+      &time, tr::wait_config_t(), delivery);
+  tr::minute_rating minute(minute_times.first, minute_times.second);
+  std::srand(1);
+  for (tr::user_index_t index = 0; index < users; ++index) {
+    minute.on_user_deal_won(minute_times.first, index, index,
+                            1 + std::rand() % 100000);
+  }
+  rating.update_week_rating(minute);
+  while (state.KeepRunning()) {
+    rating.send_rating();
+  }
+  state.SetItemsProcessed(state.iterations() * users);
+}
+
+static void fanout_args(benchmark::internal::Benchmark* b) {
+  for (int users : {50000, 200000, 1000000}) {
+    for (int workers : {1, 2, 4, 8}) {
+      b->Args({workers, users});
+    }
+  }
+}
+
+BENCHMARK(BM_ParallelFanout)
+    ->Apply(fanout_args)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static uint64_t thread_cpu_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// задержка пробуждения потребителя и его загрузка CPU;
+// range(0) - wait_strategy_t, range(1) - пауза между событиями, мкс
+static void BM_WaitStrategyWakeup(benchmark::State& state) {
+  tr::wait_config_t config;
+  config.strategy = static_cast<tr::wait_strategy_t>(state.range(0));
+  tr::idle_waiter waiter(config);
+  std::atomic<uint64_t> sent_ns(0), received_ns(0);
+  std::atomic_bool finish(false);
+  std::atomic<uint64_t> consumer_cpu_ns(0);
+  std::thread consumer([&]() {
+    auto cpu_start = thread_cpu_ns();
+    uint64_t seen = 0;
+    while (!finish) {
+      auto sent = sent_ns.load(std::memory_order_acquire);
+      if (sent != seen) {
+        seen = sent;
+        received_ns.store(steady_ns(), std::memory_order_release);
+        waiter.reset();
+        continue;
+      }
+      waiter.idle([&]() { return finish || sent_ns.load() != seen; });
+    }
+    consumer_cpu_ns = thread_cpu_ns() - cpu_start;
+  });
+
+  auto gap = std::chrono::microseconds(state.range(1));
+  uint64_t latency_ns = 0;
+  auto wall_start = steady_ns();
+  while (state.KeepRunning()) {
+    if (gap.count() > 0) {
+      std::this_thread::sleep_for(gap);
+    }
+    auto sent = steady_ns();
+    sent_ns.store(sent, std::memory_order_release);
+    waiter.notify();
+    uint64_t received;
+    while ((received = received_ns.load(std::memory_order_acquire)) < sent) {
+      tr::yield_thread();
+    }
+    latency_ns += received - sent;
+  }
+  auto wall_ns = steady_ns() - wall_start;
+  finish = true;
+  waiter.notify();
+  consumer.join();
+  state.counters["wake_ns"] =
+      state.iterations() > 0 ? latency_ns / state.iterations() : 0;
+  // доля ядра, занятая потребителем
+  state.counters["consumer_cpu"] =
+      wall_ns > 0 ? static_cast<double>(consumer_cpu_ns) / wall_ns : 0;
+}
+
+static void wait_strategy_args(benchmark::internal::Benchmark* b) {
+  for (int strategy = 0; strategy < 4; ++strategy) {
+    for (int gap_us : {0, 100, 1000}) {
+      b->Args({strategy, gap_us});
+    }
+  }
+}
+
+BENCHMARK(BM_WaitStrategyWakeup)
+    ->ArgNames({"strategy", "gap_us"})
+    ->Apply(wait_strategy_args)
+    ->UseRealTime();
+
+// рейтинг при подключении: от on_user_connected до сообщения из потока
+// недели с MAX_TEST_USER_ID пользователями в индексе; часы стоят в
+// середине минуты, публикаций нет. range(0) - стратегия ожидания потока
+// недели
+static void BM_ConnectRating(benchmark::State& state) {
+  tr::wait_config_t wait;
+  wait.strategy = static_cast<tr::wait_strategy_t>(state.range(0));
+  auto week_times = tr::get_week_times(time(nullptr));
+  auto minute_times = tr::get_minute_times(week_times.first + 3600);
+  const time_t now = minute_times.first + 30;
+  std::atomic<uint64_t> received_ns(0);
+  tr::week_rating rating(
+      week_times.first, week_times.second,
+      [](std::vector<tr::user_index_t>&) {},
+      tr::rating_sink(tr::upload_flat_result_callback(
+          [&](const tr::flat_rating_result_t&) {
+            received_ns.store(steady_ns(), std::memory_order_release);
+          })),
+      [now](time_t*) { return now; }, wait);
+  tr::minute_rating minute(minute_times.first, minute_times.second,
+                           MAX_TEST_USER_ID);
+  for (tr::user_id_t user_id = 0; user_id < MAX_TEST_USER_ID; ++user_id) {
+    minute.on_user_deal_won(minute_times.first, user_id, user_id,
+                            1 + user_id % 100000);
+  }
+  rating.update_week_rating(minute);
+  rating.start();
+  while (!rating.started()) {
+    std::this_thread::yield();
+  }
+
+  std::vector<uint64_t> latencies;
+  std::mt19937 gen(1);
+  while (state.KeepRunning()) {
+    // поток недели успевает уснуть
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    auto sent = steady_ns();
+    rating.on_user_connected(gen() % MAX_TEST_USER_ID);
+    uint64_t received;
+    while ((received = received_ns.load(std::memory_order_acquire)) < sent) {
+      tr::yield_thread();
+    }
+    latencies.push_back(received - sent);
+  }
+  rating.stop();
+  std::sort(latencies.begin(), latencies.end());
+  if (!latencies.empty()) {
+    state.counters["p50_us"] = latencies[latencies.size() / 2] / 1000.;
+    state.counters["p99_us"] = latencies[latencies.size() * 99 / 100] / 1000.;
+  }
+}
+
+BENCHMARK(BM_ConnectRating)
+    ->ArgName("strategy")
+    ->Arg(static_cast<int>(tr::wait_strategy_t::spin_yield))
+    ->Arg(static_cast<int>(tr::wait_strategy_t::spin_park))
+    ->Arg(static_cast<int>(tr::wait_strategy_t::blocking))
+    ->UseRealTime();
+
+// чтение рейтинга пользователя из опубликованного снимка недели с
+// MAX_TEST_USER_ID пользователями. range(0) = 1 - поток недели в это
+// время без перерыва сворачивает минуты и публикует снимки
+static void BM_SnapshotRead(benchmark::State& state) {
+  auto week_times = tr::get_week_times(time(nullptr));
+  auto minute_times = tr::get_minute_times(week_times.first + 3600);
+  tr::delivery_config_t delivery;
+  delivery.snapshots = true;
+  tr::week_rating rating(
+      week_times.first, week_times.second,
+      [](std::vector<tr::user_index_t>&) {},
+      tr::rating_sink(tr::upload_flat_result_callback(
+          [](const tr::flat_rating_result_t&) {})),
+      &time, tr::wait_config_t(), delivery);
+  tr::minute_rating minute(minute_times.first, minute_times.second,
+                           MAX_TEST_USER_ID);
+  for (tr::user_id_t user_id = 0; user_id < MAX_TEST_USER_ID; ++user_id) {
+    minute.on_user_deal_won(minute_times.first, user_id, user_id,
+                            1 + user_id % 100000);
+  }
+  rating.update_week_rating(minute);
+
+  std::atomic_bool finish(false);
+  std::atomic<uint64_t> publications(0);
+  std::thread writer;
+  if (state.range(0)) {
+    writer = std::thread([&]() {
+      tr::minute_rating sparse(minute_times.first, minute_times.second);
+      std::mt19937 gen(2);
+      while (!finish) {
+        sparse.reset(minute_times.first, minute_times.second);
+        for (int i = 0; i < 1000; ++i) {
+          tr::user_id_t user_id = gen() % MAX_TEST_USER_ID;
+          sparse.on_user_deal_won(minute_times.first, user_id, user_id, 1);
+        }
+        rating.update_week_rating(sparse);
+        ++publications;
+      }
+    });
+  }
+
+  std::mt19937 gen(1);
+  tr::flat_rating_result_t res;
+  size_t found = 0;
+  while (state.KeepRunning()) {
+    rating.read_snapshot([&](const tr::rating_snapshot& snapshot) {
+      found += snapshot.get_result(gen() % MAX_TEST_USER_ID, 0, res);
+    });
+  }
+  finish = true;
+  if (writer.joinable()) {
+    writer.join();
+  }
+  benchmark::DoNotOptimize(found);
+  state.counters["publications"] = publications.load();
+}
+
+BENCHMARK(BM_SnapshotRead)->ArgName("writer")->Arg(0)->Arg(1)->UseRealTime();
+
 struct get_rating_result_t {
   get_rating_result_t()
       : upload_callback(std::bind(&get_rating_result_t::upload, this,
@@ -148,6 +977,54 @@ BENCHMARK_REGISTER_F(OnUserDealWonFixture, Test)->Range(1, MAX_TEST_USER_ID);
 BENCHMARK_REGISTER_F(OnUserDealWonFixture, Test)
     ->Arg(MAX_TEST_USER_ID)
     ->Threads(1)
-    ->Threads(2);
+    ->Threads(2)
+    ->Threads(4)
+    ->Threads(8);
+
+struct ShardedOnUserDealWonFixture : public benchmark::Fixture,
+                                     get_rating_result_t {
+  void SetUp(const benchmark::State& state) {
+    if (state.thread_index == 0) {
+      tr::sharded_service_config_t config;
+      total_users = state.range(0);
+      config.shards = state.range(1);
+      service_uptr.reset(
+          new tr::sharded_service(upload_callback, &time, config));
+      service_uptr->start();
+      const std::string test_name("user");
+      for (tr::user_id_t i = 1; i < total_users; ++i) {
+        service_uptr->on_user_registered(++i, test_name);
+        service_uptr->on_user_connected(i);
+      }
+    }
+  }
+
+  void TearDown(const benchmark::State& state) {
+    if (state.thread_index == 0) {
+      service_uptr->stop();
+    }
+  }
+
+  tr::user_id_t total_users;
+  std::unique_ptr<tr::sharded_service> service_uptr;
+};
+
+BENCHMARK_DEFINE_F(ShardedOnUserDealWonFixture, Test)
+(benchmark::State& state) {
+  std::srand(std::time(0));
+  while (state.KeepRunning()) {
+    service_uptr->on_user_deal_won(time(nullptr), std::rand() % total_users,
+                                   1.);
+  }
+}
+
+BENCHMARK_REGISTER_F(ShardedOnUserDealWonFixture, Test)
+    ->Args({MAX_TEST_USER_ID, 1})
+    ->Args({MAX_TEST_USER_ID, 2})
+    ->Args({MAX_TEST_USER_ID, 4})
+    ->Args({MAX_TEST_USER_ID, 8})
+    ->Threads(1)
+    ->Threads(4)
+    ->Threads(8);
 
 BENCHMARK_MAIN();
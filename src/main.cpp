@@ -1,9 +1,95 @@
 #include "traders_rating/service.h"
+#include "traders_rating/event_feed.h"
+#include "traders_rating/replay.h"
+#include "traders_rating/utilities.h"
 
-void upload_trading_results(const traders_rating::rating_result_t&) {}
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
 
-int main() {
-  traders_rating::service srv(&upload_trading_results);
+#include <unistd.h>
+
+namespace tr = ::traders_rating;
+
+void upload_trading_results(const tr::flat_rating_result_t*, size_t) {}
+
+uint64_t percentile(std::vector<uint64_t>& values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  auto n = static_cast<size_t>(p * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+int run_replay(const std::string& path) {
+  tr::rating_sink sink(tr::upload_batch_callback(&upload_trading_results),
+                       tr::service_config_t().upload_batch_size);
+  auto report = tr::replay_feed(path, sink);
+
+  // minute_ts events results fold_us publish_us
+  std::vector<uint64_t> publish_ns;
+  for (auto& minute : report.minutes) {
+    std::cout << minute.minute_ts << ' ' << minute.events << ' '
+              << minute.results << ' ' << minute.fold_ns / 1000 << ' '
+              << minute.publish_ns / 1000 << '\n';
+    publish_ns.push_back(minute.publish_ns);
+  }
+  std::cout << "events: " << report.events << '\n'
+            << "minutes: " << report.minutes.size() << '\n'
+            << "results: " << report.results << '\n'
+            << "elapsed_ms: " << report.elapsed_ns / 1000000 << '\n'
+            << "events_per_second: "
+            << static_cast<uint64_t>(report.events_per_second()) << '\n'
+            << "publish_us p50/p99/max: "
+            << percentile(publish_ns, 0.5) / 1000 << '/'
+            << percentile(publish_ns, 0.99) / 1000 << '/'
+            << percentile(publish_ns, 1.) / 1000 << std::endl;
+  return 0;
+}
+
+/*
+ * traders_rating                 - события из stdin (pipe)
+ * traders_rating FILE            - события из файла, отображенного в память
+ * traders_rating --replay [FILE] - воспроизведение записи по часам событий
+ *                                  (без FILE или FILE = "-" - из stdin)
+ */
+int main(int argc, char** argv) {
+  if (argc > 1 && std::strcmp(argv[1], "--replay") == 0) {
+    try {
+      return run_replay(argc > 2 ? argv[2] : "-");
+    }
+    catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  tr::service srv(&upload_trading_results);
   srv.start();
+
+  auto push_events = [&srv](const tr::event_record_t* const* events,
+                            size_t count) { srv.on_events(events, count); };
+  uint64_t events = 0;
+  int result = 0;
+  try {
+    if (argc > 1) {
+      tr::mmap_feed_reader reader(argv[1]);
+      events = reader.read(push_events);
+    } else {
+      tr::stream_feed_reader reader(STDIN_FILENO);
+      events = reader.read(push_events);
+    }
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    result = 1;
+  }
+
+  while (srv.processed_cmds() < events) {
+    tr::yield_thread();
+  }
   srv.stop();
+  return result;
 }
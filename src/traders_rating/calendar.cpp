@@ -0,0 +1,126 @@
+#include "traders_rating/calendar.h"
+
+#include <time.h>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+const time_t week_seconds = 7 * 24 * 3600;
+
+int32_t utc_offset(time_t ts) {
+  tm local;
+  localtime_r(&ts, &local);
+  return static_cast<int32_t>(local.tm_gmtoff);
+}
+
+// местный понедельник 00:00 недели, содержащей ts (+ weeks недель)
+time_t monday(time_t ts, int weeks) {
+  tm local;
+  localtime_r(&ts, &local);
+  local.tm_mday -= (local.tm_wday == 0 ? 6 : local.tm_wday - 1);
+  local.tm_mday += 7 * weeks;
+  local.tm_hour = 0;
+  local.tm_min = 0;
+  local.tm_sec = 0;
+  local.tm_isdst = -1;
+  return mktime(&local);
+}
+
+}  // namespace
+
+/*
+ *
+ */
+tr::calendar_table::calendar_table() : table_(nullptr) {
+  refresh(time(nullptr));
+}
+
+std::pair<time_t, time_t> tr::calendar_table::minute_times(time_t ts) const {
+  const week_t& week = find_week(ts);
+  time_t local = ts + (ts < week.transition ? week.offset : week.offset_after);
+  time_t seconds = local % 60;
+  if (seconds < 0) {
+    seconds += 60;
+  }
+  return std::make_pair(ts - seconds, ts - seconds + 60);
+}
+
+std::pair<time_t, time_t> tr::calendar_table::week_times(time_t ts) const {
+  const week_t& week = find_week(ts);
+  return std::make_pair(week.start, week.finish);
+}
+
+const tr::calendar_table::week_t& tr::calendar_table::find_week(
+    time_t ts) const {
+  const table_t* table = table_.load(std::memory_order_acquire);
+  if (ts < table->first_start || ts >= table->weeks.back().finish) {
+    table = &refresh(ts);
+  }
+  // недели короче или длиннее week_seconds только на сдвиг часов,
+  // поэтому оценка ошибается не больше чем на одну неделю
+  size_t index = static_cast<size_t>((ts - table->first_start) / week_seconds);
+  if (index >= table->weeks.size()) {
+    index = table->weeks.size() - 1;
+  }
+  while (ts < table->weeks[index].start) {
+    --index;
+  }
+  while (ts >= table->weeks[index].finish) {
+    ++index;
+  }
+  return table->weeks[index];
+}
+
+const tr::calendar_table::table_t& tr::calendar_table::refresh(
+    time_t ts) const {
+  std::lock_guard<std::mutex> lk(refresh_mt_);
+  const table_t* current = table_.load(std::memory_order_relaxed);
+  if (current != nullptr && ts >= current->first_start &&
+      ts < current->weeks.back().finish) {
+    return *current;
+  }
+
+  std::unique_ptr<table_t> table(new table_t);
+  const int first = -static_cast<int>(weeks_before);
+  const int last = static_cast<int>(weeks_after);
+  table->weeks.reserve(last - first);
+  time_t start = monday(ts, first);
+  for (int i = first; i < last; ++i) {
+    week_t week;
+    week.start = start;
+    week.finish = monday(ts, i + 1);
+    week.offset = utc_offset(week.start);
+    week.offset_after = utc_offset(week.finish - 1);
+    week.transition = week.finish;
+    if (week.offset != week.offset_after) {
+      // первая секунда с новым смещением
+      time_t lo = week.start, hi = week.finish - 1;
+      while (lo < hi) {
+        time_t mid = lo + (hi - lo) / 2;
+        if (utc_offset(mid) == week.offset) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      week.transition = lo;
+    }
+    table->weeks.push_back(week);
+    start = week.finish;
+  }
+  table->first_start = table->weeks.front().start;
+
+  const table_t* result = table.get();
+  tables_.push_back(std::unique_ptr<const table_t>(table.release()));
+  table_.store(result, std::memory_order_release);
+  return *result;
+}
+
+/*
+ *
+ */
+const tr::calendar_table& tr::local_calendar() {
+  static calendar_table calendar;
+  return calendar;
+}
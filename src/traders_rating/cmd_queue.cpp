@@ -0,0 +1,35 @@
+#include "traders_rating/cmd_queue.h"
+
+namespace tr = ::traders_rating;
+
+/*
+ *
+ */
+tr::cmd_queue::cmd_queue(size_t capacity, size_t name_capacity)
+    : cmds_(capacity), names_(cmds_.capacity()) {
+  for (auto& name : names_) {
+    name.reserve(name_capacity);
+  }
+}
+
+size_t tr::cmd_queue::capacity() const { return cmds_.capacity(); }
+
+bool tr::cmd_queue::try_push(const cmd_t& cmd) {
+  return cmds_.try_push(cmd_t(cmd));
+}
+
+bool tr::cmd_queue::try_push(cmd_t cmd, const user_name_t& name) {
+  size_t pos;
+  if (!cmds_.try_claim(pos)) {
+    return false;
+  }
+  auto name_slot = cmds_.slot_index(pos);
+  // имя помещается в зарезервированный буфер - без выделения памяти
+  names_[name_slot].assign(name);
+  cmd.name_slot = static_cast<uint32_t>(name_slot);
+  cmds_.slot(pos) = cmd;
+  cmds_.publish(pos);
+  return true;
+}
+
+bool tr::cmd_queue::empty() const { return cmds_.empty(); }
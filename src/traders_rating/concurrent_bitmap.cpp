@@ -0,0 +1,127 @@
+#include "traders_rating/concurrent_bitmap.h"
+
+namespace tr = ::traders_rating;
+
+const size_t tr::concurrent_bitmap::segment_bits_log;
+const size_t tr::concurrent_bitmap::segment_words;
+const size_t tr::concurrent_bitmap::summary_words;
+const size_t tr::concurrent_bitmap::max_segments;
+
+/*
+ *
+ */
+tr::concurrent_bitmap::concurrent_bitmap()
+    : segments_(new std::atomic<segment_t*>[max_segments]),
+      segments_count_(0),
+      count_(0) {
+  for (size_t i = 0; i < max_segments; ++i) {
+    segments_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+tr::concurrent_bitmap::~concurrent_bitmap() {
+  for (size_t i = 0; i < segments_count_; ++i) {
+    delete segments_[i].load(std::memory_order_relaxed);
+  }
+}
+
+tr::concurrent_bitmap::segment_t* tr::concurrent_bitmap::segment(
+    index_t index) const {
+  size_t number = index >> segment_bits_log;
+  if (number >= segments_count_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return segments_[number].load(std::memory_order_acquire);
+}
+
+bool tr::concurrent_bitmap::set(index_t index) {
+  size_t number = index >> segment_bits_log;
+  segment_t* s = segment(index);
+  if (s == nullptr) {
+    // сегменты добавляются по порядку; читатель видит сегмент целиком
+    // обнуленным благодаря release при публикации
+    for (size_t i = segments_count_; i <= number; ++i) {
+      segment_t* added = new segment_t;
+      for (auto& word : added->summary) {
+        word.store(0, std::memory_order_relaxed);
+      }
+      for (auto& word : added->words) {
+        word.store(0, std::memory_order_relaxed);
+      }
+      segments_[i].store(added, std::memory_order_release);
+      segments_count_.store(i + 1, std::memory_order_release);
+    }
+    s = segments_[number].load(std::memory_order_relaxed);
+  }
+  size_t offset = index & ((size_t(1) << segment_bits_log) - 1);
+  std::atomic<uint64_t>& word = s->words[offset / 64];
+  uint64_t bit = uint64_t(1) << (offset % 64);
+  uint64_t old = word.load(std::memory_order_relaxed);
+  if (old & bit) {
+    return false;
+  }
+  word.store(old | bit, std::memory_order_release);
+  if (old == 0) {
+    // слово стало непустым - отмечается в сводке после самого слова
+    std::atomic<uint64_t>& summary = s->summary[offset / 64 / 64];
+    summary.store(summary.load(std::memory_order_relaxed) |
+                      (uint64_t(1) << (offset / 64 % 64)),
+                  std::memory_order_release);
+  }
+  count_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool tr::concurrent_bitmap::reset(index_t index) {
+  segment_t* s = segment(index);
+  if (s == nullptr) {
+    return false;
+  }
+  size_t offset = index & ((size_t(1) << segment_bits_log) - 1);
+  std::atomic<uint64_t>& word = s->words[offset / 64];
+  uint64_t bit = uint64_t(1) << (offset % 64);
+  uint64_t old = word.load(std::memory_order_relaxed);
+  if (!(old & bit)) {
+    return false;
+  }
+  word.store(old & ~bit, std::memory_order_release);
+  if (old == bit) {
+    std::atomic<uint64_t>& summary = s->summary[offset / 64 / 64];
+    summary.store(summary.load(std::memory_order_relaxed) &
+                      ~(uint64_t(1) << (offset / 64 % 64)),
+                  std::memory_order_release);
+  }
+  count_.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool tr::concurrent_bitmap::test(index_t index) const {
+  segment_t* s = segment(index);
+  if (s == nullptr) {
+    return false;
+  }
+  size_t offset = index & ((size_t(1) << segment_bits_log) - 1);
+  return (s->words[offset / 64].load(std::memory_order_acquire) >>
+          (offset % 64)) & 1;
+}
+
+void tr::concurrent_bitmap::append_to(std::vector<index_t>& out) const {
+  size_t segments = segments_count_.load(std::memory_order_acquire);
+  for (size_t number = 0; number < segments; ++number) {
+    const segment_t* s = segments_[number].load(std::memory_order_acquire);
+    index_t base = static_cast<index_t>(number << segment_bits_log);
+    for (size_t i = 0; i < summary_words; ++i) {
+      uint64_t summary = s->summary[i].load(std::memory_order_acquire);
+      while (summary != 0) {
+        size_t w = i * 64 + __builtin_ctzll(summary);
+        summary &= summary - 1;
+        uint64_t word = s->words[w].load(std::memory_order_acquire);
+        while (word != 0) {
+          out.push_back(base + static_cast<index_t>(w * 64) +
+                        __builtin_ctzll(word));
+          word &= word - 1;
+        }
+      }
+    }
+  }
+}
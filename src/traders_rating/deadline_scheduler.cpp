@@ -0,0 +1,38 @@
+#include "traders_rating/deadline_scheduler.h"
+
+#include <limits>
+
+namespace tr = ::traders_rating;
+
+/*
+ *
+ */
+tr::deadline_scheduler::deadline_scheduler(time_function_t time_function,
+                                           uint32_t check_interval)
+    : time_function_(time_function),
+      check_interval_(check_interval > 0 ? check_interval : 1),
+      polls_(0),
+      now_(time_function_(nullptr)),
+      next_deadline_(std::numeric_limits<time_t>::max()) {}
+
+void tr::deadline_scheduler::schedule(time_t deadline, timer_id_t id) {
+  timers_.insert(std::make_pair(deadline, id));
+  update_next_deadline();
+}
+
+void tr::deadline_scheduler::clear() {
+  timers_.clear();
+  update_next_deadline();
+}
+
+bool tr::deadline_scheduler::empty() const { return timers_.empty(); }
+
+time_t tr::deadline_scheduler::read_clock() {
+  now_ = time_function_(nullptr);
+  return now_;
+}
+
+void tr::deadline_scheduler::update_next_deadline() {
+  next_deadline_ = timers_.empty() ? std::numeric_limits<time_t>::max()
+                                   : timers_.begin()->first;
+}
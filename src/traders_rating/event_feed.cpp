@@ -0,0 +1,217 @@
+#include "traders_rating/event_feed.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+const size_t max_batch_size = 1024;
+
+bool valid_event_type(tr::event_type_t type) {
+  return type >= tr::event_type_t::user_registered &&
+         type <= tr::event_type_t::user_deal_won;
+}
+
+}  // namespace
+
+const char tr::event_feed_magic[8] = {'T', 'R', 'F', 'E', 'E', 'D', '0', '1'};
+
+/*
+ *
+ */
+tr::cmd_t tr::to_cmd(const event_record_t& event) {
+  switch (event.type) {
+    case event_type_t::user_registered:
+      return make_user_registered_cmd(event.user_id, 0);
+    case event_type_t::user_renamed:
+      return make_user_renamed_cmd(event.user_id, 0);
+    case event_type_t::user_connected:
+      return make_user_connected_cmd(event.user_id);
+    case event_type_t::user_disconnected:
+      return make_user_disconnected_cmd(event.user_id);
+    case event_type_t::user_deal_won:
+      break;
+  }
+  return make_user_deal_won_cmd(static_cast<time_t>(event.ts), event.user_id,
+                                event.amount);
+}
+
+void tr::append_event_feed_magic(std::vector<char>& buffer) {
+  buffer.insert(buffer.end(), event_feed_magic,
+                event_feed_magic + event_feed_magic_size);
+}
+
+void tr::append_event(std::vector<char>& buffer, event_type_t type,
+                      time_t ts, user_id_t user_id, amount_t amount,
+                      const user_name_t& name) {
+  if (name.size() > event_max_name_size) {
+    throw std::length_error("event feed: user name is too long");
+  }
+  event_record_t event;
+  std::memset(&event, 0, sizeof(event));
+  event.type = type;
+  event.name_size = static_cast<uint16_t>(name.size());
+  event.ts = ts;
+  event.user_id = user_id;
+  event.amount = to_double(amount);
+  auto offset = buffer.size();
+  buffer.resize(offset + event_size(event), 0);
+  std::memcpy(&buffer[offset], &event, sizeof(event));
+  std::copy(name.begin(), name.end(), buffer.begin() + offset + sizeof(event));
+}
+
+size_t tr::parse_events(const char* data, size_t size, size_t batch_size,
+                        const event_batch_callback& callback,
+                        uint64_t& events) {
+  const event_record_t* batch[max_batch_size];
+  batch_size = std::max<size_t>(1, std::min(batch_size, max_batch_size));
+  size_t batch_count = 0;
+  size_t offset = 0;
+  while (offset + sizeof(event_record_t) <= size) {
+    auto event = reinterpret_cast<const event_record_t*>(data + offset);
+    if (!valid_event_type(event->type)) {
+      throw std::runtime_error("event feed: unknown event type");
+    }
+    if (event->type == event_type_t::user_deal_won &&
+        !valid_amount(event->amount)) {
+      throw std::runtime_error("event feed: amount is out of range");
+    }
+    if (event->ts < 0 || event->ts > event_max_ts) {
+      throw std::runtime_error("event feed: timestamp is out of range");
+    }
+    auto next_offset = offset + event_size(*event);
+    if (next_offset > size) {
+      break;
+    }
+    batch[batch_count++] = event;
+    offset = next_offset;
+    ++events;
+    if (batch_count == batch_size) {
+      callback(batch, batch_count);
+      batch_count = 0;
+    }
+  }
+  if (batch_count > 0) {
+    callback(batch, batch_count);
+  }
+  return offset;
+}
+
+/*
+ *
+ */
+tr::stream_feed_reader::stream_feed_reader(int fd, size_t buffer_size,
+                                           size_t batch_size)
+    : fd_(fd), batch_size_(batch_size) {
+  // в буфер должна помещаться хотя бы одна запись с самым длинным именем
+  size_t min_size = sizeof(event_record_t) + event_max_name_size + 8;
+  buffer_.resize((std::max(buffer_size, min_size) + 7) / 8);
+}
+
+uint64_t tr::stream_feed_reader::read(const event_batch_callback& callback) {
+  char* buffer = reinterpret_cast<char*>(buffer_.data());
+  const size_t capacity = buffer_.size() * sizeof(uint64_t);
+  size_t filled = 0;
+  bool magic_checked = false;
+  uint64_t events = 0;
+  for (;;) {
+    auto bytes = ::read(fd_, buffer + filled, capacity - filled);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "event feed: read");
+    }
+    if (bytes == 0) {
+      break;
+    }
+    filled += bytes;
+
+    size_t start = 0;
+    if (!magic_checked) {
+      if (filled < event_feed_magic_size) {
+        continue;
+      }
+      if (std::memcmp(buffer, event_feed_magic, event_feed_magic_size) != 0) {
+        throw std::runtime_error("event feed: bad magic");
+      }
+      magic_checked = true;
+      start = event_feed_magic_size;
+    }
+    start += parse_events(buffer + start, filled - start, batch_size_,
+                          callback, events);
+    // недочитанный хвост записи переносится в начало буфера
+    std::memmove(buffer, buffer + start, filled - start);
+    filled -= start;
+  }
+  if (filled > 0) {
+    throw std::runtime_error("event feed: truncated record");
+  }
+  return events;
+}
+
+/*
+ *
+ */
+tr::mmap_feed_reader::mmap_feed_reader(const std::string& path,
+                                       size_t batch_size)
+    : batch_size_(batch_size), data_(nullptr), size_(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    auto error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ > 0) {
+    data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data_ == MAP_FAILED) {
+      auto error = errno;
+      ::close(fd);
+      data_ = nullptr;
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+  ::close(fd);
+}
+
+tr::mmap_feed_reader::~mmap_feed_reader() {
+  if (data_ != nullptr) {
+    ::munmap(data_, size_);
+  }
+}
+
+uint64_t tr::mmap_feed_reader::read(const event_batch_callback& callback) {
+  uint64_t events = 0;
+  if (size_ == 0) {
+    return events;
+  }
+  const char* data = static_cast<const char*>(data_);
+  if (size_ < event_feed_magic_size ||
+      std::memcmp(data, event_feed_magic, event_feed_magic_size) != 0) {
+    throw std::runtime_error("event feed: bad magic");
+  }
+  auto size = size_ - event_feed_magic_size;
+  auto parsed = parse_events(data + event_feed_magic_size, size, batch_size_,
+                             callback, events);
+  if (parsed != size) {
+    throw std::runtime_error("event feed: truncated record");
+  }
+  return events;
+}
@@ -0,0 +1,415 @@
+#include "traders_rating/rating_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace tr = ::traders_rating;
+
+/*
+ *
+ */
+tr::rating_index::rating_index() : root_(nil), height_(0), size_(0) {}
+
+bool tr::rating_index::before(amount_t lhs_amount, user_id_t lhs_user_id,
+                              amount_t rhs_amount, user_id_t rhs_user_id) {
+  if (lhs_amount != rhs_amount) {
+    return lhs_amount > rhs_amount;
+  }
+  return lhs_user_id < rhs_user_id;
+}
+
+bool tr::rating_index::before(const entry_t& lhs, const entry_t& rhs) {
+  return before(lhs.amount, lhs.user_id, rhs.amount, rhs.user_id);
+}
+
+size_t tr::rating_index::size() const { return size_; }
+
+bool tr::rating_index::empty() const { return size_ == 0; }
+
+size_t tr::rating_index::memory_bytes() const {
+  return leaves_.capacity() * sizeof(leaf_t) +
+         inners_.capacity() * sizeof(inner_t) +
+         (free_leaves_.capacity() + free_inners_.capacity()) *
+             sizeof(node_id_t);
+}
+
+void tr::rating_index::clear() {
+  leaves_.clear();
+  inners_.clear();
+  free_leaves_.clear();
+  free_inners_.clear();
+  root_ = nil;
+  height_ = 0;
+  size_ = 0;
+}
+
+void tr::rating_index::assign_sorted(const entry_t* entries, size_t total) {
+  clear();
+  if (total == 0) {
+    return;
+  }
+  // записи и потомки делятся между узлами уровня поровну
+  const size_t leaf_fill = leaf_capacity * 3 / 4;
+  size_t width = (total + leaf_fill - 1) / leaf_fill;
+  leaves_.resize(width);
+  size_t offset = 0;
+  for (size_t i = 0; i < width; ++i) {
+    leaf_t& leaf = leaves_[i];
+    leaf.size = static_cast<uint32_t>(total / width + (i < total % width));
+    leaf.next = i + 1 < width ? static_cast<node_id_t>(i + 1) : nil;
+    std::copy(entries + offset, entries + offset + leaf.size, leaf.entries);
+    offset += leaf.size;
+  }
+
+  // узлы уровня занимают подряд идущие номера начиная с first
+  const size_t inner_fill = inner_capacity * 3 / 4;
+  node_id_t first = 0;
+  height_ = 0;
+  while (width > 1) {
+    size_t parents = (width + inner_fill - 1) / inner_fill;
+    node_id_t parent_first = static_cast<node_id_t>(inners_.size());
+    inners_.resize(inners_.size() + parents);
+    node_id_t child = first;
+    for (size_t i = 0; i < parents; ++i) {
+      inner_t& inner = inners_[parent_first + i];
+      inner.size =
+          static_cast<uint32_t>(width / parents + (i < width % parents));
+      for (uint32_t slot = 0; slot < inner.size; ++slot, ++child) {
+        inner.children[slot] = child;
+        inner.counts[slot] = static_cast<uint32_t>(count(height_, child));
+        // первый ключ поддерева - в его крайнем левом листе
+        node_id_t n = child;
+        for (size_t level = height_; level > 0; --level) {
+          n = inners_[n].children[0];
+        }
+        inner.keys[slot] = leaves_[n].entries[0];
+      }
+    }
+    first = parent_first;
+    width = parents;
+    ++height_;
+  }
+  root_ = first;
+  size_ = total;
+}
+
+void tr::rating_index::swap(rating_index& other) {
+  leaves_.swap(other.leaves_);
+  inners_.swap(other.inners_);
+  free_leaves_.swap(other.free_leaves_);
+  free_inners_.swap(other.free_inners_);
+  std::swap(root_, other.root_);
+  std::swap(height_, other.height_);
+  std::swap(size_, other.size_);
+}
+
+uint32_t tr::rating_index::child_slot(const inner_t& inner,
+                                      const entry_t& entry) {
+  // последний потомок, разделитель которого не больше entry
+  uint32_t lo = 1, hi = inner.size;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (before(entry, inner.keys[mid])) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo - 1;
+}
+
+uint32_t tr::rating_index::lower_bound(const leaf_t& leaf,
+                                       const entry_t& entry) {
+  uint32_t lo = 0, hi = leaf.size;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (before(leaf.entries[mid], entry)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+tr::rating_index::node_id_t tr::rating_index::allocate_leaf() {
+  node_id_t n;
+  if (!free_leaves_.empty()) {
+    n = free_leaves_.back();
+    free_leaves_.pop_back();
+  } else {
+    n = static_cast<node_id_t>(leaves_.size());
+    leaves_.emplace_back();
+  }
+  leaves_[n].size = 0;
+  leaves_[n].next = nil;
+  return n;
+}
+
+tr::rating_index::node_id_t tr::rating_index::allocate_inner() {
+  node_id_t n;
+  if (!free_inners_.empty()) {
+    n = free_inners_.back();
+    free_inners_.pop_back();
+  } else {
+    n = static_cast<node_id_t>(inners_.size());
+    inners_.emplace_back();
+  }
+  inners_[n].size = 0;
+  return n;
+}
+
+void tr::rating_index::release_leaf(node_id_t n) { free_leaves_.push_back(n); }
+
+void tr::rating_index::release_inner(node_id_t n) {
+  free_inners_.push_back(n);
+}
+
+size_t tr::rating_index::count(size_t level, node_id_t n) const {
+  if (level == 0) {
+    return leaves_[n].size;
+  }
+  const inner_t& inner = inners_[n];
+  size_t result = 0;
+  for (uint32_t i = 0; i < inner.size; ++i) {
+    result += inner.counts[i];
+  }
+  return result;
+}
+
+uint32_t tr::rating_index::node_size(size_t level, node_id_t n) const {
+  return level == 0 ? leaves_[n].size : inners_[n].size;
+}
+
+tr::rating_index::node_id_t tr::rating_index::find_leaf(
+    size_t position, size_t& offset) const {
+  node_id_t n = root_;
+  for (size_t level = height_; level > 0; --level) {
+    const inner_t& inner = inners_[n];
+    uint32_t slot = 0;
+    while (position >= inner.counts[slot]) {
+      position -= inner.counts[slot];
+      ++slot;
+    }
+    n = inner.children[slot];
+  }
+  offset = position;
+  return n;
+}
+
+void tr::rating_index::insert(amount_t amount, user_id_t user_id) {
+  const entry_t entry{amount, user_id};
+  if (root_ == nil) {
+    root_ = allocate_leaf();
+    height_ = 0;
+  }
+  path_t path[max_height + 1];
+  node_id_t n = root_;
+  for (size_t level = height_; level > 0; --level) {
+    inner_t& inner = inners_[n];
+    uint32_t slot = child_slot(inner, entry);
+    ++inner.counts[slot];
+    path[level] = path_t{n, slot};
+    n = inner.children[slot];
+  }
+  leaf_t& leaf = leaves_[n];
+  uint32_t i = lower_bound(leaf, entry);
+  std::copy_backward(leaf.entries + i, leaf.entries + leaf.size,
+                     leaf.entries + leaf.size + 1);
+  leaf.entries[i] = entry;
+  ++leaf.size;
+  ++size_;
+  path[0] = path_t{n, i};
+
+  // деление корня добавляет уровень, выше которого пути нет
+  const size_t height = height_;
+  for (size_t level = 0;
+       level <= height && node_size(level, path[level].node) >
+                              (level == 0 ? leaf_capacity : inner_capacity);
+       ++level) {
+    split(path, level);
+  }
+}
+
+void tr::rating_index::split(path_t* path, size_t level) {
+  node_id_t n = path[level].node;
+  node_id_t right;
+  entry_t separator;
+  if (level == 0) {
+    right = allocate_leaf();
+    leaf_t& l = leaves_[n];
+    leaf_t& r = leaves_[right];
+    uint32_t half = l.size / 2;
+    std::copy(l.entries + half, l.entries + l.size, r.entries);
+    r.size = l.size - half;
+    l.size = half;
+    r.next = l.next;
+    l.next = right;
+    separator = r.entries[0];
+  } else {
+    right = allocate_inner();
+    inner_t& l = inners_[n];
+    inner_t& r = inners_[right];
+    uint32_t half = l.size / 2;
+    std::copy(l.keys + half, l.keys + l.size, r.keys);
+    std::copy(l.children + half, l.children + l.size, r.children);
+    std::copy(l.counts + half, l.counts + l.size, r.counts);
+    r.size = l.size - half;
+    l.size = half;
+    separator = r.keys[0];
+  }
+
+  if (level == height_) {
+    node_id_t root = allocate_inner();
+    inner_t& inner = inners_[root];
+    inner.size = 2;
+    inner.keys[1] = separator;
+    inner.children[0] = n;
+    inner.children[1] = right;
+    inner.counts[0] = static_cast<uint32_t>(count(level, n));
+    inner.counts[1] = static_cast<uint32_t>(count(level, right));
+    root_ = root;
+    ++height_;
+    return;
+  }
+  inner_t& parent = inners_[path[level + 1].node];
+  uint32_t slot = path[level + 1].slot;
+  std::copy_backward(parent.keys + slot + 1, parent.keys + parent.size,
+                     parent.keys + parent.size + 1);
+  std::copy_backward(parent.children + slot + 1,
+                     parent.children + parent.size,
+                     parent.children + parent.size + 1);
+  std::copy_backward(parent.counts + slot + 1, parent.counts + parent.size,
+                     parent.counts + parent.size + 1);
+  parent.keys[slot + 1] = separator;
+  parent.children[slot + 1] = right;
+  parent.counts[slot] = static_cast<uint32_t>(count(level, n));
+  parent.counts[slot + 1] = static_cast<uint32_t>(count(level, right));
+  ++parent.size;
+}
+
+bool tr::rating_index::erase(amount_t amount, user_id_t user_id) {
+  if (root_ == nil) {
+    return false;
+  }
+  const entry_t entry{amount, user_id};
+  path_t path[max_height + 1];
+  node_id_t n = root_;
+  for (size_t level = height_; level > 0; --level) {
+    const inner_t& inner = inners_[n];
+    uint32_t slot = child_slot(inner, entry);
+    path[level] = path_t{n, slot};
+    n = inner.children[slot];
+  }
+  leaf_t& leaf = leaves_[n];
+  uint32_t i = lower_bound(leaf, entry);
+  if (i == leaf.size || leaf.entries[i].amount != amount ||
+      leaf.entries[i].user_id != user_id) {
+    return false;
+  }
+  std::copy(leaf.entries + i + 1, leaf.entries + leaf.size,
+            leaf.entries + i);
+  --leaf.size;
+  --size_;
+  path[0] = path_t{n, i};
+  for (size_t level = 1; level <= height_; ++level) {
+    --inners_[path[level].node].counts[path[level].slot];
+  }
+
+  for (size_t level = 0; level < height_; ++level) {
+    uint32_t capacity = level == 0 ? leaf_capacity : inner_capacity;
+    if (node_size(level, path[level].node) >= capacity / 4) {
+      break;
+    }
+    merge(path, level);
+  }
+  while (height_ > 0 && inners_[root_].size == 1) {
+    node_id_t root = root_;
+    root_ = inners_[root].children[0];
+    release_inner(root);
+    --height_;
+  }
+  if (height_ == 0 && leaves_[root_].size == 0) {
+    clear();
+  }
+  return true;
+}
+
+void tr::rating_index::merge(path_t* path, size_t level) {
+  inner_t& parent = inners_[path[level + 1].node];
+  if (parent.size < 2) {
+    return;
+  }
+  uint32_t slot = path[level + 1].slot;
+  uint32_t left_slot = slot > 0 ? slot - 1 : 0;
+  uint32_t right_slot = left_slot + 1;
+  node_id_t left = parent.children[left_slot];
+  node_id_t right = parent.children[right_slot];
+  uint32_t capacity = level == 0 ? leaf_capacity : inner_capacity;
+  if (node_size(level, left) + node_size(level, right) > capacity) {
+    // сосед заполнен больше чем на три четверти
+    return;
+  }
+  if (level == 0) {
+    leaf_t& l = leaves_[left];
+    leaf_t& r = leaves_[right];
+    std::copy(r.entries, r.entries + r.size, l.entries + l.size);
+    l.size += r.size;
+    l.next = r.next;
+    release_leaf(right);
+  } else {
+    inner_t& l = inners_[left];
+    inner_t& r = inners_[right];
+    // разделитель первого потомка правого узла - в родителе
+    l.keys[l.size] = parent.keys[right_slot];
+    std::copy(r.keys + 1, r.keys + r.size, l.keys + l.size + 1);
+    std::copy(r.children, r.children + r.size, l.children + l.size);
+    std::copy(r.counts, r.counts + r.size, l.counts + l.size);
+    l.size += r.size;
+    release_inner(right);
+  }
+  parent.counts[left_slot] += parent.counts[right_slot];
+  std::copy(parent.keys + right_slot + 1, parent.keys + parent.size,
+            parent.keys + right_slot);
+  std::copy(parent.children + right_slot + 1, parent.children + parent.size,
+            parent.children + right_slot);
+  std::copy(parent.counts + right_slot + 1, parent.counts + parent.size,
+            parent.counts + right_slot);
+  --parent.size;
+}
+
+void tr::rating_index::update(user_id_t user_id, amount_t prev_amount,
+                              amount_t new_amount) {
+  auto erased = erase(prev_amount, user_id);
+  assert(erased);
+  (void)erased;
+  insert(new_amount, user_id);
+}
+
+size_t tr::rating_index::rank(amount_t amount, user_id_t user_id) const {
+  if (root_ == nil) {
+    return 0;
+  }
+  const entry_t entry{amount, user_id};
+  size_t position = 0;
+  node_id_t n = root_;
+  for (size_t level = height_; level > 0; --level) {
+    const inner_t& inner = inners_[n];
+    uint32_t slot = child_slot(inner, entry);
+    for (uint32_t i = 0; i < slot; ++i) {
+      position += inner.counts[i];
+    }
+    n = inner.children[slot];
+  }
+  return position + lower_bound(leaves_[n], entry);
+}
+
+tr::rating_index::entry_t tr::rating_index::at(size_t position) const {
+  if (position >= size()) {
+    throw std::out_of_range("rating_index::at");
+  }
+  size_t offset;
+  node_id_t n = find_leaf(position, offset);
+  return leaves_[n].entries[offset];
+}
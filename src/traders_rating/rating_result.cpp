@@ -0,0 +1,223 @@
+#include "traders_rating/rating_result.h"
+
+#include <algorithm>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+template <typename Entries>
+void add_entries(const Entries& entries, uint32_t size,
+                 tr::rating_result_t::rating_t& rating) {
+  for (uint32_t i = 0; i < size; ++i) {
+    rating[entries[i].amount].insert(entries[i].user_id);
+  }
+}
+
+bool same_entries(const tr::flat_rating_result_t::top_t& lhs,
+                  const tr::flat_rating_result_t::top_t& rhs, uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) {
+    if (lhs[i].user_id != rhs[i].user_id || lhs[i].amount != rhs[i].amount) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t mix(uint64_t h, uint64_t value) {
+  // шаг splitmix64
+  h += value + 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+template <typename Entries>
+void copy_entries(const Entries& from, uint32_t size, Entries& to,
+                  uint32_t& to_size) {
+  std::copy(from.begin(), from.begin() + size, to.begin());
+  to_size = size;
+}
+
+}  // namespace
+
+/*
+ *
+ */
+void tr::to_rating_result(const flat_rating_result_t& flat,
+                          rating_result_t& res) {
+  res.ts = flat.ts;
+  res.user_id = flat.user_id;
+  res.amount = flat.amount;
+  res.rank = flat.rank;
+  res.sections = flat.sections;
+  res.top_users = nullptr;
+  if (flat.sections & section_top) {
+    std::shared_ptr<rating_result_t::rating_t> top_users(
+        new rating_result_t::rating_t);
+    add_entries(flat.top, flat.top_size, *top_users);
+    res.top_users = top_users;
+  }
+  res.above_users.clear();
+  add_entries(flat.above, flat.above_size, res.above_users);
+  res.below_users.clear();
+  add_entries(flat.below, flat.below_size, res.below_users);
+}
+
+void tr::apply_rating_result(const flat_rating_result_t& res,
+                             flat_rating_result_t& state) {
+  state.ts = res.ts;
+  state.user_id = res.user_id;
+  if (res.sections & section_user) {
+    state.amount = res.amount;
+    state.rank = res.rank;
+  }
+  if (res.sections & section_top) {
+    copy_entries(res.top, res.top_size, state.top, state.top_size);
+  }
+  if (res.sections & section_above) {
+    copy_entries(res.above, res.above_size, state.above, state.above_size);
+  }
+  if (res.sections & section_below) {
+    copy_entries(res.below, res.below_size, state.below, state.below_size);
+  }
+  // соседи стоят подряд вокруг пользователя, их позиции следуют из rank
+  for (uint32_t i = 0; i < state.above_size; ++i) {
+    state.above[i].rank = state.rank - state.above_size + i;
+  }
+  for (uint32_t i = 0; i < state.below_size; ++i) {
+    state.below[i].rank = state.rank + 1 + i;
+  }
+  state.sections |= res.sections;
+}
+
+uint64_t tr::fingerprint(const rating_entry_t* entries, uint32_t size) {
+  uint64_t h = mix(0, size);
+  for (uint32_t i = 0; i < size; ++i) {
+    h = mix(h, entries[i].user_id);
+    h = mix(h, tr::amount_bits(entries[i].amount));
+  }
+  return h | 1;
+}
+
+uint64_t tr::fingerprint(amount_t amount, uint64_t rank) {
+  return mix(mix(0, tr::amount_bits(amount)), rank) | 1;
+}
+
+/*
+ *
+ */
+tr::rating_sink::rating_sink(upload_result_callback callback)
+    : upload_result_callback_(callback),
+      batch_size_(1),
+      results_(1),
+      size_(0),
+      top_size_(0),
+      callback_mt_(nullptr) {}
+
+tr::rating_sink::rating_sink(upload_flat_result_callback callback)
+    : upload_flat_result_callback_(callback),
+      batch_size_(1),
+      results_(1),
+      size_(0),
+      top_size_(0),
+      callback_mt_(nullptr) {}
+
+tr::rating_sink::rating_sink(upload_batch_callback callback,
+                             size_t batch_size)
+    : upload_batch_callback_(callback),
+      batch_size_(batch_size),
+      results_(batch_size > 0 ? batch_size : 1),
+      size_(0),
+      top_size_(0),
+      callback_mt_(nullptr) {}
+
+tr::flat_rating_result_t& tr::rating_sink::next() {
+  if (size_ == results_.size()) {
+    // batch_size == 0: буфер растет до размера публикации
+    results_.resize(results_.size() * 2);
+  }
+  return results_[size_];
+}
+
+void tr::rating_sink::commit() {
+  ++size_;
+  if (size_ == batch_size_) {
+    flush();
+  }
+}
+
+void tr::rating_sink::flush() {
+  if (size_ == 0) {
+    return;
+  }
+  auto lk = lock_callback();
+  if (upload_batch_callback_) {
+    upload_batch_callback_(results_.data(), size_);
+  } else if (upload_flat_result_callback_) {
+    upload_flat_result_callback_(results_[0]);
+  } else {
+    upload_converted(results_[0]);
+  }
+  size_ = 0;
+}
+
+void tr::rating_sink::upload(const flat_rating_result_t& flat) {
+  next() = flat;
+  commit();
+}
+
+void tr::rating_sink::upload(const flat_rating_result_t* results,
+                             size_t count) {
+  if (count == 0) {
+    return;
+  }
+  flush();
+  auto lk = lock_callback();
+  if (upload_batch_callback_) {
+    upload_batch_callback_(results, count);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (upload_flat_result_callback_) {
+      upload_flat_result_callback_(results[i]);
+    } else {
+      upload_converted(results[i]);
+    }
+  }
+}
+
+void tr::rating_sink::set_callback_mutex(std::mutex* mt) {
+  callback_mt_ = mt;
+}
+
+std::unique_lock<std::mutex> tr::rating_sink::lock_callback() {
+  if (!callback_mt_) {
+    return std::unique_lock<std::mutex>();
+  }
+  return std::unique_lock<std::mutex>(*callback_mt_);
+}
+
+void tr::rating_sink::upload_converted(const flat_rating_result_t& flat) {
+  if (!(flat.sections & section_top)) {
+    result_.top_users = nullptr;
+  } else if (!result_.top_users || top_size_ != flat.top_size ||
+             !same_entries(top_, flat.top, flat.top_size)) {
+    std::shared_ptr<rating_result_t::rating_t> top_users(
+        new rating_result_t::rating_t);
+    add_entries(flat.top, flat.top_size, *top_users);
+    result_.top_users = top_users;
+    top_ = flat.top;
+    top_size_ = flat.top_size;
+  }
+  result_.ts = flat.ts;
+  result_.user_id = flat.user_id;
+  result_.amount = flat.amount;
+  result_.rank = flat.rank;
+  result_.sections = flat.sections;
+  result_.above_users.clear();
+  add_entries(flat.above, flat.above_size, result_.above_users);
+  result_.below_users.clear();
+  add_entries(flat.below, flat.below_size, result_.below_users);
+  upload_result_callback_(result_);
+}
@@ -0,0 +1,103 @@
+#include "traders_rating/rating_snapshot.h"
+
+#include <algorithm>
+
+namespace tr = ::traders_rating;
+
+/*
+ *
+ */
+const size_t tr::rating_snapshot::npos;
+
+tr::rating_snapshot::rating_snapshot() : version_(0), ts_(0) {}
+
+void tr::rating_snapshot::assign(uint64_t version, time_t ts,
+                                 const rating_index& index,
+                                 const std::vector<amount_t>& amounts,
+                                 const std::vector<user_id_t>& user_ids,
+                                 const std::vector<uint8_t>& has_amount) {
+  version_ = version;
+  ts_ = ts;
+  // память прошлого заполнения этого экземпляра переиспользуется
+  entries_.resize(index.size());
+  index.range(0, index.size(),
+              [&](size_t position, const rating_index::entry_t& e) {
+    entries_[position] = e;
+  });
+  users_.resize(has_amount.size());
+  for (size_t i = 0; i < has_amount.size(); ++i) {
+    users_[i].amount = amounts[i];
+    users_[i].user_id = user_ids[i];
+    // оборот за неделю не пропадает, а индекс пользователя не меняется:
+    // в таблицу добавляются появившиеся после прошлого заполнения
+    if (has_amount[i] && (i >= ranked_.size() || !ranked_[i])) {
+      indices_[user_ids[i]] = static_cast<user_index_t>(i);
+    }
+  }
+  ranked_.assign(has_amount.begin(), has_amount.end());
+}
+
+tr::user_index_t tr::rating_snapshot::find(user_id_t user_id) const {
+  auto it = indices_.find(user_id);
+  return it != indices_.end() ? it->second : user_directory::npos;
+}
+
+size_t tr::rating_snapshot::position(user_index_t index) const {
+  if (index >= ranked_.size() || !ranked_[index]) {
+    return npos;
+  }
+  return rank(users_[index].amount, users_[index].user_id);
+}
+
+bool tr::rating_snapshot::key(user_index_t index,
+                              rating_index::entry_t& key) const {
+  if (index >= ranked_.size() || !ranked_[index]) {
+    return false;
+  }
+  key = users_[index];
+  return true;
+}
+
+size_t tr::rating_snapshot::rank(amount_t amount, user_id_t user_id) const {
+  const rating_index::entry_t key{amount, user_id};
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), key,
+      [](const rating_index::entry_t& lhs, const rating_index::entry_t& rhs) {
+        return rating_index::before(lhs.amount, lhs.user_id, rhs.amount,
+                                    rhs.user_id);
+      });
+  return static_cast<size_t>(it - entries_.begin());
+}
+
+size_t tr::rating_snapshot::range(size_t first, size_t last,
+                                  rating_entry_t* out) const {
+  last = std::min(last, entries_.size());
+  size_t n = 0;
+  for (size_t position = first; position < last; ++position) {
+    const rating_index::entry_t& e = entries_[position];
+    out[n++] = rating_entry_t{position + 1, e.user_id, e.amount};
+  }
+  return n;
+}
+
+bool tr::rating_snapshot::get_result(user_index_t index, time_t ts,
+                                     flat_rating_result_t& res) const {
+  size_t position = this->position(index);
+  if (position == npos) {
+    return false;
+  }
+  const size_t neighbours = flat_rating_result_t::neighbours_capacity;
+  res.ts = ts;
+  res.user_id = users_[index].user_id;
+  res.amount = users_[index].amount;
+  res.rank = position + 1;
+  res.sections = section_all;
+  res.top_size = static_cast<uint32_t>(
+      range(0, flat_rating_result_t::top_capacity, res.top.data()));
+  res.above_size = static_cast<uint32_t>(
+      range(position > neighbours ? position - neighbours : 0, position,
+            res.above.data()));
+  res.below_size = static_cast<uint32_t>(range(
+      position + 1, position + 1 + neighbours, res.below.data()));
+  return true;
+}
@@ -0,0 +1,213 @@
+#include "traders_rating/replay.h"
+#include "traders_rating/utilities.h"
+#include "traders_rating/calendar.h"
+
+#include <chrono>
+#include <functional>
+
+#include <unistd.h>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+using steady_clock_t = std::chrono::steady_clock;
+
+uint64_t elapsed_ns(steady_clock_t::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             steady_clock_t::now() - start).count();
+}
+
+}  // namespace
+
+/*
+ *
+ */
+double tr::replay_report_t::events_per_second() const {
+  if (elapsed_ns == 0) {
+    return 0;
+  }
+  return events * 1e9 / elapsed_ns;
+}
+
+/*
+ *
+ */
+tr::replay::replay(const rating_sink& sink)
+    : rating_sink_(sink),
+      now_(0),
+      started_(false),
+      publish_pending_(false),
+      publish_ts_(0),
+      publish_minute_(0) {}
+
+time_t tr::replay::now() const { return now_; }
+
+const tr::replay_report_t& tr::replay::report() const { return report_; }
+
+void tr::replay::on_events(const event_record_t* const* events, size_t count) {
+  auto start = steady_clock_t::now();
+  for (size_t i = 0; i < count; ++i) {
+    const event_record_t& event = *events[i];
+    if (!started_) {
+      init(static_cast<time_t>(event.ts));
+    }
+    advance(static_cast<time_t>(event.ts));
+    handle_event(event);
+  }
+  report_.elapsed_ns += elapsed_ns(start);
+}
+
+void tr::replay::finish() {
+  if (!started_) {
+    return;
+  }
+  auto start = steady_clock_t::now();
+  advance(minute_times_.second + 1);
+  // минута, открытая последней публикацией, пуста
+  report_.minutes.pop_back();
+  report_.elapsed_ns += elapsed_ns(start);
+}
+
+void tr::replay::init(time_t ts) {
+  started_ = true;
+  now_ = ts;
+  minute_times_ = local_calendar().minute_times(ts);
+  minute_rating_ = minute_rating_uptr(
+      new minute_rating(minute_times_.first, minute_times_.second));
+  report_.minutes.push_back(replay_minute_t());
+  report_.minutes.back().minute_ts = minute_times_.first;
+  start_week(ts);
+}
+
+void tr::replay::start_week(time_t ts) {
+  using namespace std::placeholders;
+  auto week_times = local_calendar().week_times(ts);
+  week_rating_ = week_rating_uptr(new week_rating(
+      week_times.first, week_times.second,
+      std::bind(&replay::get_connected_users, this, _1), rating_sink_,
+      [this](time_t* t) {
+        if (t != nullptr) {
+          *t = now_;
+        }
+        return now_;
+      }));
+}
+
+void tr::replay::advance(time_t ts) {
+  // часы модели не идут назад; события без метки времени (0) и
+  // опоздавшие события относятся к текущему моменту
+  if (ts <= now_) {
+    return;
+  }
+  for (;;) {
+    if (publish_pending_ && ts >= publish_ts_) {
+      now_ = publish_ts_;
+      publish();
+    } else if (!publish_pending_ && ts >= week_rating_->finish_ts() &&
+               minute_times_.first == week_rating_->start_ts() &&
+               report_.minutes.back().events == 0) {
+      // неделя началась без событий, а ts - в одной из следующих недель:
+      // пустые недели не публикуются, модель сразу переходит к минуте ts
+      minute_times_ = local_calendar().minute_times(ts);
+      minute_rating_->reset(minute_times_.first, minute_times_.second);
+      report_.minutes.back().minute_ts = minute_times_.first;
+      start_week(ts);
+    } else if (ts >= minute_times_.second) {
+      now_ = minute_times_.second;
+      close_minute();
+    } else {
+      break;
+    }
+  }
+  now_ = ts;
+}
+
+void tr::replay::close_minute() {
+  auto start = steady_clock_t::now();
+  minute_rating& mr = *minute_rating_;
+  if (mr.start_ts() >= week_rating_->start_ts() &&
+      mr.finish_ts() <= week_rating_->finish_ts()) {
+    week_rating_->update_week_rating(mr);
+  }
+  report_.minutes.back().fold_ns = elapsed_ns(start);
+
+  publish_pending_ = true;
+  publish_ts_ = minute_times_.second + 1;
+  publish_minute_ = report_.minutes.size() - 1;
+
+  minute_times_ = local_calendar().minute_times(minute_times_.second);
+  minute_rating_->reset(minute_times_.first, minute_times_.second);
+  report_.minutes.push_back(replay_minute_t());
+  report_.minutes.back().minute_ts = minute_times_.first;
+}
+
+void tr::replay::publish() {
+  publish_pending_ = false;
+  auto start = steady_clock_t::now();
+  auto results = week_rating_->send_rating();
+  replay_minute_t& minute = report_.minutes[publish_minute_];
+  minute.publish_ns = elapsed_ns(start);
+  minute.results = results;
+  report_.results += results;
+
+  // последняя публикация недели сделана - начинается следующая неделя
+  auto minute_finish_ts = publish_ts_ - 1;
+  if (minute_finish_ts >= week_rating_->finish_ts()) {
+    start_week(minute_finish_ts);
+  }
+}
+
+void tr::replay::handle_event(const event_record_t& event) {
+  ++report_.events;
+  ++report_.minutes.back().events;
+  switch (event.type) {
+    case event_type_t::user_registered:
+      users_.register_user(event.user_id,
+                           user_name_t(event_name(event), event.name_size));
+      break;
+    case event_type_t::user_renamed: {
+      user_name_t* name = users_.find_name(event.user_id);
+      if (name != nullptr) {
+        name->assign(event_name(event), event.name_size);
+      }
+      break;
+    }
+    case event_type_t::user_connected:
+      users_.connect(event.user_id);
+      break;
+    case event_type_t::user_disconnected:
+      users_.disconnect(event.user_id);
+      break;
+    case event_type_t::user_deal_won:
+      minute_rating_->on_user_deal_won(static_cast<time_t>(event.ts),
+                                       users_.insert(event.user_id),
+                                       event.user_id, event.amount);
+      break;
+  }
+}
+
+void tr::replay::get_connected_users(std::vector<user_index_t>& users) {
+  users.clear();
+  users_.connected().append_to(users);
+}
+
+/*
+ *
+ */
+tr::replay_report_t tr::replay_feed(const std::string& path,
+                                    const rating_sink& sink) {
+  replay r(sink);
+  auto callback = [&r](const event_record_t* const* events, size_t count) {
+    r.on_events(events, count);
+  };
+  if (path == "-") {
+    stream_feed_reader reader(STDIN_FILENO);
+    reader.read(callback);
+  } else {
+    mmap_feed_reader reader(path);
+    reader.read(callback);
+  }
+  r.finish();
+  return r.report();
+}
@@ -1,7 +1,10 @@
 #include "traders_rating/service.h"
 #include "traders_rating/utilities.h"
+#include "traders_rating/calendar.h"
 
+#include <algorithm>
 #include <functional>
+#include <stdexcept>
 #include <cassert>
 
 namespace tr = ::traders_rating;
@@ -9,27 +12,47 @@ namespace tr = ::traders_rating;
 using unique_lock_t = std::unique_lock<std::mutex>;
 using lock_guard_t = std::lock_guard<std::mutex>;
 
+namespace {
+
+tr::delivery_config_t clamp_window(tr::delivery_config_t config) {
+  // часы с точностью до секунды: не больше одной части в секунду
+  config.window = std::min<uint32_t>(config.window, 59);
+  return config;
+}
+
+}  // namespace
+
 /*
  *
  */
 tr::service::service(tr::upload_result_callback callback,
-                     time_function_t time_function)
-    : finish_thread_(false),
+                     time_function_t time_function,
+                     const service_config_t& config)
+    : service(rating_sink(callback), time_function, config) {}
+
+tr::service::service(tr::upload_flat_result_callback callback,
+                     time_function_t time_function,
+                     const service_config_t& config)
+    : service(rating_sink(callback), time_function, config) {}
+
+tr::service::service(tr::upload_batch_callback callback,
+                     time_function_t time_function,
+                     const service_config_t& config)
+    : service(rating_sink(callback, config.upload_batch_size), time_function,
+              config) {}
+
+tr::service::service(const rating_sink& sink, time_function_t time_function,
+                     const service_config_t& config)
+    : config_(config),
+      cmds_(config.cmd_queue_capacity, config.cmd_name_capacity),
+      waiter_(config.wait),
+      finish_thread_(false),
       time_function_(time_function),
-      upload_result_callback_(callback),
+      timers_(time_function, config.clock_check_interval),
+      minute_pool_(minute_rating_pool::create(config.minute_expected_users)),
+      rating_sink_(sink),
       processed_cmds_(0) {
-  lock.clear();
   using namespace std::placeholders;
-  user_registered_callback_ =
-      std::bind(&service::process_user_registered, this, _1, _2);
-  user_renamed_callback_ =
-      std::bind(&service::process_user_renamed, this, _1, _2);
-  user_connected_callback_ =
-      std::bind(&service::process_user_connected, this, _1);
-  user_disconnected_callback_ =
-      std::bind(&service::process_user_disconnected, this, _1);
-  user_deal_won_callback_ =
-      std::bind(&service::process_user_deal_won, this, _1, _2, _3);
   get_connected_callback_ = std::bind(&service::get_connected_users, this, _1);
 }
 
@@ -40,162 +63,271 @@ void tr::service::start() {
 
 void tr::service::stop() {
   finish_thread_ = true;
+  waiter_.notify();
   th_.join();
 }
 
-void tr::service::add_cmd(cmd_uptr cmd) {
-  auto done = false;
-  while (!done) {
-    while (lock.test_and_set(std::memory_order_acquire))
-      ;  // spin
-    if (cmds_.size() < 1000) {
-      cmds_.push(std::move(cmd));
-      done = true;
-    }
-    lock.clear(std::memory_order_release);
-    if (done || finish_thread_) {
-      break;
-    } else {
-      tr::yield_thread();
+void tr::service::add_cmd(const cmd_t& cmd) {
+  while (!cmds_.try_push(cmd)) {
+    if (finish_thread_) {
+      return;
     }
+    tr::yield_thread();
   }
+  waiter_.notify();
 }
 
-std::pair<bool, tr::cmd_uptr> tr::service::get_cmd() {
-  optional_cmd_t optional_cmd;
-  while (lock.test_and_set(std::memory_order_acquire))
-    ;  // spin
-  if (cmds_.empty()) {
-    optional_cmd.first = false;
-  } else {
-    optional_cmd.first = true;
-    optional_cmd.second = std::move(cmds_.front());
-    cmds_.pop();
+void tr::service::add_cmd(const cmd_t& cmd, const user_name_t& name) {
+  while (!cmds_.try_push(cmd, name)) {
+    if (finish_thread_) {
+      return;
+    }
+    tr::yield_thread();
   }
-  lock.clear(std::memory_order_release);
-  return optional_cmd;
+  waiter_.notify();
 }
 
 void tr::service::on_user_registered(user_id_t id, const user_name_t& name) {
-  add_cmd(cmd_uptr(new user_registered(id, name, user_registered_callback_)));
+  add_cmd(make_user_registered_cmd(id, 0), name);
 }
 
 void tr::service::on_user_renamed(user_id_t id, const user_name_t& name) {
-  add_cmd(cmd_uptr(new user_renamed(id, name, user_renamed_callback_)));
+  add_cmd(make_user_renamed_cmd(id, 0), name);
 }
 
 void tr::service::on_user_connected(user_id_t id) {
-  add_cmd(cmd_uptr(new user_connected(id, user_connected_callback_)));
+  add_cmd(make_user_connected_cmd(id));
 }
 
 void tr::service::on_user_disconnected(user_id_t id) {
-  add_cmd(cmd_uptr(new user_disconnected(id, user_disconnected_callback_)));
+  add_cmd(make_user_disconnected_cmd(id));
 }
 
 void tr::service::on_user_deal_won(time_t ts, user_id_t id, amount_t amount) {
-  add_cmd(cmd_uptr(new user_deal_won(ts, id, amount, user_deal_won_callback_)));
+  if (!valid_amount(amount)) {
+    throw std::invalid_argument("service: amount is out of range");
+  }
+  add_cmd(make_user_deal_won_cmd(ts, id, amount));
+}
+
+void tr::service::on_events(const event_record_t* const* events,
+                            size_t count) {
+  // до постановки в очередь: занятые ячейки должны быть заполнены
+  for (size_t i = 0; i < count; ++i) {
+    if (events[i]->type == event_type_t::user_deal_won &&
+        !valid_amount(events[i]->amount)) {
+      throw std::invalid_argument("service: amount is out of range");
+    }
+  }
+  while (count > 0) {
+    auto n = std::min(count,
+                      std::min(config_.cmd_batch_size, cmds_.capacity()));
+    auto fill = [events](size_t i, cmd_t& cmd, user_name_t& name) {
+      const event_record_t& event = *events[i];
+      cmd = to_cmd(event);
+      name.assign(event_name(event), event.name_size);
+    };
+    while (!cmds_.try_push_batch(n, fill)) {
+      if (finish_thread_) {
+        return;
+      }
+      tr::yield_thread();
+    }
+    waiter_.notify();
+    events += n;
+    count -= n;
+  }
+}
+
+void tr::service::handle_cmd(const cmd_t& cmd) {
+  switch (cmd.type) {
+    case cmd_type_t::user_registered:
+      process_user_registered(cmd.id, cmds_.name(cmd));
+      break;
+    case cmd_type_t::user_renamed:
+      process_user_renamed(cmd.id, cmds_.name(cmd));
+      break;
+    case cmd_type_t::user_connected:
+      process_user_connected(cmd.id);
+      break;
+    case cmd_type_t::user_disconnected:
+      process_user_disconnected(cmd.id);
+      break;
+    case cmd_type_t::user_deal_won:
+      process_user_deal_won(cmd.ts, cmd.id, cmd.amount);
+      break;
+  }
 }
 
 void tr::service::execute() {
-  auto start_ts = time_function_(nullptr);
-  auto this_week_times = tr::get_week_times(start_ts);
-  this_week_rating_ = week_rating_uptr(new week_rating(
+  timers_.clear();
+  auto start_ts = timers_.read_clock();
+  auto this_week_times = tr::local_calendar().week_times(start_ts);
+  week_rating_sptr week(new week_rating(
       this_week_times.first, this_week_times.second, get_connected_callback_,
-      upload_result_callback_, time_function_));
-  this_week_rating_->start();
+      rating_sink_, time_function_, config_.wait, config_.delivery));
+  week->start();
+  unique_lock_t lk(mt_);
+  // повторный start(): прежняя неделя остановлена, ее освободит
+  // последний читатель get_rating
+  this_week_rating_ = std::move(week);
+  std::atomic_store(&current_week_, this_week_rating_);
+  lk.unlock();
+  timers_.schedule(this_week_times.second, week_rollover);
 
-  auto this_minute_times = tr::get_minute_times(start_ts);
-  this_minute_rating_ = minute_rating_uptr(
-      new minute_rating(this_minute_times.first, this_minute_times.second));
+  auto this_minute_times = tr::local_calendar().minute_times(start_ts);
+  this_minute_rating_ = minute_pool_->acquire(this_minute_times.first,
+                                              this_minute_times.second);
+  timers_.schedule(this_minute_times.second, minute_close);
 
+  auto fired = [this](deadline_scheduler::timer_id_t id, time_t ts) {
+    on_deadline(id, ts);
+  };
   while (!finish_thread_) {
-    auto current_ts = time_function_(nullptr);
-
-    if (current_ts >= this_minute_times.second) {
-      this_week_rating_->on_minute(std::move(this_minute_rating_));
-      this_minute_times = tr::get_minute_times(current_ts);
-      this_minute_rating_ = minute_rating_uptr(
-          new minute_rating(this_minute_times.first, this_minute_times.second));
-    }
-
-    if (current_ts >= this_week_times.second) {
-      auto ts = this_week_rating_->start_ts();
-      archive_week_ratings_.insert(
-          std::make_pair(ts, std::move(this_week_rating_)));
-      this_week_times = tr::get_week_times(current_ts);
-      this_week_rating_ = week_rating_uptr(new week_rating(
-          this_week_times.first, this_week_times.second,
-          get_connected_callback_, upload_result_callback_, time_function_));
-      this_week_rating_->start();
-    }
-
-    auto optional_cmd = get_cmd();
-    if (!optional_cmd.first) {
-      tr::yield_thread();
+    auto handled = cmds_.consume([this](cmd_t& cmd) { handle_cmd(cmd); },
+                                 config_.cmd_batch_size);
+    if (handled == 0) {
+      waiter_.idle([this]() { return finish_thread_ || !cmds_.empty(); });
+      // в простое часы читаются на каждой итерации
+      timers_.poll_now(fired);
       continue;
     }
-
-    optional_cmd.second->handle();
-    ++processed_cmds_;
+    waiter_.reset();
+    processed_cmds_.fetch_add(handled, std::memory_order_relaxed);
+    timers_.poll(fired);
   }
   this_week_rating_->stop();
   for (auto& p : archive_week_ratings_) {
     p.second->stop();
   }
+  archive_week_ratings_.clear();
+}
+
+void tr::service::on_deadline(deadline_scheduler::timer_id_t id,
+                              time_t current_ts) {
+  if (id == minute_close) {
+    this_week_rating_->on_minute(std::move(this_minute_rating_));
+    auto minute_times = tr::local_calendar().minute_times(current_ts);
+    this_minute_rating_ =
+        minute_pool_->acquire(minute_times.first, minute_times.second);
+    timers_.schedule(minute_times.second, minute_close);
+    return;
+  }
+  auto week_times = tr::local_calendar().week_times(current_ts);
+  week_rating_sptr week(new week_rating(
+      week_times.first, week_times.second, get_connected_callback_,
+      rating_sink_, time_function_, config_.wait, config_.delivery));
+  week->start();
+  // потоки прошлых недель сами завершаются вскоре после их конца
+  for (auto it = archive_week_ratings_.begin();
+       it != archive_week_ratings_.end();) {
+    if (!it->second->finished()) {
+      ++it;
+      continue;
+    }
+    it->second->stop();
+    it = archive_week_ratings_.erase(it);
+  }
+  lock_guard_t lk(mt_);
+  auto ts = this_week_rating_->start_ts();
+  archive_week_ratings_.insert(
+      std::make_pair(ts, std::move(this_week_rating_)));
+  this_week_rating_ = std::move(week);
+  std::atomic_store(&current_week_, this_week_rating_);
+  timers_.schedule(week_times.second, week_rollover);
 }
 
 uint64_t tr::service::processed_cmds() const { return processed_cmds_; }
 
+tr::delivery_stats_t tr::service::delivery_stats() const {
+  lock_guard_t lk(mt_);
+  return this_week_rating_ ? this_week_rating_->delivery_stats()
+                           : delivery_stats_t();
+}
+
+bool tr::service::get_rating(user_id_t id, flat_rating_result_t& res) const {
+  // ни mt_, ни users_: индекс пользователя берется из самого снимка
+  week_rating_sptr week = std::atomic_load(&current_week_);
+  if (!week) {
+    return false;
+  }
+  bool found = false;
+  auto ts = time_function_(nullptr);
+  week->read_snapshot([&](const rating_snapshot& snapshot) {
+    user_index_t index = snapshot.find(id);
+    found = index != user_directory::npos &&
+            snapshot.get_result(index, ts, res);
+  });
+  return found;
+}
+
 void tr::service::process_user_registered(user_id_t id,
                                           const user_name_t& name) {
   lock_guard_t lk(mt_);
-  registered_users_.insert(std::make_pair(id, name));
+  users_.register_user(id, name);
 }
 
 bool tr::service::is_user_registered(user_id_t user_id) const {
   lock_guard_t lk(mt_);
-  return registered_users_.count(user_id) > 0;
+  return users_.is_registered(user_id);
 }
 
 void tr::service::process_user_renamed(user_id_t id, const user_name_t& name) {
   lock_guard_t lk(mt_);
-  auto itr = registered_users_.find(id);
-  if (itr != registered_users_.end()) {
-    itr->second = name;
+  user_name_t* user_name = users_.find_name(id);
+  if (user_name != nullptr) {
+    *user_name = name;
   }
 }
 
 void tr::service::process_user_connected(user_id_t id) {
-  lock_guard_t lk(mt_);
-  auto itr = registered_users_.find(id);
-  if (itr != registered_users_.end()) {
-    connected_users_.insert(id);
+  // users_ изменяет только этот поток, поэтому проверка идет без mt_:
+  // ответ по снимку может ждать rating_sink недели. Сделки создают
+  // индексы и незарегистрированным; рейтинг при подключении - только
+  // новому подключению зарегистрированного
+  user_index_t index = users_.find(id);
+  if (index == user_directory::npos || !users_.is_registered(id) ||
+      users_.connected().test(index)) {
+    return;
   }
+  // до того, как пользователь попадет в снимок подключенных
+  this_week_rating_->on_user_connected(index);
+  lock_guard_t lk(mt_);
+  users_.connect(id);
 }
 
 void tr::service::process_user_disconnected(user_id_t id) {
   lock_guard_t lk(mt_);
-  connected_users_.erase(id);
+  users_.disconnect(id);
 }
 
 bool tr::service::is_user_connected(user_id_t user_id) const {
   lock_guard_t lk(mt_);
-  return connected_users_.count(user_id) > 0;
+  return users_.is_connected(user_id);
 }
 
 void tr::service::process_user_deal_won(time_t ts, user_id_t id, amount_t am) {
-  this_minute_rating_->on_user_deal_won(ts, id, am);
+  if (ts >= timers_.next_deadline()) {
+    // сделка уже из следующей минуты: срок наступил раньше, чем
+    // горячий цикл прочитал часы
+    timers_.poll_now([this](deadline_scheduler::timer_id_t id, time_t now) {
+      on_deadline(id, now);
+    });
+  }
+  // users_ изменяет только этот поток, поэтому поиск идет без mt_
+  user_index_t index = users_.find(id);
+  if (index == user_directory::npos) {
+    lock_guard_t lk(mt_);
+    index = users_.insert(id);
+  }
+  this_minute_rating_->on_user_deal_won(ts, index, id, am);
 }
 
-void tr::service::get_connected_users(std::vector<user_id_t>& users) {
-  unique_lock_t lk(mt_);
-  auto connected_users_size = connected_users_.size();
-  lk.unlock();
-  users.reserve(connected_users_size + 10);
-  lk.lock();
-  for (auto user_id : connected_users_) {
-    users.push_back(user_id);
-  }
+void tr::service::get_connected_users(std::vector<user_index_t>& users) {
+  // без mt_: поток сервиса продолжает подключать и отключать
+  // пользователей, пока снимок копируется
+  users.clear();
+  users_.connected().append_to(users);
 }
 
 /*
@@ -205,17 +337,49 @@ tr::week_rating::week_rating(time_t start, time_t finish,
                              get_connected_callback get_connected,
                              upload_result_callback upload_result_callback_f,
                              time_function_t time_function)
+    : week_rating(start, finish, get_connected,
+                  rating_sink(upload_result_callback_f), time_function) {}
+
+tr::week_rating::week_rating(
+    time_t start, time_t finish, get_connected_callback get_connected,
+    upload_flat_result_callback upload_flat_result_callback_f,
+    time_function_t time_function)
+    : week_rating(start, finish, get_connected,
+                  rating_sink(upload_flat_result_callback_f), time_function) {}
+
+tr::week_rating::week_rating(time_t start, time_t finish,
+                             get_connected_callback get_connected,
+                             const rating_sink& sink,
+                             time_function_t time_function,
+                             const wait_config_t& wait_config,
+                             const delivery_config_t& delivery_config)
     : start_ts_(start),
       finish_ts_(finish),
+      waiter_(wait_config),
       finish_thread_(false),
+      minutes_pending_(false),
       get_connected_callback_(get_connected),
-      upload_result_callback_(upload_result_callback_f),
+      rating_sink_(sink),
       time_function_(time_function),
       thread_started_(false),
-      thread_finished_(false) {}
+      thread_finished_(false),
+      top_size_(0),
+      delivery_config_(clamp_window(delivery_config)),
+      slices_(0),
+      next_slice_(0),
+      top_fingerprint_(0),
+      connects_pending_(false),
+      connect_sink_(sink),
+      stats_second_(0),
+      stats_second_messages_(0) {
+  rating_sink_.set_callback_mutex(&callback_mt_);
+  connect_sink_.set_callback_mutex(&callback_mt_);
+}
 
 time_t tr::week_rating::start_ts() const { return start_ts_; }
 
+time_t tr::week_rating::finish_ts() const { return finish_ts_; }
+
 bool tr::week_rating::started() const { return thread_started_; }
 
 bool tr::week_rating::finished() const { return thread_finished_; }
@@ -223,8 +387,20 @@ bool tr::week_rating::finished() const { return thread_finished_; }
 void tr::week_rating::on_minute(tr::minute_rating_uptr minute_rating) {
   unique_lock_t lk(mt_);
   minute_ratings_.push(std::move(minute_rating));
+  minutes_pending_ = true;
+  lk.unlock();
+  waiter_.notify();
+}
+
+void tr::week_rating::on_user_connected(user_index_t index) {
+  if (delivery_config_.snapshots && send_snapshot_rating(index)) {
+    return;
+  }
+  unique_lock_t lk(mt_);
+  connected_since_.push_back(index);
+  connects_pending_ = true;
   lk.unlock();
-  cv_.notify_one();
+  waiter_.notify();
 }
 
 void tr::week_rating::start() {
@@ -233,10 +409,8 @@ void tr::week_rating::start() {
 }
 
 void tr::week_rating::stop() {
-  unique_lock_t lk(mt_);
   finish_thread_ = true;
-  cv_.notify_one();
-  lk.unlock();
+  waiter_.notify();
   th_.join();
 }
 
@@ -244,163 +418,641 @@ void tr::week_rating::execute() {
   thread_started_ = true;
   struct on_finish_t {
     week_rating* p;
-    ~on_finish_t() { p->thread_finished_ = true; }
+    ~on_finish_t() {
+      // потоки пула не переживают поток недели (архивные недели)
+      p->pool_.reset();
+      p->thread_finished_ = true;
+    }
   } on_finish{this};
-  std::chrono::seconds wait_interval(1);
-  auto current_minute = get_minute_times(time_function_(nullptr));
-  // поток сам завершится через 5 секунду после окончания недели
-  auto finish_thread_ts = finish_ts_ + 5;
-  while (!finish_thread_) {
-    auto current_ts = time_function_(nullptr);
-    if (current_ts > finish_thread_ts) {
+  enum : deadline_scheduler::timer_id_t { publication, delivery, finish };
+  deadline_scheduler timers(time_function_);
+  const calendar_table& calendar = local_calendar();
+  bool publish = false;
+  bool deliver = false;
+  time_t delivery_start = 0;
+  auto fired = [&](deadline_scheduler::timer_id_t id, time_t current_ts) {
+    if (id == finish) {
       finish_thread_ = true;
-      continue;
+      return;
     }
+    if (id == delivery) {
+      deliver = true;
+      return;
+    }
+    // рейтинг отправляется через 1 секунду после окончания минуты
+    publish = true;
+    timers.schedule(calendar.minute_times(current_ts).second + 1, publication);
+  };
+  timers.schedule(calendar.minute_times(timers.now()).second + 1, publication);
+  // поток сам завершится через 5 секунд после окончания недели
+  timers.schedule(finish_ts_ + 6, finish);
 
-    minute_ratings_t copy_minute_ratings_;
-    unique_lock_t lk(mt_);
-    while (!minute_ratings_.empty()) {
-      copy_minute_ratings_.push(std::move(minute_ratings_.front()));
-      minute_ratings_.pop();
+  while (!finish_thread_) {
+    timers.poll_now(fired);
+    if (finish_thread_) {
+      continue;
     }
-    lk.unlock();
+    if (connects_pending_) {
+      send_connected();
+      waiter_.reset();
+    }
+
+    if (minutes_pending_) {
+      minute_ratings_t copy_minute_ratings_;
+      unique_lock_t lk(mt_);
+      while (!minute_ratings_.empty()) {
+        copy_minute_ratings_.push(std::move(minute_ratings_.front()));
+        minute_ratings_.pop();
+      }
+      minutes_pending_ = false;
+      lk.unlock();
 
-    while (!copy_minute_ratings_.empty()) {
-      minute_rating& mr = *copy_minute_ratings_.front();
-      if (mr.start_ts() >= start_ts_ && mr.finish_ts() <= finish_ts_) {
-        update_week_rating(mr);
+      while (!copy_minute_ratings_.empty()) {
+        minute_rating& mr = *copy_minute_ratings_.front();
+        if (mr.start_ts() >= start_ts_ && mr.finish_ts() <= finish_ts_) {
+          if (connects_pending_) {
+            send_connected();
+          }
+          update_week_rating(mr);
+        }
+        copy_minute_ratings_.pop();
       }
-      copy_minute_ratings_.pop();
+      waiter_.reset();
     }
 
-    // через 1 секунду после окончания минуты функция отправляет рейтинг
-    if (current_ts < current_minute.second + 1) {
-      lk.lock();
-      if (finish_thread_) {
-        continue;
+    if (publish) {
+      // недоставленные части прошлой минуты досылаются сразу
+      while (next_slice_ < slices_) {
+        send_slice(next_slice_++);
+        if (connects_pending_) {
+          send_connected();
+        }
       }
-      cv_.wait_for(lk, wait_interval, [&]() { return !!finish_thread_; });
+      // часть i уходит через i секунд после начала рассылки
+      prepare_delivery(std::max<uint32_t>(delivery_config_.window, 1));
+      delivery_start = timers.now();
+      publish = false;
+      deliver = true;
+    }
+
+    if (!deliver) {
+      waiter_.idle([this]() {
+        return finish_thread_ || minutes_pending_ || connects_pending_;
+      });
       continue;
     }
 
-    send_rating();
-    current_minute = get_minute_times(current_ts);
+    deliver = false;
+    if (next_slice_ < slices_) {
+      send_slice(next_slice_++);
+    }
+    if (next_slice_ < slices_) {
+      timers.schedule(delivery_start + next_slice_, delivery);
+    }
+    waiter_.reset();
   }
 }
 
-void tr::week_rating::send_rating() {
-  auto ts = time_function_(nullptr);
-  std::vector<user_id_t> users;
-  get_connected_callback_(users);
-  for (auto user_id : users) {
-    rating_result_t res;
-    res.ts = ts;
-    res.user_id = user_id;
-    res.amount = 0;
-    auto user_won_amount_itr = user_won_amount_.find(user_id);
-    if (user_won_amount_itr != std::end(user_won_amount_)) {
-      res.amount = user_won_amount_itr->second;
-    } else {
-      continue;
+size_t tr::week_rating::send_rating() {
+  prepare_delivery(1);
+  next_slice_ = 1;
+  return send_slice(0);
+}
+
+tr::delivery_stats_t tr::week_rating::delivery_stats() const {
+  lock_guard_t lk(stats_mt_);
+  return stats_;
+}
+
+void tr::week_rating::prepare_delivery(uint32_t slices) {
+  connected_users_.clear();
+  get_connected_callback_(connected_users_);
+  // после снимка: подключение попадает в connected_since_ или
+  // answered_since_ раньше, чем в снимок, поэтому каждый подключившийся
+  // из снимка уже получил полное сообщение, delivered_ хранит его
+  // отпечатки, и в разностном режиме дальше идут разности к нему
+  send_connected();
+  // до сборки: при параллельной сборке массив не растет
+  if (delivery_config_.delta && delivered_.size() < has_amount_.size()) {
+    delivered_.resize(has_amount_.size());
+  }
+
+  // подсчетом по частям: каждый пользователь попадает ровно в одну часть,
+  // и у одного пользователя она одна и та же каждую минуту
+  slices_ = slices;
+  next_slice_ = 0;
+  slice_offsets_.assign(slices + 1, 0);
+  for (auto index : connected_users_) {
+    if (index < has_amount_.size() && has_amount_[index]) {
+      ++slice_offsets_[index % slices + 1];
+    }
+  }
+  for (uint32_t i = 0; i < slices; ++i) {
+    slice_offsets_[i + 1] += slice_offsets_[i];
+  }
+  delivery_users_.resize(slice_offsets_[slices]);
+  slice_positions_.assign(slice_offsets_.begin(), slice_offsets_.end() - 1);
+  for (auto index : connected_users_) {
+    if (index < has_amount_.size() && has_amount_[index]) {
+      delivery_users_[slice_positions_[index % slices]++] = index;
     }
+  }
 
-    // top 10 users
-    {
-      rating_by_amount_t::iterator itr = rating_by_amount_.begin();
-      for (auto i = 0U; i < 10 && i < rating_by_amount_.size(); ++i, ++itr) {
-        auto user_pair = res.top_users.insert(
-            std::make_pair(itr->first, rating_result_t::user_set_t()));
-        rating_result_t::user_set_t& user_set = user_pair.first->second;
-        for (auto k : itr->second) {
-          user_set.insert(k);
-        }
+  lock_guard_t lk(stats_mt_);
+  ++stats_.minutes;
+  stats_.last_messages = 0;
+  stats_.last_peak = 0;
+}
+
+size_t tr::week_rating::send_slice(uint32_t slice) {
+  // между частями поток недели сворачивает минуты, поэтому топ берется
+  // заново для каждой части: топ, место и соседи из одного состояния
+  take_top();
+  auto ts = time_function_(nullptr);
+  size_t first = slice_offsets_[slice], last = slice_offsets_[slice + 1];
+  delivery_counts_t counts;
+  if (delivery_config_.workers > 1 && last - first > fanout_chunk) {
+    send_parallel(first, last, ts, counts);
+  } else {
+    for (size_t i = first; i < last; ++i) {
+      flat_rating_result_t& res = rating_sink_.next();
+      if (!build_result(delivery_users_[i], ts, res)) {
+        // место в буфере занимает следующее сообщение
+        ++counts.unchanged;
+        continue;
       }
+      counts.entries += res.top_size + res.above_size + res.below_size;
+      rating_sink_.commit();
+      ++counts.messages;
     }
+    rating_sink_.flush();
+  }
 
-    // users above user_id
-    rating_by_amount_t::iterator above_itr =
-        rating_by_amount_.lower_bound(res.amount);
-    if (above_itr != std::begin(rating_by_amount_)) {
-      auto above_total = 0;
-      do {
-        --above_itr;
-        auto user_pair = res.above_users.insert(
-            std::make_pair(above_itr->first, rating_result_t::user_set_t()));
-        rating_result_t::user_set_t& user_set = user_pair.first->second;
-        for (auto k : above_itr->second) {
-          user_set.insert(k);
-        }
-      } while (above_itr != std::begin(rating_by_amount_) &&
-               above_total++ < 10);
+  lock_guard_t lk(stats_mt_);
+  stats_.messages += counts.messages;
+  stats_.unchanged += counts.unchanged;
+  stats_.entries += counts.entries;
+  stats_.last_messages += counts.messages;
+  if (ts != stats_second_) {
+    stats_second_ = ts;
+    stats_second_messages_ = 0;
+  }
+  stats_second_messages_ += counts.messages;
+  stats_.last_peak = std::max<uint64_t>(stats_.last_peak,
+                                        stats_second_messages_);
+  stats_.max_peak = std::max(stats_.max_peak, stats_.last_peak);
+  return counts.messages;
+}
+
+tr::worker_pool& tr::week_rating::workers() {
+  if (!pool_) {
+    pool_.reset(new worker_pool(delivery_config_.workers));
+    fanout_.resize(pool_->size());
+    for (auto& buffer : fanout_) {
+      buffer.results.resize(fanout_chunk);
     }
+  }
+  return *pool_;
+}
 
-    // users below user_id
-    {
-      rating_by_amount_t::iterator below_itr =
-          rating_by_amount_.upper_bound(res.amount);
-      auto below_total = 0;
-      while (below_itr != rating_by_amount_.end() && below_total < 10) {
-        auto user_pair = res.below_users.insert(
-            std::make_pair(below_itr->first, rating_result_t::user_set_t()));
-        rating_result_t::user_set_t& user_set = user_pair.first->second;
-        for (auto k : below_itr->second) {
-          user_set.insert(k);
-        }
-        ++below_itr;
+void tr::week_rating::send_parallel(size_t first, size_t last, time_t ts,
+                                    delivery_counts_t& counts) {
+  size_t chunks = (last - first + fanout_chunk - 1) / fanout_chunk;
+  workers().run(chunks, [&](size_t chunk, size_t worker) {
+    fanout_buffer_t& buffer = fanout_[worker];
+    size_t begin = first + chunk * fanout_chunk;
+    size_t end = std::min(begin + fanout_chunk, last);
+    size_t n = 0;
+    for (size_t i = begin; i < end; ++i) {
+      flat_rating_result_t& res = buffer.results[n];
+      if (!build_result(delivery_users_[i], ts, res)) {
+        ++buffer.counts.unchanged;
+        continue;
       }
+      buffer.counts.entries += res.top_size + res.above_size + res.below_size;
+      ++n;
+    }
+    buffer.counts.messages += n;
+    lock_guard_t lk(sink_mt_);
+    rating_sink_.upload(buffer.results.data(), n);
+  });
+  for (auto& buffer : fanout_) {
+    counts.messages += buffer.counts.messages;
+    counts.unchanged += buffer.counts.unchanged;
+    counts.entries += buffer.counts.entries;
+    buffer.counts = delivery_counts_t();
+  }
+}
+
+size_t tr::week_rating::send_connected() {
+  connect_users_.clear();
+  answered_users_.clear();
+  unique_lock_t lk(mt_);
+  connect_users_.swap(connected_since_);
+  answered_users_.swap(answered_since_);
+  connects_pending_ = false;
+  lk.unlock();
+  if (delivery_config_.delta && delivered_.size() < has_amount_.size()) {
+    delivered_.resize(has_amount_.size());
+  }
+  // получившим полный рейтинг по снимку дальше идут разности к нему
+  for (const auto& answered : answered_users_) {
+    if (answered.index < delivered_.size()) {
+      delivered_[answered.index] = answered.delivered;
+    }
+  }
+  if (connect_users_.empty()) {
+    return 0;
+  }
+
+  // топ по текущему индексу: снимок публикации мог устареть
+  take_top();
+  auto ts = time_function_(nullptr);
+  delivery_counts_t counts;
+  for (auto index : connect_users_) {
+    if (index < delivered_.size()) {
+      delivered_[index] = delivered_t();
     }
+    // без оборота за неделю пользователя нет в рейтинге
+    if (index >= has_amount_.size() || !has_amount_[index]) {
+      continue;
+    }
+    flat_rating_result_t& res = rating_sink_.next();
+    res.top = top_;
+    res.top_size = top_size_;
+    fill_result(index, ts, res);
+    if (delivery_config_.delta) {
+      make_delta(index, top_fingerprint_, res);
+    }
+    counts.entries += res.top_size + res.above_size + res.below_size;
+    rating_sink_.commit();
+    ++counts.messages;
+  }
+  rating_sink_.flush();
+
+  lock_guard_t stats_lk(stats_mt_);
+  stats_.connect_messages += counts.messages;
+  stats_.entries += counts.entries;
+  return counts.messages;
+}
+
+void tr::week_rating::take_top() {
+  top_size_ = 0;
+  rating_index_.range(0, flat_rating_result_t::top_capacity,
+                      [&](size_t position, const rating_index::entry_t& e) {
+    top_[top_size_++] = rating_entry_t{position + 1, e.user_id, e.amount};
+  });
+  top_fingerprint_ = fingerprint(top_.data(), top_size_);
+}
+
+bool tr::week_rating::build_result(user_index_t index, time_t ts,
+                                   flat_rating_result_t& res) {
+  res.top = top_;
+  res.top_size = top_size_;
+  fill_result(index, ts, res);
+  return !delivery_config_.delta || make_delta(index, top_fingerprint_, res);
+}
+
+void tr::week_rating::fill_result(user_index_t index, time_t ts,
+                                  flat_rating_result_t& res) const {
+  user_id_t user_id = user_ids_[index];
+  res.ts = ts;
+  res.user_id = user_id;
+  res.amount = amounts_[index];
+  size_t position = rating_index_.rank(res.amount, user_id);
+  res.rank = position + 1;
+  res.sections = section_all;
+
+  // users above user_id
+  const size_t neighbours = flat_rating_result_t::neighbours_capacity;
+  res.above_size = 0;
+  rating_index_.range(position > neighbours ? position - neighbours : 0,
+                      position,
+                      [&](size_t above, const rating_index::entry_t& e) {
+    res.above[res.above_size++] =
+        rating_entry_t{above + 1, e.user_id, e.amount};
+  });
+
+  // users below user_id
+  res.below_size = 0;
+  rating_index_.range(position + 1, position + 1 + neighbours,
+                      [&](size_t below, const rating_index::entry_t& e) {
+    res.below[res.below_size++] =
+        rating_entry_t{below + 1, e.user_id, e.amount};
+  });
+}
+
+bool tr::week_rating::make_delta(user_index_t index, uint64_t top_fingerprint,
+                                 flat_rating_result_t& res) {
+  // delivered_ размечен по has_amount_ в prepare_delivery и
+  // send_connected
+  delivered_t& last = delivered_[index];
+  delivered_t current{fingerprint(res.amount, res.rank), top_fingerprint,
+                      fingerprint(res.above.data(), res.above_size),
+                      fingerprint(res.below.data(), res.below_size)};
+  res.sections = 0;
+  if (current.user != last.user) {
+    res.sections |= section_user;
+  }
+  if (current.top != last.top) {
+    res.sections |= section_top;
+  } else {
+    res.top_size = 0;
+  }
+  if (current.above != last.above) {
+    res.sections |= section_above;
+  } else {
+    res.above_size = 0;
+  }
+  if (current.below != last.below) {
+    res.sections |= section_below;
+  } else {
+    res.below_size = 0;
+  }
+  last = current;
+  return res.sections != 0;
+}
+
+void tr::week_rating::update_week_rating(tr::minute_rating& mr) {
+  fold_minute(mr);
+  if (delivery_config_.snapshots) {
+    publish_snapshot(mr.finish_ts());
+  }
+}
+
+void tr::week_rating::publish_snapshot(time_t ts) {
+  // back() никто не читает: publish() дождался читателей прошлого раза
+  snapshots_.back().assign(snapshots_.front().version() + 1, ts,
+                           rating_index_, amounts_, user_ids_, has_amount_);
+  snapshots_.publish();
+}
 
-    upload_result_callback_(res);
+bool tr::week_rating::send_snapshot_rating(user_index_t index) {
+  // опубликованный снимок свертка не меняет, поэтому ответ ее не ждет;
+  // сообщение отдается уже после чтения снимка, а рассылку недели ждет
+  // не дольше одного вызова функции получателя
+  flat_rating_result_t res;
+  bool found = false;
+  auto ts = time_function_(nullptr);
+  snapshots_.read([&](const rating_snapshot& snapshot) {
+    found = snapshot.get_result(index, ts, res);
+  });
+  if (!found) {
+    return false;
+  }
+  connect_sink_.upload(&res, 1);
+  if (delivery_config_.delta) {
+    // отпечатки ответа: следующая публикация пошлет разности к нему
+    answered_t answered{
+        index,
+        delivered_t{fingerprint(res.amount, res.rank),
+                    fingerprint(res.top.data(), res.top_size),
+                    fingerprint(res.above.data(), res.above_size),
+                    fingerprint(res.below.data(), res.below_size)}};
+    unique_lock_t lk(mt_);
+    answered_since_.push_back(answered);
+    connects_pending_ = true;
+    lk.unlock();
+    waiter_.notify();
   }
+
+  lock_guard_t lk(stats_mt_);
+  ++stats_.connect_messages;
+  stats_.entries += res.top_size + res.above_size + res.below_size;
+  return true;
 }
 
-void tr::week_rating::update_week_rating(const tr::minute_rating& mr) {
-  for (const auto& user_data : mr) {
-    user_id_t user_id = user_data.first;
-    amount_t amount = user_data.second;
-    auto itr = user_won_amount_.find(user_id);
-    amount_t prev_amount;
-    if (itr == std::end(user_won_amount_)) {
-      std::tie(itr, std::ignore) =
-          user_won_amount_.insert(std::make_pair(user_id, amount));
-      prev_amount = 0;
+void tr::week_rating::fold_minute(tr::minute_rating& mr) {
+  if (mr.size() == 0) {
+    return;
+  }
+  // суммы недели читаются и пишутся по возрастанию индекса
+  mr.sort_by_index();
+  user_index_t last_index = (mr.end() - 1)->index;
+  if (last_index >= has_amount_.size()) {
+    size_t size = std::max<size_t>(last_index + 1, has_amount_.size() * 2);
+    amounts_.resize(size);
+    user_ids_.resize(size);
+    has_amount_.resize(size);
+  }
+  // способ свертки - по доле ключей индекса, которые изменит минута.
+  // В редкой минуте изменения попадают в разные листья индекса, и
+  // прежний и новый ключ пользователя дешевле менять сразу, пока путь к
+  // ним в кэше; если меняется большая часть ключей, индекс дешевле
+  // построить заново из упорядоченного массива
+  const size_t ranked = rating_index_.size();
+  const bool rebuild = mr.size() * fold_rebuild_density >= ranked;
+  const bool batch = mr.size() * fold_batch_density >= ranked;
+  fold_erased_.clear();
+  fold_inserted_.clear();
+  for (const auto& entry : mr) {
+    user_index_t index = entry.index;
+    if (!has_amount_[index]) {
+      has_amount_[index] = 1;
+      amounts_[index] = entry.amount;
+      user_ids_[index] = entry.user_id;
+      if (rebuild) {
+        continue;
+      }
     } else {
-      prev_amount = itr->second;
-      itr->second += amount;
-    }
-    if (prev_amount > 0) {
-      auto ra_itr = rating_by_amount_.find(prev_amount);
-      assert(ra_itr != rating_by_amount_.end());
-      same_amount_users_t& same_amount_users = ra_itr->second;
-      same_amount_users.erase(user_id);
+      amount_t prev_amount = amounts_[index];
+      amounts_[index] += entry.amount;
+      if (rebuild) {
+        continue;
+      }
+      if (!batch) {
+        rating_index_.update(entry.user_id, prev_amount, amounts_[index]);
+        continue;
+      }
+      fold_erased_.push_back(rating_index::entry_t{prev_amount, entry.user_id});
     }
-    amount_t new_amount = itr->second;
-    auto new_ra_itr = rating_by_amount_.find(new_amount);
-    if (new_ra_itr == std::end(rating_by_amount_)) {
-      std::tie(new_ra_itr, std::ignore) = rating_by_amount_.insert(
-          std::make_pair(new_amount, same_amount_users_t{}));
+    fold_inserted_.push_back(
+        rating_index::entry_t{amounts_[index], entry.user_id});
+  }
+
+  if (rebuild) {
+    // новый индекс строится рядом и заменяет прежний целиком
+    for (size_t index = 0; index < has_amount_.size(); ++index) {
+      if (has_amount_[index]) {
+        fold_inserted_.push_back(
+            rating_index::entry_t{amounts_[index], user_ids_[index]});
+      }
     }
-    new_ra_itr->second.insert(user_id);
+    sort_by_rating(fold_inserted_);
+    rating_index rebuilt;
+    rebuilt.assign_sorted(fold_inserted_.data(), fold_inserted_.size());
+    rating_index_.swap(rebuilt);
+    return;
+  }
+
+  // ключи разных пользователей различны: сначала удаляются все прежние,
+  // затем вставляются новые, каждые по порядку рейтинга
+  sort_by_rating(fold_erased_);
+  sort_by_rating(fold_inserted_);
+  for (const auto& entry : fold_erased_) {
+    auto erased = rating_index_.erase(entry.amount, entry.user_id);
+    assert(erased);
+    (void)erased;
+  }
+  for (const auto& entry : fold_inserted_) {
+    rating_index_.insert(entry.amount, entry.user_id);
+  }
+}
+
+void tr::week_rating::sort_by_rating(
+    std::vector<rating_index::entry_t>& entries) {
+  auto by_rating = [](const rating_index::entry_t& lhs,
+                      const rating_index::entry_t& rhs) {
+    return rating_index::before(lhs.amount, lhs.user_id, rhs.amount,
+                                rhs.user_id);
+  };
+  const size_t n = entries.size();
+  const size_t parts =
+      std::min<size_t>(delivery_config_.workers, n / sort_chunk);
+  if (parts <= 1) {
+    std::sort(entries.begin(), entries.end(), by_rating);
+    return;
+  }
+  // части сортируются пулом, затем сливаются попарно через
+  // fold_scratch_, пока не останется одна
+  worker_pool& pool = workers();
+  auto bound = [&](size_t part) {
+    return std::min(part, parts) * n / parts;
+  };
+  pool.run(parts, [&](size_t part, size_t) {
+    std::sort(entries.begin() + bound(part), entries.begin() + bound(part + 1),
+              by_rating);
+  });
+  fold_scratch_.resize(n);
+  std::vector<rating_index::entry_t>* from = &entries;
+  std::vector<rating_index::entry_t>* to = &fold_scratch_;
+  for (size_t width = 1; width < parts; width *= 2) {
+    pool.run((parts + 2 * width - 1) / (2 * width), [&](size_t m, size_t) {
+      size_t first = bound(2 * m * width);
+      size_t middle = bound(2 * m * width + width);
+      size_t last = bound(2 * m * width + 2 * width);
+      std::merge(from->begin() + first, from->begin() + middle,
+                 from->begin() + middle, from->begin() + last,
+                 to->begin() + first, by_rating);
+    });
+    std::swap(from, to);
+  }
+  if (from != &entries) {
+    entries.swap(fold_scratch_);
   }
 }
 
 /*
  *
  */
-tr::minute_rating::minute_rating(time_t start, time_t finish)
-    : start_ts_(start), finish_ts_(finish) {}
-
-void tr::minute_rating::on_user_deal_won(time_t ts, user_id_t id, amount_t am) {
-  if (ts >= start_ts_ && ts < finish_ts_) {
-    auto itr = user_won_amount_.find(id);
-    if (itr != user_won_amount_.end()) {
-      itr->second += am;
-    } else {
-      user_won_amount_.insert(std::make_pair(id, am));
-    }
+tr::minute_rating::minute_rating(time_t start, time_t finish,
+                                 size_t expected_users)
+    : start_ts_(start), finish_ts_(finish) {
+  position_.reserve(expected_users);
+  entries_.reserve(expected_users);
+}
+
+void tr::minute_rating::on_user_deal_won(time_t ts, user_index_t index,
+                                         user_id_t id, amount_t am) {
+  if (!valid_amount(am)) {
+    throw std::invalid_argument("minute_rating: amount is out of range");
+  }
+  if (ts < start_ts_ || ts >= finish_ts_) {
+    return;
+  }
+  if (index >= position_.size()) {
+    position_.resize(std::max<size_t>(index + 1, position_.size() * 2));
+  }
+  uint32_t& position = position_[index];
+  if (position != 0) {
+    entries_[position - 1].amount += am;
+    return;
+  }
+  entries_.push_back(entry_t{index, id, am});
+  position = static_cast<uint32_t>(entries_.size());
+}
+
+void tr::minute_rating::reset(time_t start, time_t finish) {
+  start_ts_ = start;
+  finish_ts_ = finish;
+  for (const auto& entry : entries_) {
+    position_[entry.index] = 0;
+  }
+  entries_.clear();
+}
+
+void tr::minute_rating::sort_by_index() {
+  std::sort(entries_.begin(), entries_.end(),
+            [](const entry_t& lhs, const entry_t& rhs) {
+    return lhs.index < rhs.index;
+  });
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    position_[entries_[i].index] = static_cast<uint32_t>(i + 1);
   }
 }
 
 time_t tr::minute_rating::start_ts() const { return start_ts_; }
 
 time_t tr::minute_rating::finish_ts() const { return finish_ts_; }
+
+void tr::minute_rating_deleter::operator()(minute_rating* mr) const {
+  if (pool) {
+    pool->release(mr);
+  } else {
+    delete mr;
+  }
+}
+
+/*
+ *
+ */
+std::shared_ptr<tr::minute_rating_pool> tr::minute_rating_pool::create(
+    size_t expected_users, size_t max_free) {
+  return std::shared_ptr<minute_rating_pool>(
+      new minute_rating_pool(expected_users, max_free));
+}
+
+tr::minute_rating_pool::minute_rating_pool(size_t expected_users,
+                                           size_t max_free)
+    : expected_users_(expected_users), max_free_(max_free), allocated_(0) {}
+
+tr::minute_rating_uptr tr::minute_rating_pool::acquire(time_t start,
+                                                       time_t finish) {
+  minute_rating_deleter deleter{shared_from_this()};
+  {
+    lock_guard_t lk(mt_);
+    if (!free_.empty()) {
+      std::unique_ptr<minute_rating> mr = std::move(free_.back());
+      free_.pop_back();
+      // таблица уже очищена в release
+      mr->start_ts_ = start;
+      mr->finish_ts_ = finish;
+      return minute_rating_uptr(mr.release(), deleter);
+    }
+    ++allocated_;
+  }
+  return minute_rating_uptr(new minute_rating(start, finish, expected_users_),
+                            deleter);
+}
+
+void tr::minute_rating_pool::release(minute_rating* mr) {
+  std::unique_ptr<minute_rating> p(mr);
+  // очистка вне mutex, в потоке, освободившем минуту
+  p->reset(0, 0);
+  lock_guard_t lk(mt_);
+  if (free_.size() < max_free_) {
+    free_.push_back(std::move(p));
+  } else {
+    --allocated_;
+  }
+}
+
+size_t tr::minute_rating_pool::allocated() const {
+  lock_guard_t lk(mt_);
+  return allocated_;
+}
+
+size_t tr::minute_rating_pool::free_size() const {
+  lock_guard_t lk(mt_);
+  return free_.size();
+}
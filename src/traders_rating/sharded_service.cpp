@@ -0,0 +1,437 @@
+#include "traders_rating/sharded_service.h"
+#include "traders_rating/utilities.h"
+#include "traders_rating/calendar.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace tr = ::traders_rating;
+
+using unique_lock_t = std::unique_lock<std::mutex>;
+using lock_guard_t = std::lock_guard<std::mutex>;
+
+namespace {
+
+bool entry_before(const tr::rating_index::entry_t& lhs,
+                  const tr::rating_index::entry_t& rhs) {
+  return tr::rating_index::before(lhs.amount, lhs.user_id, rhs.amount,
+                                  rhs.user_id);
+}
+
+}  // namespace
+
+/*
+ *
+ */
+tr::rating_shard::rating_shard(const sharded_service_config_t& config,
+                               time_function_t time_function,
+                               idle_waiter* folded)
+    : config_(config),
+      cmds_(config.cmd_queue_capacity, config.cmd_name_capacity),
+      waiter_(config.wait),
+      finish_thread_(false),
+      time_function_(time_function),
+      timers_(time_function, config.clock_check_interval),
+      folded_until_(0),
+      folded_waiter_(folded),
+      processed_cmds_(0) {}
+
+void tr::rating_shard::start() {
+  finish_thread_ = false;
+  timers_.clear();
+  auto start_ts = timers_.read_clock();
+  this_week_times_ = tr::local_calendar().week_times(start_ts);
+  auto minute_times = tr::local_calendar().minute_times(start_ts);
+  this_minute_rating_ = minute_rating_uptr(new minute_rating(
+      minute_times.first, minute_times.second, config_.minute_expected_users));
+  folded_until_ = minute_times.first;
+  timers_.schedule(minute_times.second, minute_close);
+  th_ = std::thread(&tr::rating_shard::execute, this);
+}
+
+void tr::rating_shard::stop() {
+  finish_thread_ = true;
+  waiter_.notify();
+  th_.join();
+}
+
+void tr::rating_shard::wake() { waiter_.notify(); }
+
+void tr::rating_shard::add_cmd(const cmd_t& cmd) {
+  while (!cmds_.try_push(cmd)) {
+    if (finish_thread_) {
+      return;
+    }
+    tr::yield_thread();
+  }
+  waiter_.notify();
+}
+
+void tr::rating_shard::add_cmd(const cmd_t& cmd, const user_name_t& name) {
+  while (!cmds_.try_push(cmd, name)) {
+    if (finish_thread_) {
+      return;
+    }
+    tr::yield_thread();
+  }
+  waiter_.notify();
+}
+
+void tr::rating_shard::execute() {
+  auto fired = [this](deadline_scheduler::timer_id_t, time_t current_ts) {
+    close_minute(current_ts);
+  };
+  while (!finish_thread_) {
+    auto handled = cmds_.consume([this](cmd_t& cmd) { handle_cmd(cmd); },
+                                 config_.cmd_batch_size);
+    if (handled == 0) {
+      waiter_.idle([this]() { return finish_thread_ || !cmds_.empty(); });
+      timers_.poll_now(fired);
+      continue;
+    }
+    waiter_.reset();
+    processed_cmds_.fetch_add(handled, std::memory_order_relaxed);
+    timers_.poll(fired);
+  }
+}
+
+void tr::rating_shard::close_minute(time_t current_ts) {
+  fold_minute(*this_minute_rating_);
+  // минута свернута в этом же потоке - таблица переиспользуется на месте
+  auto minute_times = tr::local_calendar().minute_times(current_ts);
+  this_minute_rating_->reset(minute_times.first, minute_times.second);
+  folded_until_ = minute_times.first;
+  timers_.schedule(minute_times.second, minute_close);
+  if (folded_waiter_ != nullptr) {
+    folded_waiter_->notify();
+  }
+}
+
+void tr::rating_shard::handle_cmd(const cmd_t& cmd) {
+  switch (cmd.type) {
+    case cmd_type_t::user_registered: {
+      lock_guard_t lk(mt_);
+      users_.register_user(cmd.id, cmds_.name(cmd));
+      break;
+    }
+    case cmd_type_t::user_renamed: {
+      lock_guard_t lk(mt_);
+      user_name_t* name = users_.find_name(cmd.id);
+      if (name != nullptr) {
+        *name = cmds_.name(cmd);
+      }
+      break;
+    }
+    case cmd_type_t::user_connected: {
+      lock_guard_t lk(mt_);
+      users_.connect(cmd.id);
+      break;
+    }
+    case cmd_type_t::user_disconnected: {
+      lock_guard_t lk(mt_);
+      users_.disconnect(cmd.id);
+      break;
+    }
+    case cmd_type_t::user_deal_won: {
+      if (cmd.ts >= timers_.next_deadline()) {
+        // сделка из следующей минуты - часы еще не прочитаны
+        timers_.poll_now([this](deadline_scheduler::timer_id_t, time_t ts) {
+          close_minute(ts);
+        });
+      }
+      user_index_t index = users_.find(cmd.id);
+      if (index == user_directory::npos) {
+        lock_guard_t lk(mt_);
+        index = users_.insert(cmd.id);
+      }
+      this_minute_rating_->on_user_deal_won(cmd.ts, index, cmd.id,
+                                            cmd.amount);
+      break;
+    }
+  }
+}
+
+void tr::rating_shard::fold_minute(const minute_rating& mr) {
+  lock_guard_t lk(index_mt_);
+  if (mr.start_ts() >= this_week_times_.second) {
+    // первая минута новой недели
+    this_week_times_ = tr::local_calendar().week_times(mr.start_ts());
+    std::fill(has_amount_.begin(), has_amount_.end(), 0);
+    rating_index_.clear();
+  }
+  for (const auto& entry : mr) {
+    user_index_t index = entry.index;
+    if (index >= has_amount_.size()) {
+      size_t size = std::max<size_t>(index + 1, has_amount_.size() * 2);
+      amounts_.resize(size);
+      user_ids_.resize(size);
+      has_amount_.resize(size);
+    }
+    if (!has_amount_[index]) {
+      has_amount_[index] = 1;
+      amounts_[index] = entry.amount;
+      user_ids_[index] = entry.user_id;
+      rating_index_.insert(entry.amount, entry.user_id);
+    } else {
+      amount_t prev_amount = amounts_[index];
+      amounts_[index] += entry.amount;
+      rating_index_.update(entry.user_id, prev_amount, amounts_[index]);
+    }
+  }
+}
+
+bool tr::rating_shard::is_user_registered(user_id_t user_id) const {
+  lock_guard_t lk(mt_);
+  return users_.is_registered(user_id);
+}
+
+bool tr::rating_shard::is_user_connected(user_id_t user_id) const {
+  lock_guard_t lk(mt_);
+  return users_.is_connected(user_id);
+}
+
+uint64_t tr::rating_shard::processed_cmds() const { return processed_cmds_; }
+
+time_t tr::rating_shard::folded_until() const { return folded_until_; }
+
+void tr::rating_shard::copy_rating(rating_snapshot& rating) const {
+  lock_guard_t lk(index_mt_);
+  rating.assign(0, folded_until_, rating_index_, amounts_, user_ids_,
+                has_amount_);
+}
+
+void tr::rating_shard::get_connected_users(
+    std::vector<user_index_t>& users) const {
+  users_.connected().append_to(users);
+}
+
+/*
+ *
+ */
+tr::sharded_service::sharded_service(upload_result_callback callback,
+                                     time_function_t time_function,
+                                     const sharded_service_config_t& config)
+    : sharded_service(rating_sink(callback), time_function, config) {}
+
+tr::sharded_service::sharded_service(upload_flat_result_callback callback,
+                                     time_function_t time_function,
+                                     const sharded_service_config_t& config)
+    : sharded_service(rating_sink(callback), time_function, config) {}
+
+tr::sharded_service::sharded_service(upload_batch_callback callback,
+                                     time_function_t time_function,
+                                     const sharded_service_config_t& config)
+    : sharded_service(rating_sink(callback, config.upload_batch_size),
+                      time_function, config) {}
+
+tr::sharded_service::sharded_service(const rating_sink& sink,
+                                     time_function_t time_function,
+                                     const sharded_service_config_t& config)
+    : config_(config),
+      waiter_(config.wait),
+      finish_thread_(false),
+      time_function_(time_function),
+      rating_sink_(sink) {
+  if (config_.shards == 0) {
+    config_.shards = 1;
+  }
+  for (size_t i = 0; i < config_.shards; ++i) {
+    shards_.push_back(
+        rating_shard_uptr(new rating_shard(config_, time_function_, &waiter_)));
+    shard_ratings_.emplace_back(new rating_snapshot());
+  }
+}
+
+size_t tr::sharded_service::shards() const { return shards_.size(); }
+
+tr::rating_shard& tr::sharded_service::shard(user_id_t user_id) const {
+  // перемешивание битов, чтобы последовательные id не попадали в один шард
+  // при числе шардов, кратном шагу id
+  uint64_t h = user_id * 0x9E3779B97F4A7C15ULL;
+  return *shards_[(h >> 32) % shards_.size()];
+}
+
+void tr::sharded_service::start() {
+  finish_thread_ = false;
+  for (auto& s : shards_) {
+    s->start();
+  }
+  th_ = std::thread(&tr::sharded_service::execute, this);
+}
+
+void tr::sharded_service::stop() {
+  finish_thread_ = true;
+  waiter_.notify();
+  th_.join();
+  for (auto& s : shards_) {
+    s->stop();
+  }
+}
+
+void tr::sharded_service::on_user_registered(user_id_t id,
+                                             const user_name_t& name) {
+  shard(id).add_cmd(make_user_registered_cmd(id, 0), name);
+}
+
+void tr::sharded_service::on_user_renamed(user_id_t id,
+                                          const user_name_t& name) {
+  shard(id).add_cmd(make_user_renamed_cmd(id, 0), name);
+}
+
+void tr::sharded_service::on_user_connected(user_id_t id) {
+  shard(id).add_cmd(make_user_connected_cmd(id));
+}
+
+void tr::sharded_service::on_user_disconnected(user_id_t id) {
+  shard(id).add_cmd(make_user_disconnected_cmd(id));
+}
+
+void tr::sharded_service::on_user_deal_won(time_t ts, user_id_t id,
+                                           amount_t amount) {
+  if (!valid_amount(amount)) {
+    throw std::invalid_argument("sharded_service: amount is out of range");
+  }
+  shard(id).add_cmd(make_user_deal_won_cmd(ts, id, amount));
+}
+
+bool tr::sharded_service::is_user_registered(user_id_t user_id) const {
+  return shard(user_id).is_user_registered(user_id);
+}
+
+bool tr::sharded_service::is_user_connected(user_id_t user_id) const {
+  return shard(user_id).is_user_connected(user_id);
+}
+
+uint64_t tr::sharded_service::processed_cmds() const {
+  uint64_t total = 0;
+  for (const auto& s : shards_) {
+    total += s->processed_cmds();
+  }
+  return total;
+}
+
+void tr::sharded_service::execute() {
+  deadline_scheduler timers(time_function_);
+  // через 1 секунду после окончания минуты рейтинг сливается и
+  // отправляется
+  const calendar_table& calendar = local_calendar();
+  time_t minute_finish_ts = calendar.minute_times(timers.now()).second;
+  timers.schedule(minute_finish_ts + 1, 0);
+  auto fired = [&](deadline_scheduler::timer_id_t, time_t current_ts) {
+    wait_folded(minute_finish_ts);
+    send_rating();
+    minute_finish_ts = calendar.minute_times(current_ts).second;
+    timers.schedule(minute_finish_ts + 1, 0);
+  };
+  while (!finish_thread_) {
+    if (timers.poll_now(fired) > 0) {
+      waiter_.reset();
+      continue;
+    }
+    waiter_.idle([this]() { return !!finish_thread_; });
+  }
+}
+
+void tr::sharded_service::wait_folded(time_t ts) {
+  // простаивающий шард сворачивает минуту, только проверив часы; его
+  // будят, а он будит поток публикации после свертки
+  for (const auto& s : shards_) {
+    s->wake();
+  }
+  for (const auto& s : shards_) {
+    while (s->folded_until() < ts && !finish_thread_) {
+      waiter_.idle(
+          [&]() { return finish_thread_ || s->folded_until() >= ts; });
+    }
+  }
+  waiter_.reset();
+}
+
+void tr::sharded_service::send_rating() {
+  auto ts = time_function_(nullptr);
+  // шарды уже свернули минуту; каждый блокируется только на копию своего
+  // рейтинга, сборка и отправка сообщений идут без блокировок
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->copy_rating(*shard_ratings_[i]);
+  }
+
+  // общий топ-10 - слияние топ-10 шардов
+  const size_t top_capacity = flat_rating_result_t::top_capacity;
+  top_.clear();
+  for (const auto& rating : shard_ratings_) {
+    for (size_t i = 0; i < rating->size() && i < top_capacity; ++i) {
+      top_.push_back(rating->at(i));
+    }
+  }
+  std::sort(top_.begin(), top_.end(), entry_before);
+  flat_rating_result_t::top_t top;
+  uint32_t top_size = 0;
+  for (size_t i = 0; i < top_.size() && i < top_capacity; ++i) {
+    top[top_size++] = rating_entry_t{i + 1, top_[i].user_id, top_[i].amount};
+  }
+
+  // индексы пользователей у каждого шарда свои
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    connected_users_.clear();
+    shards_[shard]->get_connected_users(connected_users_);
+    for (auto index : connected_users_) {
+      rating_index::entry_t key;
+      if (!shard_ratings_[shard]->key(index, key)) {
+        continue;
+      }
+      flat_rating_result_t& res = rating_sink_.next();
+      res.ts = ts;
+      res.user_id = key.user_id;
+      res.amount = key.amount;
+      res.rank = 1;
+      for (const auto& rating : shard_ratings_) {
+        res.rank += rating->rank(key.amount, key.user_id);
+      }
+      res.sections = section_all;
+      res.top = top;
+      res.top_size = top_size;
+      merge_neighbours(res);
+      rating_sink_.commit();
+    }
+  }
+  rating_sink_.flush();
+}
+
+void tr::sharded_service::merge_neighbours(flat_rating_result_t& res) {
+  const size_t neighbours = flat_rating_result_t::neighbours_capacity;
+  amount_t amount = res.amount;
+  user_id_t user_id = res.user_id;
+  above_.clear();
+  below_.clear();
+  for (const auto& rating : shard_ratings_) {
+    size_t position = rating->rank(amount, user_id);
+    for (size_t i = position > neighbours ? position - neighbours : 0;
+         i < position; ++i) {
+      above_.push_back(rating->at(i));
+    }
+    size_t last = std::min(position + neighbours + 1, rating->size());
+    for (size_t i = position; i < last; ++i) {
+      if (rating->at(i).user_id != user_id) {
+        below_.push_back(rating->at(i));
+      }
+    }
+  }
+
+  std::sort(above_.begin(), above_.end(), entry_before);
+  size_t first = above_.size() > neighbours ? above_.size() - neighbours : 0;
+  res.above_size = 0;
+  for (size_t i = first; i < above_.size(); ++i) {
+    uint64_t rank = res.rank - (above_.size() - i);
+    res.above[res.above_size++] =
+        rating_entry_t{rank, above_[i].user_id, above_[i].amount};
+  }
+
+  std::sort(below_.begin(), below_.end(), entry_before);
+  res.below_size = 0;
+  for (size_t i = 0; i < below_.size() && i < neighbours; ++i) {
+    res.below[res.below_size++] =
+        rating_entry_t{res.rank + 1 + i, below_[i].user_id,
+                       below_[i].amount};
+  }
+}
@@ -0,0 +1,78 @@
+#include "traders_rating/user_directory.h"
+
+#include <stdexcept>
+
+namespace tr = ::traders_rating;
+
+const tr::user_index_t tr::user_directory::npos;
+
+/*
+ *
+ */
+tr::user_directory::user_directory(size_t expected_users)
+    : index_(expected_users) {
+  ids_.reserve(expected_users);
+  names_.reserve(expected_users);
+  registered_.reserve(expected_users);
+}
+
+tr::user_index_t tr::user_directory::find(user_id_t id) const {
+  auto itr = index_.find(id);
+  return itr != index_.end() ? itr->second : npos;
+}
+
+tr::user_index_t tr::user_directory::insert(user_id_t id) {
+  auto r = index_.insert(std::make_pair(id, user_index_t(ids_.size())));
+  if (!r.second) {
+    return r.first->second;
+  }
+  if (ids_.size() >= npos) {
+    index_.erase(id);
+    throw std::length_error("user directory: too many users");
+  }
+  ids_.push_back(id);
+  names_.emplace_back();
+  registered_.push_back(0);
+  return r.first->second;
+}
+
+tr::user_index_t tr::user_directory::register_user(user_id_t id,
+                                                   const user_name_t& name) {
+  user_index_t index = insert(id);
+  if (!registered_[index]) {
+    registered_[index] = 1;
+    names_[index] = name;
+  }
+  return index;
+}
+
+tr::user_name_t* tr::user_directory::find_name(user_id_t id) {
+  user_index_t index = find(id);
+  return index != npos && registered_[index] ? &names_[index] : nullptr;
+}
+
+bool tr::user_directory::is_registered(user_id_t id) const {
+  user_index_t index = find(id);
+  return index != npos && registered_[index];
+}
+
+bool tr::user_directory::connect(user_id_t id) {
+  user_index_t index = find(id);
+  if (index == npos || !registered_[index]) {
+    return false;
+  }
+  connected_.set(index);
+  return true;
+}
+
+void tr::user_directory::disconnect(user_id_t id) {
+  user_index_t index = find(id);
+  if (index != npos) {
+    connected_.reset(index);
+  }
+}
+
+bool tr::user_directory::is_connected(user_id_t id) const {
+  user_index_t index = find(id);
+  return index != npos && connected_.test(index);
+}
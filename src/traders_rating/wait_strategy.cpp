@@ -0,0 +1,85 @@
+#include "traders_rating/wait_strategy.h"
+#include "traders_rating/utilities.h"
+
+#if defined __linux__
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tr = ::traders_rating;
+
+using unique_lock_t = std::unique_lock<std::mutex>;
+
+namespace {
+
+#if defined __linux__
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected,
+                std::chrono::milliseconds timeout) {
+  timespec ts;
+  ts.tv_sec = timeout.count() / 1000;
+  ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+  // возврат по таймауту, сигналу или EAGAIN (слово уже изменилось) -
+  // вызывающий все равно перепроверяет наличие работы
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+            FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t>& word) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+            1, nullptr, nullptr, 0);
+}
+#endif
+
+}  // namespace
+
+/*
+ *
+ */
+tr::idle_waiter::idle_waiter(const wait_config_t& config)
+    : config_(config),
+      idle_count_(0),
+      wake_seq_(0),
+      sleeping_(false),
+      wakeups_(0) {}
+
+uint64_t tr::idle_waiter::wakeups() const { return wakeups_; }
+
+void tr::idle_waiter::cpu_relax() {
+#if defined __x86_64__ || defined __i386__
+  __builtin_ia32_pause();
+#endif
+}
+
+void tr::idle_waiter::yield() { tr::yield_thread(); }
+
+void tr::idle_waiter::park(uint32_t wake_seq) {
+#if defined __linux__
+  if (config_.strategy == wait_strategy_t::spin_park) {
+    futex_wait(wake_seq_, wake_seq, config_.park_timeout);
+    return;
+  }
+#endif
+  unique_lock_t lk(mt_);
+  cv_.wait_for(lk, config_.park_timeout, [&]() {
+    return wake_seq_.load(std::memory_order_relaxed) != wake_seq;
+  });
+}
+
+void tr::idle_waiter::wake() {
+  wakeups_.fetch_add(1, std::memory_order_relaxed);
+#if defined __linux__
+  if (config_.strategy == wait_strategy_t::spin_park) {
+    wake_seq_.fetch_add(1, std::memory_order_release);
+    futex_wake(wake_seq_);
+    return;
+  }
+#endif
+  {
+    unique_lock_t lk(mt_);
+    wake_seq_.fetch_add(1, std::memory_order_release);
+  }
+  cv_.notify_one();
+}
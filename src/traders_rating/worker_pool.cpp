@@ -0,0 +1,130 @@
+#include "traders_rating/worker_pool.h"
+
+#include <algorithm>
+
+namespace tr = ::traders_rating;
+
+using unique_lock_t = std::unique_lock<std::mutex>;
+using lock_guard_t = std::lock_guard<std::mutex>;
+
+/*
+ *
+ */
+tr::worker_pool::worker_pool(size_t workers)
+    : finish_(false), generation_(0), active_(0), task_(nullptr) {
+  workers = std::max<size_t>(workers, 1);
+  for (size_t i = 0; i < workers; ++i) {
+    queues_.emplace_back(new queue_t);
+  }
+  for (size_t i = 1; i < workers; ++i) {
+    threads_.emplace_back(&worker_pool::execute, this, i);
+  }
+}
+
+tr::worker_pool::~worker_pool() {
+  unique_lock_t lk(mt_);
+  finish_ = true;
+  lk.unlock();
+  start_cv_.notify_all();
+  for (auto& th : threads_) {
+    th.join();
+  }
+}
+
+void tr::worker_pool::run(size_t tasks, const task_t& task) {
+  if (tasks == 0) {
+    return;
+  }
+  const size_t workers = queues_.size();
+  for (size_t i = 0; i < workers; ++i) {
+    lock_guard_t lk(queues_[i]->mt);
+    queues_[i]->begin = tasks * i / workers;
+    queues_[i]->end = tasks * (i + 1) / workers;
+  }
+  unique_lock_t lk(mt_);
+  task_ = &task;
+  error_ = nullptr;
+  active_ = workers;
+  ++generation_;
+  lk.unlock();
+  start_cv_.notify_all();
+
+  work(0);
+
+  lk.lock();
+  done_cv_.wait(lk, [this]() { return active_ == 0; });
+  task_ = nullptr;
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void tr::worker_pool::execute(size_t worker) {
+  uint64_t generation = 0;
+  while (true) {
+    unique_lock_t lk(mt_);
+    start_cv_.wait(lk, [&]() { return finish_ || generation_ != generation; });
+    if (finish_) {
+      return;
+    }
+    generation = generation_;
+    lk.unlock();
+    work(worker);
+  }
+}
+
+void tr::worker_pool::work(size_t worker) {
+  const task_t& task = *task_;
+  size_t i;
+  while (pop(worker, i) || (steal(worker) && pop(worker, i))) {
+    try {
+      task(i, worker);
+    }
+    catch (...) {
+      lock_guard_t lk(mt_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+  lock_guard_t lk(mt_);
+  if (--active_ == 0) {
+    done_cv_.notify_one();
+  }
+}
+
+bool tr::worker_pool::pop(size_t worker, size_t& task) {
+  queue_t& queue = *queues_[worker];
+  lock_guard_t lk(queue.mt);
+  if (queue.begin == queue.end) {
+    return false;
+  }
+  task = queue.begin++;
+  return true;
+}
+
+bool tr::worker_pool::steal(size_t worker) {
+  // задачи только убывают, поэтому пустые очереди у всех - конец run()
+  const size_t workers = queues_.size();
+  for (size_t i = 1; i < workers; ++i) {
+    queue_t& victim = *queues_[(worker + i) % workers];
+    unique_lock_t lk(victim.mt);
+    size_t left = victim.end - victim.begin;
+    if (left == 0) {
+      continue;
+    }
+    size_t n = (left + 1) / 2;
+    size_t begin = victim.end - n;
+    victim.end = begin;
+    lk.unlock();
+
+    queue_t& own = *queues_[worker];
+    lock_guard_t own_lk(own.mt);
+    own.begin = begin;
+    own.end = begin + n;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/calendar.h"
+#include "traders_rating/utilities.h"
+
+#include <cstdlib>
+#include <string>
+
+#include <time.h>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+// часовой пояс на время теста
+struct scoped_tz_t {
+  explicit scoped_tz_t(const char* tz) {
+    const char* prev = getenv("TZ");
+    had_prev = prev != nullptr;
+    if (had_prev) {
+      prev_tz = prev;
+    }
+    setenv("TZ", tz, 1);
+    tzset();
+  }
+  ~scoped_tz_t() {
+    if (had_prev) {
+      setenv("TZ", prev_tz.c_str(), 1);
+    } else {
+      unsetenv("TZ");
+    }
+    tzset();
+  }
+  bool had_prev;
+  std::string prev_tz;
+};
+
+tm local_tm(time_t ts) {
+  tm local;
+  localtime_r(&ts, &local);
+  return local;
+}
+
+void check_week(time_t ts, const std::pair<time_t, time_t>& week) {
+  ASSERT_LE(week.first, ts);
+  ASSERT_LT(ts, week.second);
+  for (time_t boundary : {week.first, week.second}) {
+    tm local = local_tm(boundary);
+    ASSERT_EQ(local.tm_wday, 1);
+    ASSERT_EQ(local.tm_hour, 0);
+    ASSERT_EQ(local.tm_min, 0);
+    ASSERT_EQ(local.tm_sec, 0);
+  }
+}
+
+}  // namespace
+
+TEST(CalendarTableTest, SameAsUtilities) {
+  try {
+    tr::calendar_table calendar;
+    std::srand(1);
+    time_t now = time(nullptr);
+    for (int i = 0; i < 100000; ++i) {
+      time_t ts = now - 30 * 24 * 3600 + std::rand() % (60 * 24 * 3600);
+      ASSERT_EQ(calendar.minute_times(ts), tr::get_minute_times(ts));
+      // get_week_times отсчитывает неделю от местного времени ts и
+      // совпадает с таблицей, если с понедельника не менялось смещение
+      auto week = calendar.week_times(ts);
+      if (local_tm(ts).tm_gmtoff == local_tm(week.first).tm_gmtoff) {
+        ASSERT_EQ(week, tr::get_week_times(ts));
+      }
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(CalendarTableTest, DaylightSaving) {
+  try {
+    scoped_tz_t tz("Europe/Berlin");
+    tr::calendar_table calendar;
+    // 2026-03-29 01:00 UTC - переход на летнее время,
+    // 2026-10-25 01:00 UTC - на зимнее
+    for (time_t transition : {1774746000, 1792890000}) {
+      for (time_t ts = transition - 8 * 24 * 3600;
+           ts < transition + 8 * 24 * 3600; ts += 599) {
+        check_week(ts, calendar.week_times(ts));
+        auto minute = calendar.minute_times(ts);
+        ASSERT_EQ(minute, tr::get_minute_times(ts));
+        ASSERT_EQ(local_tm(minute.first).tm_sec, 0);
+      }
+      // неделя с переходом короче или длиннее на час
+      auto week = calendar.week_times(transition);
+      ASSERT_EQ(std::abs((week.second - week.first) - 7 * 24 * 3600), 3600);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(CalendarTableTest, Refresh) {
+  try {
+    tr::calendar_table calendar;
+    time_t now = time(nullptr);
+    // за пределами таблицы она перестраивается
+    for (time_t ts : {now - 10 * 365 * 24 * 3600, now,
+                      now + 5 * 365 * 24 * 3600, now}) {
+      check_week(ts, calendar.week_times(ts));
+      ASSERT_EQ(calendar.minute_times(ts), tr::get_minute_times(ts));
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
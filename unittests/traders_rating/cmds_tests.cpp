@@ -1,127 +1,97 @@
 #include "gtest/gtest.h"
 
 #include "traders_rating/cmds.h"
-#include "traders_rating/service.h"
+#include "traders_rating/cmd_queue.h"
+
+#include <vector>
 
 namespace tr = ::traders_rating;
 
-struct UserRegisteredTest : public ::testing::Test {
-  UserRegisteredTest() {
-    using namespace std::placeholders;
-    test_callback_ =
-        std::bind(&UserRegisteredTest::test_callback, this, _1, _2);
+TEST(CmdTest, Size) {
+  try {
+    ASSERT_LE(sizeof(tr::cmd_t), 32);
   }
-
-  void test_callback(tr::user_id_t id, const tr::user_name_t& name) {
-    called++;
-    user_id = id;
-    user_name = name;
+  catch (std::exception& e) {
+    FAIL() << e.what();
   }
+}
 
-  tr::user_registered_callback test_callback_;
-  tr::user_id_t user_id = 0;
-  tr::user_name_t user_name = "";
-  unsigned called = 0;
-};
-
-TEST_F(UserRegisteredTest, Constuctor) {
+TEST(UserRegisteredTest, Make) {
   try {
-    tr::user_registered cmd(1, "test", test_callback_);
-    SUCCEED();
+    auto cmd = tr::make_user_registered_cmd(10, 5);
+    ASSERT_TRUE(cmd.type == tr::cmd_type_t::user_registered);
+    ASSERT_EQ(cmd.id, 10);
+    ASSERT_EQ(cmd.name_slot, 5);
   }
   catch (std::exception& e) {
     FAIL() << e.what();
   }
 }
 
-TEST_F(UserRegisteredTest, Callback) {
+TEST(UserRenameTest, Make) {
   try {
-    tr::cmd_uptr cmd(new tr::user_registered(10, "test11", test_callback_));
-    cmd->handle();
-    ASSERT_EQ(called, 1);
-    ASSERT_EQ(user_id, 10);
-    ASSERT_STREQ(user_name.c_str(), "test11");
+    auto cmd = tr::make_user_renamed_cmd(20, 7);
+    ASSERT_TRUE(cmd.type == tr::cmd_type_t::user_renamed);
+    ASSERT_EQ(cmd.id, 20);
+    ASSERT_EQ(cmd.name_slot, 7);
   }
   catch (std::exception& e) {
     FAIL() << e.what();
   }
 }
 
-TEST(UserRenameTest, Callback) {
+TEST(UserConnectedTest, Make) {
   try {
-    tr::user_id_t test_id = 0;
-    tr::user_name_t test_name = "";
-    unsigned called = 0;
-
-    tr::cmd_uptr cmd(new tr::user_renamed(
-        20, "test12", [&](tr::user_id_t id, const tr::user_name_t& name) {
-          test_id = id;
-          test_name = name;
-          ++called;
-        }));
-    cmd->handle();
-    ASSERT_EQ(called, 1);
-    ASSERT_EQ(test_id, 20);
-    ASSERT_STREQ(test_name.c_str(), "test12");
+    auto cmd = tr::make_user_connected_cmd(20);
+    ASSERT_TRUE(cmd.type == tr::cmd_type_t::user_connected);
+    ASSERT_EQ(cmd.id, 20);
   }
   catch (std::exception& e) {
     FAIL() << e.what();
   }
 }
 
-TEST(UserConnectedTest, Callback) {
+TEST(UserDisconnectedTest, Make) {
   try {
-    tr::user_id_t test_id = 0;
-    unsigned called = 0;
-
-    tr::cmd_uptr cmd(new tr::user_connected(20, [&](tr::user_id_t id) {
-      test_id = id;
-      ++called;
-    }));
-    cmd->handle();
-    ASSERT_EQ(called, 1);
-    ASSERT_EQ(test_id, 20);
+    auto cmd = tr::make_user_disconnected_cmd(20);
+    ASSERT_TRUE(cmd.type == tr::cmd_type_t::user_disconnected);
+    ASSERT_EQ(cmd.id, 20);
   }
   catch (std::exception& e) {
     FAIL() << e.what();
   }
 }
 
-TEST(UserDisconnectedTest, Callback) {
+TEST(UserDealWonTest, Make) {
   try {
-    tr::user_id_t test_id = 0;
-    unsigned called = 0;
-
-    tr::cmd_uptr cmd(new tr::user_disconnected(20, [&](tr::user_id_t id) {
-      test_id = id;
-      ++called;
-    }));
-    cmd->handle();
-    ASSERT_EQ(called, 1);
-    ASSERT_EQ(test_id, 20);
+    time_t test_ts = time(nullptr);
+    auto cmd = tr::make_user_deal_won_cmd(test_ts, 20, 25.1);
+    ASSERT_TRUE(cmd.type == tr::cmd_type_t::user_deal_won);
+    ASSERT_EQ(cmd.ts, test_ts);
+    ASSERT_EQ(cmd.id, 20);
+    ASSERT_EQ(cmd.amount, 25.1);
   }
   catch (std::exception& e) {
     FAIL() << e.what();
   }
 }
 
-TEST(UserDealWonTest, Callback) {
+TEST(CmdQueueTest, Names) {
   try {
-    time_t test_ts = time(nullptr);
-    tr::user_id_t test_id = 0;
-    tr::amount_t test_amount = 0.;
-    unsigned called = 0;
+    tr::cmd_queue queue(4, 16);
+    ASSERT_TRUE(queue.try_push(tr::make_user_registered_cmd(1, 0), "first"));
+    ASSERT_TRUE(queue.try_push(tr::make_user_deal_won_cmd(0, 1, 2.)));
+    ASSERT_TRUE(queue.try_push(tr::make_user_renamed_cmd(1, 0), "second"));
 
-    tr::cmd_uptr cmd(new tr::user_deal_won(
-        test_ts, 20, 25.1, [&](time_t, tr::user_id_t id, tr::amount_t amount) {
-          test_id = id;
-          test_amount = amount;
-          ++called;
-        }));
-    cmd->handle();
-    ASSERT_EQ(called, 1);
-    ASSERT_EQ(test_id, 20);
-    ASSERT_EQ(test_amount, 25.1);
+    std::vector<tr::user_name_t> names;
+    auto consumed = queue.consume([&](tr::cmd_t& cmd) {
+      if (cmd.type != tr::cmd_type_t::user_deal_won) {
+        names.push_back(queue.name(cmd));
+      }
+    }, 10);
+    ASSERT_EQ(consumed, 3);
+    ASSERT_TRUE(names == (std::vector<tr::user_name_t>{"first", "second"}));
+    ASSERT_TRUE(queue.empty());
   }
   catch (std::exception& e) {
     FAIL() << e.what();
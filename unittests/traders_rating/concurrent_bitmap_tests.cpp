@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/concurrent_bitmap.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(ConcurrentBitmapTest, SetReset) {
+  try {
+    tr::concurrent_bitmap bitmap;
+    ASSERT_FALSE(bitmap.test(5));
+    ASSERT_FALSE(bitmap.reset(5));
+    ASSERT_TRUE(bitmap.set(5));
+    ASSERT_FALSE(bitmap.set(5));
+    // второй и далекий сегменты
+    ASSERT_TRUE(bitmap.set((1u << 20) + 3));
+    ASSERT_TRUE(bitmap.set(~0u));
+    ASSERT_TRUE(bitmap.set(64));
+    ASSERT_EQ(bitmap.count(), 4);
+    ASSERT_TRUE(bitmap.test(~0u));
+    std::vector<tr::concurrent_bitmap::index_t> indices;
+    bitmap.append_to(indices);
+    ASSERT_EQ(indices, (std::vector<tr::concurrent_bitmap::index_t>{
+                           5, 64, (1u << 20) + 3, ~0u}));
+    ASSERT_TRUE(bitmap.reset(64));
+    ASSERT_TRUE(bitmap.reset(5));
+    indices.clear();
+    bitmap.append_to(indices);
+    ASSERT_EQ(indices.size(), 2);
+    ASSERT_EQ(indices[0], (1u << 20) + 3);
+    ASSERT_EQ(bitmap.count(), 2);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ConcurrentBitmapTest, SnapshotWhileWriting) {
+  try {
+    // четные индексы установлены все время, нечетные переключаются
+    // писателем; снимок обязан содержать все четные
+    const tr::concurrent_bitmap::index_t size = 1 << 16;
+    tr::concurrent_bitmap bitmap;
+    for (tr::concurrent_bitmap::index_t i = 0; i < size; i += 2) {
+      bitmap.set(i);
+    }
+    std::atomic_bool finish(false);
+    std::thread writer([&]() {
+      for (uint32_t round = 0; !finish; ++round) {
+        for (tr::concurrent_bitmap::index_t i = 1; i < size; i += 2) {
+          round % 2 == 0 ? bitmap.set(i) : bitmap.reset(i);
+        }
+      }
+    });
+    std::vector<tr::concurrent_bitmap::index_t> indices;
+    for (int snapshot = 0; snapshot < 200; ++snapshot) {
+      indices.clear();
+      bitmap.append_to(indices);
+      size_t even = 0;
+      for (size_t i = 0; i < indices.size(); ++i) {
+        ASSERT_LT(indices[i], size);
+        ASSERT_TRUE(i == 0 || indices[i - 1] < indices[i]);
+        even += indices[i] % 2 == 0 ? 1 : 0;
+      }
+      ASSERT_EQ(even, size / 2);
+    }
+    finish = true;
+    writer.join();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
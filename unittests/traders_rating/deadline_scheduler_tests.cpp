@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/deadline_scheduler.h"
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+struct test_clock_t {
+  test_clock_t()
+      : now(1000),
+        reads(0),
+        function([this](time_t*) {
+          ++reads;
+          return now;
+        }) {}
+  time_t now;
+  size_t reads;
+  tr::time_function_t function;
+};
+
+using fired_t =
+    std::vector<std::pair<tr::deadline_scheduler::timer_id_t, time_t>>;
+
+}  // namespace
+
+TEST(DeadlineSchedulerTest, Order) {
+  try {
+    test_clock_t clock;
+    tr::deadline_scheduler timers(clock.function);
+    ASSERT_TRUE(timers.empty());
+    ASSERT_EQ(timers.next_deadline(), std::numeric_limits<time_t>::max());
+    timers.schedule(1060, 1);
+    timers.schedule(1060, 0);
+    timers.schedule(1030, 2);
+    ASSERT_EQ(timers.next_deadline(), 1030);
+
+    fired_t fired;
+    auto f = [&](tr::deadline_scheduler::timer_id_t id, time_t now) {
+      fired.push_back(std::make_pair(id, now));
+    };
+    ASSERT_EQ(timers.poll_now(f), 0);
+    clock.now = 1060;
+    ASSERT_EQ(timers.poll_now(f), 3);
+    // по сроку, при равных сроках - по идентификатору
+    ASSERT_EQ(fired.size(), 3);
+    ASSERT_EQ(fired[0].first, 2);
+    ASSERT_EQ(fired[1].first, 0);
+    ASSERT_EQ(fired[2].first, 1);
+    ASSERT_EQ(fired[2].second, 1060);
+    ASSERT_TRUE(timers.empty());
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(DeadlineSchedulerTest, CheckInterval) {
+  try {
+    test_clock_t clock;
+    tr::deadline_scheduler timers(clock.function, 4);
+    timers.schedule(1001, 0);
+    clock.now = 1001;
+    clock.reads = 0;
+    size_t fired = 0;
+    auto f = [&](tr::deadline_scheduler::timer_id_t, time_t) { ++fired; };
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_EQ(timers.poll(f), 0);
+    }
+    ASSERT_EQ(clock.reads, 0);
+    ASSERT_EQ(timers.poll(f), 1);
+    ASSERT_EQ(clock.reads, 1);
+    ASSERT_EQ(timers.now(), 1001);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(DeadlineSchedulerTest, Reschedule) {
+  try {
+    test_clock_t clock;
+    tr::deadline_scheduler timers(clock.function);
+    timers.schedule(1060, 0);
+    std::vector<time_t> fired;
+    auto f = [&](tr::deadline_scheduler::timer_id_t id, time_t now) {
+      fired.push_back(now);
+      timers.schedule(now + 60, id);
+    };
+    clock.now = 1075;
+    ASSERT_EQ(timers.poll_now(f), 1);
+    ASSERT_EQ(timers.next_deadline(), 1135);
+    timers.clear();
+    ASSERT_TRUE(timers.empty());
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
@@ -0,0 +1,90 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/double_buffer.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(DoubleBufferTest, PublishRead) {
+  try {
+    tr::double_buffer<std::vector<int>> buffer;
+    buffer.read([](const std::vector<int>& v) { ASSERT_TRUE(v.empty()); });
+    buffer.back().assign(3, 1);
+    // до публикации читатели видят прежний экземпляр
+    buffer.read([](const std::vector<int>& v) { ASSERT_TRUE(v.empty()); });
+    buffer.publish();
+    buffer.read([](const std::vector<int>& v) {
+      ASSERT_EQ(v, (std::vector<int>{1, 1, 1}));
+    });
+    ASSERT_EQ(buffer.front().size(), 3);
+    ASSERT_TRUE(buffer.back().empty());
+    buffer.back().assign(2, 2);
+    buffer.publish();
+    buffer.read([](const std::vector<int>& v) {
+      ASSERT_EQ(v, (std::vector<int>{2, 2}));
+    });
+    ASSERT_EQ(buffer.back().size(), 3);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(DoubleBufferTest, ReadWhilePublishing) {
+  try {
+    // писатель заполняет экземпляр номером публикации целиком; читатель
+    // не должен увидеть частично заполненный экземпляр или вернуться к
+    // старой публикации
+    const size_t size = 1 << 12;
+    const uint64_t publications = 2000;
+    tr::double_buffer<std::vector<uint64_t>> buffer;
+    buffer.back().assign(size, 0);
+    buffer.publish();
+    buffer.back().assign(size, 0);
+    std::atomic_bool finish(false);
+    std::atomic<uint64_t> torn(0);
+    std::atomic<uint64_t> reads(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+      readers.emplace_back([&]() {
+        uint64_t last = 0;
+        while (!finish) {
+          buffer.read([&](const std::vector<uint64_t>& v) {
+            uint64_t version = v[0];
+            for (uint64_t value : v) {
+              if (value != version) {
+                ++torn;
+                break;
+              }
+            }
+            if (version < last) {
+              ++torn;
+            }
+            last = version;
+          });
+          ++reads;
+        }
+      });
+    }
+    for (uint64_t version = 1; version <= publications; ++version) {
+      std::vector<uint64_t>& back = buffer.back();
+      for (uint64_t& value : back) {
+        value = version;
+      }
+      buffer.publish();
+    }
+    finish = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    ASSERT_EQ(torn, 0);
+    ASSERT_GT(reads, 0);
+    ASSERT_EQ(buffer.front()[size - 1], publications);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
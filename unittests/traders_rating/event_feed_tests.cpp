@@ -0,0 +1,237 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/event_feed.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+struct test_events {
+  test_events()
+      : callback(std::bind(&test_events::add, this, std::placeholders::_1,
+                           std::placeholders::_2)) {}
+  void add(const tr::event_record_t* const* events, size_t count) {
+    ++batches;
+    for (size_t i = 0; i < count; ++i) {
+      cmds.push_back(tr::to_cmd(*events[i]));
+      names.push_back(std::string(tr::event_name(*events[i]),
+                                  events[i]->name_size));
+    }
+  }
+  size_t batches = 0;
+  std::vector<tr::cmd_t> cmds;
+  std::vector<std::string> names;
+  tr::event_batch_callback callback;
+};
+
+std::vector<char> make_feed() {
+  std::vector<char> feed;
+  tr::append_event_feed_magic(feed);
+  tr::append_event(feed, tr::event_type_t::user_registered, 0, 100, 0,
+                   "user #100");
+  tr::append_event(feed, tr::event_type_t::user_renamed, 0, 100, 0,
+                   "пользователь #100");
+  tr::append_event(feed, tr::event_type_t::user_connected, 0, 100);
+  tr::append_event(feed, tr::event_type_t::user_deal_won, 1000, 100, 10.5);
+  tr::append_event(feed, tr::event_type_t::user_disconnected, 0, 100);
+  return feed;
+}
+
+void check_events(const test_events& events) {
+  ASSERT_EQ(events.cmds.size(), 5);
+  ASSERT_TRUE(events.cmds[0].type == tr::cmd_type_t::user_registered);
+  ASSERT_EQ(events.names[0], "user #100");
+  ASSERT_TRUE(events.cmds[1].type == tr::cmd_type_t::user_renamed);
+  ASSERT_EQ(events.names[1], "пользователь #100");
+  ASSERT_TRUE(events.cmds[2].type == tr::cmd_type_t::user_connected);
+  ASSERT_TRUE(events.cmds[3].type == tr::cmd_type_t::user_deal_won);
+  ASSERT_EQ(events.cmds[3].ts, 1000);
+  ASSERT_EQ(events.cmds[3].amount, 10.5);
+  ASSERT_TRUE(events.cmds[4].type == tr::cmd_type_t::user_disconnected);
+  for (auto& cmd : events.cmds) {
+    ASSERT_EQ(cmd.id, 100);
+  }
+}
+
+uint64_t read_pipe(const std::vector<char>& feed, size_t chunk,
+                   test_events& events) {
+  int fds[2];
+  if (::pipe(fds) != 0) {
+    throw std::runtime_error("pipe");
+  }
+  std::thread writer([&feed, chunk, fds]() {
+    for (size_t offset = 0; offset < feed.size(); offset += chunk) {
+      auto size = std::min(chunk, feed.size() - offset);
+      if (::write(fds[1], feed.data() + offset, size) < 0) {
+        break;
+      }
+    }
+    ::close(fds[1]);
+  });
+  uint64_t count = 0;
+  try {
+    tr::stream_feed_reader reader(fds[0], 0, 2);
+    count = reader.read(events.callback);
+  }
+  catch (...) {
+    writer.join();
+    ::close(fds[0]);
+    throw;
+  }
+  writer.join();
+  ::close(fds[0]);
+  return count;
+}
+
+}  // namespace
+
+TEST(EventFeedTest, RecordSize) {
+  try {
+    std::vector<char> feed;
+    tr::append_event(feed, tr::event_type_t::user_connected, 0, 1);
+    ASSERT_EQ(feed.size(), 32);
+    tr::append_event(feed, tr::event_type_t::user_registered, 0, 1, 0, "a");
+    ASSERT_EQ(feed.size(), 32 + 40);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(EventFeedTest, Parse) {
+  try {
+    auto feed = make_feed();
+    test_events events;
+    uint64_t count = 0;
+    auto size = feed.size() - tr::event_feed_magic_size;
+    auto parsed = tr::parse_events(feed.data() + tr::event_feed_magic_size,
+                                   size, 2, events.callback, count);
+    ASSERT_EQ(parsed, size);
+    ASSERT_EQ(count, 5);
+    ASSERT_EQ(events.batches, 3);
+    check_events(events);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(EventFeedTest, ParsePartial) {
+  try {
+    auto feed = make_feed();
+    test_events events;
+    uint64_t count = 0;
+    // последняя запись обрезана - разбираются только целые
+    auto size = feed.size() - tr::event_feed_magic_size - 8;
+    auto parsed = tr::parse_events(feed.data() + tr::event_feed_magic_size,
+                                   size, 256, events.callback, count);
+    ASSERT_EQ(parsed, size - 24);
+    ASSERT_EQ(count, 4);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(EventFeedTest, UnknownType) {
+  std::vector<char> feed;
+  tr::append_event(feed, tr::event_type_t::user_connected, 0, 1);
+  feed[0] = 42;
+  test_events events;
+  uint64_t count = 0;
+  ASSERT_THROW(tr::parse_events(feed.data(), feed.size(), 256,
+                                events.callback, count),
+               std::runtime_error);
+}
+
+TEST(EventFeedTest, BadAmount) {
+  // NaN, бесконечность и суммы вне диапазона amount_t не принимаются
+  for (double amount : {std::nan(""), std::numeric_limits<double>::infinity(),
+                        1e300}) {
+    std::vector<char> feed;
+    tr::append_event(feed, tr::event_type_t::user_deal_won, 0, 1, 1.);
+    std::memcpy(&feed[offsetof(tr::event_record_t, amount)], &amount,
+                sizeof(amount));
+    test_events events;
+    uint64_t count = 0;
+    ASSERT_THROW(tr::parse_events(feed.data(), feed.size(), 256,
+                                  events.callback, count),
+                 std::runtime_error);
+    ASSERT_EQ(count, 0);
+  }
+}
+
+TEST(EventFeedTest, BadTimestamp) {
+  // поврежденная метка времени не уводит часы воспроизведения в
+  // далекое будущее
+  for (time_t ts : {time_t(-1), time_t(1000000000000)}) {
+    std::vector<char> feed;
+    tr::append_event(feed, tr::event_type_t::user_connected, ts, 1);
+    test_events events;
+    uint64_t count = 0;
+    ASSERT_THROW(tr::parse_events(feed.data(), feed.size(), 256,
+                                  events.callback, count),
+                 std::runtime_error);
+  }
+}
+
+TEST(EventFeedTest, Stream) {
+  try {
+    auto feed = make_feed();
+    for (size_t chunk : {1, 7, 32, 4096}) {
+      test_events events;
+      ASSERT_EQ(read_pipe(feed, chunk, events), 5);
+      check_events(events);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(EventFeedTest, StreamErrors) {
+  auto feed = make_feed();
+  test_events events;
+  feed.pop_back();
+  ASSERT_THROW(read_pipe(feed, 4096, events), std::runtime_error);
+  feed = make_feed();
+  feed[0] = 'X';
+  ASSERT_THROW(read_pipe(feed, 4096, events), std::runtime_error);
+}
+
+TEST(EventFeedTest, Mmap) {
+  char path[] = "/tmp/event_feed_testXXXXXX";
+  int fd = ::mkstemp(path);
+  ASSERT_GE(fd, 0);
+  try {
+    auto feed = make_feed();
+    ASSERT_EQ(::write(fd, feed.data(), feed.size()),
+              static_cast<ssize_t>(feed.size()));
+    test_events events;
+    tr::mmap_feed_reader reader(path, 2);
+    ASSERT_EQ(reader.read(events.callback), 5);
+    check_events(events);
+
+    ASSERT_EQ(::ftruncate(fd, feed.size() - 1), 0);
+    tr::mmap_feed_reader truncated(path);
+    ASSERT_THROW(truncated.read(events.callback), std::runtime_error);
+  }
+  catch (std::exception& e) {
+    ADD_FAILURE() << e.what();
+  }
+  ::close(fd);
+  ::unlink(path);
+  ASSERT_THROW(tr::mmap_feed_reader reader(path), std::system_error);
+}
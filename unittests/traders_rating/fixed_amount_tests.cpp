@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/fixed_amount.h"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace tr = ::traders_rating;
+
+using amount_t = tr::fixed_amount<10000>;
+
+TEST(FixedAmountTest, Rounding) {
+  try {
+    ASSERT_EQ(amount_t(5.2).units(), 52000);
+    ASSERT_EQ(amount_t(0.00004).units(), 0);
+    ASSERT_EQ(amount_t(0.00005).units(), 1);
+    ASSERT_EQ(amount_t(-1.5).units(), -15000);
+    ASSERT_EQ(amount_t(5.2).to_double(), 5.2);
+    ASSERT_EQ(static_cast<double>(amount_t(600.5)), 600.5);
+    ASSERT_EQ(amount_t::from_units(7), amount_t(0.0007));
+    std::ostringstream os;
+    os << amount_t(2.25);
+    ASSERT_EQ(os.str(), "2.25");
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FixedAmountTest, Representable) {
+  try {
+    ASSERT_TRUE(amount_t::representable(0.));
+    ASSERT_TRUE(amount_t::representable(-1e14));
+    ASSERT_TRUE(amount_t::representable(9.2e14));
+    ASSERT_FALSE(amount_t::representable(9.3e14));
+    ASSERT_FALSE(amount_t::representable(-9.3e14));
+    ASSERT_FALSE(amount_t::representable(std::nan("")));
+    ASSERT_FALSE(
+        amount_t::representable(std::numeric_limits<double>::infinity()));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FixedAmountTest, OutOfRange) {
+  try {
+    ASSERT_THROW(amount_t(9.3e14), std::out_of_range);
+    ASSERT_THROW(amount_t(std::nan("")), std::out_of_range);
+    ASSERT_THROW(amount_t(-std::numeric_limits<double>::infinity()),
+                 std::out_of_range);
+    // сложение и вычитание насыщаются на границах диапазона
+    const auto max = std::numeric_limits<amount_t::units_t>::max();
+    const auto min = std::numeric_limits<amount_t::units_t>::min();
+    amount_t sum = amount_t::from_units(max - 1);
+    sum += amount_t::from_units(5);
+    ASSERT_EQ(sum.units(), max);
+    sum -= amount_t::from_units(1);
+    ASSERT_EQ(sum.units(), max - 1);
+    sum = amount_t::from_units(min + 1) - amount_t::from_units(5);
+    ASSERT_EQ(sum.units(), min);
+    sum += amount_t::from_units(-1);
+    ASSERT_EQ(sum.units(), min);
+    ASSERT_EQ((amount_t::from_units(min) - amount_t::from_units(-1)).units(),
+              min + 1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FixedAmountTest, ExactSums) {
+  try {
+    // в double 0.1 + 0.2 != 0.3
+    amount_t sum = 0.1;
+    sum += 0.2;
+    ASSERT_EQ(sum, 0.3);
+    ASSERT_EQ(amount_t(0.1) + 0.2, amount_t(0.3));
+    amount_t a = 0., b = 0.;
+    for (int i = 0; i < 1000; ++i) {
+      a += 0.01;
+    }
+    for (int i = 0; i < 10; ++i) {
+      b += 1.;
+    }
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(tr::amount_bits(a), tr::amount_bits(b));
+    ASSERT_EQ(b - 0.5, amount_t(9.5));
+    ASSERT_TRUE(amount_t(0.3) > 0.2);
+    ASSERT_TRUE(amount_t(0.2) <= 0.2);
+    ASSERT_FALSE(amount_t(0.2) != 0.2);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/flat_hash_map.h"
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(FlatHashMapTest, InsertFind) {
+  try {
+    tr::flat_hash_map<double> map;
+    ASSERT_TRUE(map.empty());
+    ASSERT_TRUE(map.find(1) == map.end());
+    ASSERT_TRUE(map.insert(std::make_pair(1, 10.)).second);
+    ASSERT_FALSE(map.insert(std::make_pair(1, 20.)).second);
+    map[2] += 5.;
+    map[2] += 5.;
+    ASSERT_EQ(map.size(), 2);
+    ASSERT_EQ(map.find(1)->second, 10.);
+    ASSERT_EQ(map.find(2)->second, 10.);
+    ASSERT_EQ(map.count(3), 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FlatHashMapTest, EmptyKey) {
+  try {
+    const uint64_t key = tr::flat_hash_map<int>::empty_key;
+    tr::flat_hash_map<int> map;
+    ASSERT_TRUE(map.find(key) == map.end());
+    map[key] = 7;
+    map[0] = 1;
+    ASSERT_EQ(map.size(), 2);
+    ASSERT_EQ(map.find(key)->second, 7);
+    std::map<uint64_t, int> items(map.begin(), map.end());
+    ASSERT_EQ(items.size(), 2);
+    ASSERT_EQ(items[key], 7);
+    ASSERT_EQ(items[0], 1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FlatHashMapTest, GrowAndIterate) {
+  try {
+    tr::flat_hash_map<uint64_t> map;
+    const uint64_t n = 10000;
+    for (uint64_t key = 0; key < n; ++key) {
+      map[key * 7] = key;
+    }
+    ASSERT_EQ(map.size(), n);
+    ASSERT_GE(map.capacity() * 3 / 4, n);
+    for (uint64_t key = 0; key < n; ++key) {
+      ASSERT_EQ(map.find(key * 7)->second, key);
+      ASSERT_TRUE(map.find(key * 7 + 1) == map.end());
+    }
+    uint64_t sum = 0, count = 0;
+    for (const auto& item : map) {
+      ASSERT_EQ(item.first, item.second * 7);
+      sum += item.second;
+      ++count;
+    }
+    ASSERT_EQ(count, n);
+    ASSERT_EQ(sum, n * (n - 1) / 2);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FlatHashMapTest, ReserveAndClearKeepCapacity) {
+  try {
+    tr::flat_hash_map<int> map(1000);
+    auto capacity = map.capacity();
+    ASSERT_GE(capacity * 3 / 4, 1000);
+    for (int i = 0; i < 1000; ++i) {
+      map[i] = i;
+    }
+    ASSERT_EQ(map.capacity(), capacity);
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQ(map.capacity(), capacity);
+    ASSERT_TRUE(map.find(5) == map.end());
+    ASSERT_TRUE(map.begin() == map.end());
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FlatHashMapTest, EraseMatchesUnorderedMap) {
+  try {
+    // маленький диапазон ключей - длинные цепочки и много переносов
+    // при обратном сдвиге
+    std::srand(1);
+    tr::flat_hash_map<int> map;
+    std::unordered_map<uint64_t, int> expected;
+    for (int i = 0; i < 100000; ++i) {
+      uint64_t key = std::rand() % 500;
+      if (std::rand() % 3 == 0) {
+        ASSERT_EQ(map.erase(key), expected.erase(key));
+      } else {
+        map[key] += i;
+        expected[key] += i;
+      }
+      ASSERT_EQ(map.size(), expected.size());
+    }
+    for (const auto& item : expected) {
+      auto itr = map.find(item.first);
+      ASSERT_TRUE(itr != map.end());
+      ASSERT_EQ(itr->second, item.second);
+    }
+    size_t count = 0;
+    for (const auto& item : map) {
+      ASSERT_EQ(expected.count(item.first), 1);
+      ++count;
+    }
+    ASSERT_EQ(count, expected.size());
+    ASSERT_EQ(map.erase(tr::flat_hash_map<int>::empty_key), 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FlatHashMapTest, StringValues) {
+  try {
+    tr::flat_hash_map<std::string> names;
+    for (uint64_t id = 0; id < 1000; ++id) {
+      names.insert(std::make_pair(id, "user " + std::to_string(id)));
+    }
+    names.find(10)->second = "renamed";
+    ASSERT_EQ(names.erase(500), 1);
+    ASSERT_EQ(names.size(), 999);
+    ASSERT_EQ(names.find(10)->second, "renamed");
+    ASSERT_EQ(names.find(999)->second, "user 999");
+    ASSERT_EQ(names.count(500), 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(FlatHashSetTest, InsertEraseIterate) {
+  try {
+    tr::flat_hash_set set;
+    ASSERT_TRUE(set.insert(1).second);
+    ASSERT_FALSE(set.insert(1).second);
+    ASSERT_TRUE(set.insert(tr::flat_hash_set::empty_key).second);
+    set.insert(2);
+    ASSERT_EQ(set.size(), 3);
+    ASSERT_EQ(set.count(2), 1);
+    ASSERT_EQ(set.erase(2), 1);
+    ASSERT_EQ(set.erase(2), 0);
+    ASSERT_EQ(set.erase(tr::flat_hash_set::empty_key), 1);
+    std::vector<uint64_t> keys(set.begin(), set.end());
+    ASSERT_EQ(keys, std::vector<uint64_t>{1});
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
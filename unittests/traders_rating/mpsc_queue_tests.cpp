@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/mpsc_queue.h"
+
+#include <thread>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(MpscQueueTest, Capacity) {
+  try {
+    tr::mpsc_queue<int> queue(1000);
+    ASSERT_EQ(queue.capacity(), 1024);
+    ASSERT_TRUE(queue.empty());
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(MpscQueueTest, PushConsume) {
+  try {
+    tr::mpsc_queue<int> queue(4);
+    ASSERT_TRUE(queue.try_push(1));
+    ASSERT_TRUE(queue.try_push(2));
+    ASSERT_TRUE(queue.try_push(3));
+    ASSERT_TRUE(queue.try_push(4));
+    ASSERT_FALSE(queue.try_push(5));
+
+    std::vector<int> values;
+    auto consumed = queue.consume([&](int& v) { values.push_back(v); }, 3);
+    ASSERT_EQ(consumed, 3);
+    ASSERT_TRUE(values == (std::vector<int>{1, 2, 3}));
+    ASSERT_TRUE(queue.try_push(5));
+    ASSERT_TRUE(queue.try_push(6));
+    ASSERT_TRUE(queue.try_push(7));
+    ASSERT_FALSE(queue.try_push(8));
+
+    values.clear();
+    consumed = queue.consume([&](int& v) { values.push_back(v); }, 10);
+    ASSERT_EQ(consumed, 4);
+    ASSERT_TRUE(values == (std::vector<int>{4, 5, 6, 7}));
+    ASSERT_TRUE(queue.empty());
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(MpscQueueTest, ClaimPublish) {
+  try {
+    tr::mpsc_queue<int> queue(8);
+    size_t first, second, third;
+    ASSERT_TRUE(queue.try_claim(first, 3));
+    ASSERT_TRUE(queue.try_claim(second));
+    ASSERT_EQ(second, first + 3);
+    ASSERT_FALSE(queue.try_claim(third, 5));
+
+    queue.slot(second) = 40;
+    queue.publish(second);
+    // позиции публикуются не по порядку, читатель ждет первую
+    ASSERT_TRUE(queue.empty());
+    for (size_t i = 0; i < 3; ++i) {
+      queue.slot(first + i) = 10 * (i + 1);
+      queue.publish(first + i);
+    }
+
+    std::vector<int> values;
+    queue.consume([&](int& v) { values.push_back(v); }, 10);
+    ASSERT_TRUE(values == (std::vector<int>{10, 20, 30, 40}));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(MpscQueueTest, MultipleProducers) {
+  try {
+    const int producers = 4;
+    const int per_producer = 20000;
+    tr::mpsc_queue<int> queue(256);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+      threads.emplace_back([&queue, p]() {
+        for (int i = 0; i < per_producer; ++i) {
+          while (!queue.try_push(p * per_producer + i)) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+
+    std::vector<int> last(producers, -1);
+    int total = 0;
+    while (total < producers * per_producer) {
+      total += queue.consume([&](int& v) {
+        int p = v / per_producer;
+        // порядок сообщений одного писателя сохраняется
+        ASSERT_LT(last[p], v);
+        last[p] = v;
+      }, 64);
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+    ASSERT_TRUE(queue.empty());
+    for (int p = 0; p < producers; ++p) {
+      ASSERT_EQ(last[p], (p + 1) * per_producer - 1);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
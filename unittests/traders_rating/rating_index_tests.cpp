@@ -0,0 +1,249 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/rating_index.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(RatingIndexTest, Empty) {
+  try {
+    tr::rating_index index;
+    ASSERT_TRUE(index.empty());
+    ASSERT_EQ(index.size(), 0);
+    ASSERT_EQ(index.rank(10., 1), 0);
+    ASSERT_THROW(index.at(0), std::out_of_range);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingIndexTest, RankAndAt) {
+  try {
+    tr::rating_index index;
+    index.insert(5.2, 20);
+    index.insert(30., 10);
+    index.insert(0.01, 30);
+    index.insert(5.2, 15);
+    ASSERT_EQ(index.size(), 4);
+    ASSERT_EQ(index.rank(30., 10), 0);
+    ASSERT_EQ(index.rank(5.2, 15), 1);
+    ASSERT_EQ(index.rank(5.2, 20), 2);
+    ASSERT_EQ(index.rank(0.01, 30), 3);
+    ASSERT_EQ(index.at(0).user_id, 10);
+    ASSERT_EQ(index.at(1).user_id, 15);
+    ASSERT_EQ(index.at(2).user_id, 20);
+    ASSERT_EQ(index.at(3).user_id, 30);
+    ASSERT_EQ(index.at(3).amount, 0.01);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingIndexTest, UpdateAndErase) {
+  try {
+    tr::rating_index index;
+    index.insert(1., 1);
+    index.insert(2., 2);
+    index.insert(3., 3);
+    index.update(1, 1., 10.);
+    ASSERT_EQ(index.size(), 3);
+    ASSERT_EQ(index.rank(10., 1), 0);
+    ASSERT_EQ(index.at(2).user_id, 2);
+    ASSERT_TRUE(index.erase(3., 3));
+    ASSERT_FALSE(index.erase(3., 3));
+    ASSERT_EQ(index.size(), 2);
+    ASSERT_EQ(index.at(1).user_id, 2);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingIndexTest, Range) {
+  try {
+    tr::rating_index index;
+    for (tr::user_id_t i = 1; i <= 100; ++i) {
+      index.insert(static_cast<tr::amount_t>(i), i);
+    }
+    std::vector<tr::user_id_t> users;
+    std::vector<size_t> positions;
+    index.range(40, 45, [&](size_t position,
+                            const tr::rating_index::entry_t& entry) {
+      positions.push_back(position);
+      users.push_back(entry.user_id);
+    });
+    ASSERT_TRUE(positions == (std::vector<size_t>{40, 41, 42, 43, 44}));
+    ASSERT_TRUE(users == (std::vector<tr::user_id_t>{60, 59, 58, 57, 56}));
+
+    users.clear();
+    index.range(98, 120, [&](size_t, const tr::rating_index::entry_t& entry) {
+      users.push_back(entry.user_id);
+    });
+    ASSERT_TRUE(users == (std::vector<tr::user_id_t>{2, 1}));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingIndexTest, RandomUpdates) {
+  try {
+    tr::rating_index index;
+    std::vector<tr::amount_t> amounts(1000, 0.);
+    std::mt19937 gen(7);
+    for (auto i = 0; i < 20000; ++i) {
+      tr::user_id_t user_id = gen() % amounts.size();
+      tr::amount_t amount = gen() % 50;
+      if (amounts[user_id] == 0.) {
+        amounts[user_id] = amount + 1;
+        index.insert(amounts[user_id], user_id);
+      } else {
+        tr::amount_t prev_amount = amounts[user_id];
+        amounts[user_id] += amount;
+        index.update(user_id, prev_amount, amounts[user_id]);
+      }
+    }
+
+    std::vector<tr::rating_index::entry_t> expected;
+    for (tr::user_id_t i = 0; i < amounts.size(); ++i) {
+      if (amounts[i] > 0) {
+        expected.push_back(tr::rating_index::entry_t{amounts[i], i});
+      }
+    }
+    std::sort(expected.begin(), expected.end(),
+              [](const tr::rating_index::entry_t& lhs,
+                 const tr::rating_index::entry_t& rhs) {
+      return tr::rating_index::before(lhs.amount, lhs.user_id, rhs.amount,
+                                      rhs.user_id);
+    });
+    ASSERT_EQ(index.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(index.at(i).user_id, expected[i].user_id);
+      ASSERT_EQ(index.rank(expected[i].amount, expected[i].user_id), i);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingIndexTest, GrowAndShrink) {
+  try {
+    // больше записей, чем помещается в два уровня узлов: проходят деление
+    // и слияние листьев и внутренних узлов
+    tr::rating_index index;
+    const tr::user_id_t users = 300000;
+    std::vector<tr::amount_t> amounts(users);
+    std::mt19937 gen(11);
+    for (tr::user_id_t i = 0; i < users; ++i) {
+      // много равных оборотов - порядок по user_id
+      amounts[i] = static_cast<tr::amount_t>(gen() % 1000 + 1);
+      index.insert(amounts[i], i);
+    }
+    ASSERT_EQ(index.size(), users);
+    size_t full_bytes = index.memory_bytes();
+    ASSERT_LT(full_bytes, users * 64);
+
+    std::vector<bool> present(users, true);
+    for (tr::user_id_t i = 0; i < users; ++i) {
+      if (i % 10 != 0) {
+        ASSERT_TRUE(index.erase(amounts[i], i));
+        present[i] = false;
+      }
+    }
+    ASSERT_FALSE(index.erase(amounts[1], 1));
+
+    std::vector<tr::rating_index::entry_t> expected;
+    for (tr::user_id_t i = 0; i < users; ++i) {
+      if (present[i]) {
+        expected.push_back(tr::rating_index::entry_t{amounts[i], i});
+      }
+    }
+    std::sort(expected.begin(), expected.end(),
+              [](const tr::rating_index::entry_t& lhs,
+                 const tr::rating_index::entry_t& rhs) {
+      return tr::rating_index::before(lhs.amount, lhs.user_id, rhs.amount,
+                                      rhs.user_id);
+    });
+    ASSERT_EQ(index.size(), expected.size());
+    size_t position = 0;
+    index.range(0, index.size(), [&](size_t p,
+                                     const tr::rating_index::entry_t& entry) {
+      ASSERT_EQ(p, position);
+      ASSERT_EQ(entry.user_id, expected[position].user_id);
+      ++position;
+    });
+    ASSERT_EQ(position, expected.size());
+    for (size_t i = 0; i < expected.size(); i += 97) {
+      ASSERT_EQ(index.at(i).user_id, expected[i].user_id);
+      ASSERT_EQ(index.rank(expected[i].amount, expected[i].user_id), i);
+    }
+
+    // освобожденные узлы используются повторно
+    for (tr::user_id_t i = 0; i < users; ++i) {
+      if (!present[i]) {
+        index.insert(amounts[i], i);
+      }
+    }
+    ASSERT_EQ(index.size(), users);
+    ASSERT_LE(index.memory_bytes(), full_bytes * 2);
+
+    for (tr::user_id_t i = 0; i < users; ++i) {
+      ASSERT_TRUE(index.erase(amounts[i], i));
+    }
+    ASSERT_TRUE(index.empty());
+    ASSERT_EQ(index.rank(1., 1), 0);
+    index.insert(1., 1);
+    ASSERT_EQ(index.at(0).user_id, 1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingIndexTest, AssignSorted) {
+  try {
+    for (size_t count : {0, 1, 48, 49, 5000, 200000}) {
+      std::vector<tr::rating_index::entry_t> entries;
+      for (size_t i = 0; i < count; ++i) {
+        entries.push_back(tr::rating_index::entry_t{
+            static_cast<tr::amount_t>(count - i / 3),
+            static_cast<tr::user_id_t>(i)});
+      }
+      tr::rating_index index;
+      index.insert(1., 1);
+      index.assign_sorted(entries.data(), entries.size());
+      ASSERT_EQ(index.size(), count);
+      size_t position = 0;
+      index.range(0, count, [&](size_t,
+                                const tr::rating_index::entry_t& entry) {
+        ASSERT_EQ(entry.user_id, entries[position].user_id);
+        ++position;
+      });
+      ASSERT_EQ(position, count);
+      for (size_t i = 0; i < count; i += 7) {
+        ASSERT_EQ(index.at(i).user_id, i);
+        ASSERT_EQ(index.rank(entries[i].amount, i), i);
+      }
+
+      // после построения индекс изменяется как обычно
+      for (size_t i = 0; i < count; i += 2) {
+        ASSERT_TRUE(index.erase(entries[i].amount, i));
+      }
+      index.insert(0.5, count);
+      ASSERT_EQ(index.size(), count / 2 + 1);
+      ASSERT_EQ(index.at(index.size() - 1).user_id, count);
+      for (size_t i = 1; i < count; i += 14) {
+        ASSERT_EQ(index.rank(entries[i].amount, i), i / 2);
+      }
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
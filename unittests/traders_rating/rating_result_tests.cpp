@@ -0,0 +1,238 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/rating_result.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+tr::flat_rating_result_t make_flat_result() {
+  tr::flat_rating_result_t flat;
+  flat.ts = 100;
+  flat.user_id = 20;
+  flat.amount = 5.;
+  flat.rank = 2;
+  flat.sections = tr::section_all;
+  flat.top_size = 3;
+  flat.top[0] = tr::rating_entry_t{1, 10, 7.};
+  flat.top[1] = tr::rating_entry_t{2, 20, 5.};
+  flat.top[2] = tr::rating_entry_t{3, 30, 5.};
+  flat.above_size = 1;
+  flat.above[0] = tr::rating_entry_t{1, 10, 7.};
+  flat.below_size = 1;
+  flat.below[0] = tr::rating_entry_t{3, 30, 5.};
+  return flat;
+}
+
+}  // namespace
+
+TEST(RatingResultTest, ToRatingResult) {
+  try {
+    auto flat = make_flat_result();
+    tr::rating_result_t res;
+    tr::to_rating_result(flat, res);
+    ASSERT_EQ(res.ts, 100);
+    ASSERT_EQ(res.user_id, 20);
+    ASSERT_EQ(res.amount, 5.);
+    ASSERT_EQ(res.rank, 2);
+    ASSERT_EQ(res.top_users->size(), 2);
+    ASSERT_TRUE(res.top_users->begin()->second ==
+                tr::rating_result_t::user_set_t{10});
+    ASSERT_TRUE(res.top_users->rbegin()->second ==
+                (tr::rating_result_t::user_set_t{20, 30}));
+    ASSERT_EQ(res.above_users.size(), 1);
+    ASSERT_EQ(res.below_users.size(), 1);
+    ASSERT_TRUE(res.below_users.begin()->second ==
+                tr::rating_result_t::user_set_t{30});
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingResultTest, ApplyDelta) {
+  try {
+    auto state = make_flat_result();
+    // изменились только позиция и соседи снизу
+    tr::flat_rating_result_t delta;
+    delta.ts = 160;
+    delta.user_id = 20;
+    delta.amount = 5.;
+    delta.rank = 3;
+    delta.sections = tr::section_user | tr::section_below;
+    delta.top_size = delta.above_size = 0;
+    delta.below_size = 0;
+    tr::apply_rating_result(delta, state);
+    ASSERT_EQ(state.ts, 160);
+    ASSERT_EQ(state.rank, 3);
+    ASSERT_EQ(state.top_size, 3);
+    ASSERT_EQ(state.top[2].user_id, 30);
+    ASSERT_EQ(state.above_size, 1);
+    ASSERT_EQ(state.above[0].rank, 2);
+    ASSERT_EQ(state.below_size, 0);
+
+    tr::rating_result_t res;
+    tr::to_rating_result(delta, res);
+    ASSERT_EQ(res.sections, delta.sections);
+    ASSERT_EQ(res.top_users, nullptr);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingResultTest, Fingerprint) {
+  try {
+    auto flat = make_flat_result();
+    auto top = tr::fingerprint(flat.top.data(), flat.top_size);
+    ASSERT_NE(top, 0);
+    ASSERT_EQ(top, tr::fingerprint(flat.top.data(), flat.top_size));
+    ASSERT_NE(top, tr::fingerprint(flat.top.data(), 2));
+    // позиции записей в отпечаток не входят
+    flat.top[1].rank = 5;
+    ASSERT_EQ(top, tr::fingerprint(flat.top.data(), flat.top_size));
+    flat.top[1].amount = 6.;
+    ASSERT_NE(top, tr::fingerprint(flat.top.data(), flat.top_size));
+    ASSERT_NE(tr::fingerprint(nullptr, 0), 0);
+    ASSERT_EQ(tr::fingerprint(5., 2), tr::fingerprint(5., 2));
+    ASSERT_NE(tr::fingerprint(5., 2), tr::fingerprint(5., 3));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingSinkTest, SharesTopBlock) {
+  try {
+    std::vector<tr::rating_result_t> results;
+    tr::rating_sink sink(tr::upload_result_callback(
+        [&](const tr::rating_result_t& res) { results.push_back(res); }));
+    auto flat = make_flat_result();
+    sink.upload(flat);
+    flat.user_id = 30;
+    flat.rank = 3;
+    sink.upload(flat);
+    flat.top[0].amount = 8.;
+    sink.upload(flat);
+    ASSERT_EQ(results.size(), 3);
+    ASSERT_EQ(results[1].user_id, 30);
+    ASSERT_EQ(results[0].top_users, results[1].top_users);
+    ASSERT_NE(results[1].top_users, results[2].top_users);
+    ASSERT_EQ(results[2].top_users->begin()->first, 8.);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingSinkTest, Flat) {
+  try {
+    std::vector<tr::user_id_t> users;
+    tr::rating_sink sink(tr::upload_flat_result_callback(
+        [&](const tr::flat_rating_result_t& res) {
+          users.push_back(res.user_id);
+        }));
+    sink.upload(make_flat_result());
+    ASSERT_TRUE(users == std::vector<tr::user_id_t>{20});
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingSinkTest, BatchChunks) {
+  try {
+    std::vector<size_t> batches;
+    std::vector<tr::user_id_t> users;
+    tr::rating_sink sink(
+        tr::upload_batch_callback([&](const tr::flat_rating_result_t* results,
+                                      size_t count) {
+          batches.push_back(count);
+          for (size_t i = 0; i < count; ++i) {
+            users.push_back(results[i].user_id);
+          }
+        }),
+        4);
+    for (tr::user_id_t user_id = 0; user_id < 10; ++user_id) {
+      tr::flat_rating_result_t& res = sink.next();
+      res.user_id = user_id;
+      sink.commit();
+    }
+    ASSERT_TRUE(batches == (std::vector<size_t>{4, 4}));
+    sink.flush();
+    ASSERT_TRUE(batches == (std::vector<size_t>{4, 4, 2}));
+    sink.flush();
+    ASSERT_EQ(batches.size(), 3);
+    ASSERT_EQ(users.size(), 10);
+    ASSERT_EQ(users[9], 9);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingSinkTest, BatchWholePublication) {
+  try {
+    std::vector<size_t> batches;
+    tr::rating_sink sink(
+        tr::upload_batch_callback([&](const tr::flat_rating_result_t*,
+                                      size_t count) {
+          batches.push_back(count);
+        }),
+        0);
+    for (auto i = 0; i < 1000; ++i) {
+      sink.upload(make_flat_result());
+    }
+    ASSERT_TRUE(batches.empty());
+    sink.flush();
+    ASSERT_TRUE(batches == std::vector<size_t>{1000});
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(RatingSinkTest, CallbackMutex) {
+  try {
+    // две копии одного получателя: сборка в буфере идет без общего
+    // mutex, под ним только вызов функции получателя
+    std::mutex callback_mt;
+    std::vector<size_t> batches;
+    std::atomic_bool uploaded(false);
+    tr::rating_sink sink(
+        tr::upload_batch_callback([&](const tr::flat_rating_result_t*,
+                                      size_t count) {
+          batches.push_back(count);
+        }),
+        4);
+    tr::rating_sink copy(sink);
+    sink.set_callback_mutex(&callback_mt);
+    copy.set_callback_mutex(&callback_mt);
+
+    std::unique_lock<std::mutex> lk(callback_mt);
+    for (int i = 0; i < 3; ++i) {
+      sink.upload(make_flat_result());
+    }
+    std::thread th([&]() {
+      tr::flat_rating_result_t res = make_flat_result();
+      copy.upload(&res, 1);
+      uploaded = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_FALSE(uploaded);
+    lk.unlock();
+    th.join();
+    ASSERT_TRUE(batches == std::vector<size_t>{1});
+    sink.flush();
+    ASSERT_TRUE(batches == (std::vector<size_t>{1, 3}));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
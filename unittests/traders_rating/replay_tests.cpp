@@ -0,0 +1,214 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/replay.h"
+#include "traders_rating/utilities.h"
+
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+struct replay_results_t {
+  replay_results_t()
+      : sink(tr::upload_batch_callback(
+                 std::bind(&replay_results_t::upload, this,
+                           std::placeholders::_1, std::placeholders::_2)),
+             0) {}
+  void upload(const tr::flat_rating_result_t* results, size_t count) {
+    this->results.insert(this->results.end(), results, results + count);
+  }
+  std::vector<tr::flat_rating_result_t> results;
+  tr::rating_sink sink;
+};
+
+// начало минуты через час после начала недели
+time_t test_start_ts() {
+  auto week_times = tr::get_week_times(1500000000);
+  return tr::get_minute_times(week_times.first + 3600).first;
+}
+
+void run(const std::vector<char>& feed, tr::replay& replay) {
+  uint64_t events = 0;
+  tr::parse_events(feed.data(), feed.size(), 3,
+                   [&replay](const tr::event_record_t* const* records,
+                             size_t count) {
+                     replay.on_events(records, count);
+                   },
+                   events);
+  replay.finish();
+}
+
+std::vector<char> make_feed(time_t ts) {
+  std::vector<char> feed;
+  for (tr::user_id_t id : {10, 20, 30}) {
+    tr::append_event(feed, tr::event_type_t::user_registered, ts, id, 0,
+                     "user");
+  }
+  tr::append_event(feed, tr::event_type_t::user_connected, ts, 10);
+  tr::append_event(feed, tr::event_type_t::user_connected, ts, 20);
+  tr::append_event(feed, tr::event_type_t::user_deal_won, ts + 1, 10, 5.);
+  tr::append_event(feed, tr::event_type_t::user_deal_won, ts + 2, 20, 7.);
+  tr::append_event(feed, tr::event_type_t::user_deal_won, ts + 3, 30, 1.);
+  tr::append_event(feed, tr::event_type_t::user_connected, ts + 61, 30);
+  return feed;
+}
+
+}  // namespace
+
+TEST(ReplayTest, Empty) {
+  try {
+    replay_results_t results;
+    tr::replay replay(results.sink);
+    replay.finish();
+    ASSERT_EQ(replay.report().events, 0);
+    ASSERT_TRUE(replay.report().minutes.empty());
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ReplayTest, Minutes) {
+  try {
+    auto ts = test_start_ts();
+    replay_results_t results;
+    tr::replay replay(results.sink);
+    run(make_feed(ts), replay);
+
+    auto& report = replay.report();
+    ASSERT_EQ(report.events, 9);
+    ASSERT_EQ(report.results, 5);
+    ASSERT_EQ(report.minutes.size(), 2);
+    ASSERT_EQ(report.minutes[0].minute_ts, ts);
+    ASSERT_EQ(report.minutes[0].events, 8);
+    ASSERT_EQ(report.minutes[0].results, 2);
+    ASSERT_EQ(report.minutes[1].minute_ts, ts + 60);
+    ASSERT_EQ(report.minutes[1].events, 1);
+    ASSERT_EQ(report.minutes[1].results, 3);
+    ASSERT_EQ(replay.now(), ts + 121);
+
+    // первая публикация - через секунду после конца минуты,
+    // пользователь 30 еще не подключен
+    ASSERT_EQ(results.results.size(), 5);
+    for (size_t i = 0; i < 2; ++i) {
+      auto& res = results.results[i];
+      ASSERT_EQ(res.ts, ts + 61);
+      ASSERT_EQ(res.top_size, 3);
+      ASSERT_EQ(res.rank, res.user_id == 20 ? 1 : 2);
+    }
+    for (size_t i = 2; i < 5; ++i) {
+      ASSERT_EQ(results.results[i].ts, ts + 121);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ReplayTest, Gap) {
+  try {
+    auto ts = test_start_ts();
+    replay_results_t results;
+    tr::replay replay(results.sink);
+    auto feed = make_feed(ts);
+    tr::append_event(feed, tr::event_type_t::user_deal_won, ts + 600 + 5, 10,
+                     1.);
+    run(feed, replay);
+
+    // пропуск проходится поминутно: каждая минута опубликована
+    auto& report = replay.report();
+    ASSERT_EQ(report.minutes.size(), 11);
+    for (size_t i = 0; i < report.minutes.size(); ++i) {
+      ASSERT_EQ(report.minutes[i].minute_ts, ts + 60 * i);
+      ASSERT_EQ(report.minutes[i].results, i == 0 ? 2 : 3);
+    }
+    ASSERT_EQ(results.results.back().ts, ts + 660 + 1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ReplayTest, Deterministic) {
+  try {
+    auto ts = test_start_ts();
+    auto feed = make_feed(ts);
+    replay_results_t first, second;
+    tr::replay first_replay(first.sink);
+    run(feed, first_replay);
+    tr::replay second_replay(second.sink);
+    run(feed, second_replay);
+
+    ASSERT_EQ(first.results.size(), second.results.size());
+    for (size_t i = 0; i < first.results.size(); ++i) {
+      ASSERT_EQ(first.results[i].ts, second.results[i].ts);
+      ASSERT_EQ(first.results[i].user_id, second.results[i].user_id);
+      ASSERT_EQ(first.results[i].rank, second.results[i].rank);
+      ASSERT_EQ(first.results[i].amount, second.results[i].amount);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ReplayTest, NextWeek) {
+  try {
+    auto ts = test_start_ts();
+    auto week_times = tr::get_week_times(ts);
+    replay_results_t results;
+    tr::replay replay(results.sink);
+    std::vector<char> feed;
+    tr::append_event(feed, tr::event_type_t::user_registered, ts, 10, 0,
+                     "user");
+    tr::append_event(feed, tr::event_type_t::user_connected, ts, 10);
+    tr::append_event(feed, tr::event_type_t::user_deal_won, ts, 10, 5.);
+    tr::append_event(feed, tr::event_type_t::user_connected,
+                     week_times.second + 2, 10);
+    run(feed, replay);
+
+    // последняя минута недели публикуется по старой неделе,
+    // в новой неделе у пользователя нет выигрышей
+    auto& minutes = replay.report().minutes;
+    ASSERT_EQ(minutes.back().minute_ts, week_times.second);
+    ASSERT_EQ(minutes.back().results, 0);
+    ASSERT_EQ(minutes[minutes.size() - 2].results, 1);
+    ASSERT_EQ(results.results.back().ts, week_times.second + 1);
+    ASSERT_EQ(results.results.back().amount, 5.);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ReplayTest, FarFuture) {
+  try {
+    // поминутно проходится только остаток текущей недели, пустые недели
+    // пропускаются целиком
+    auto ts = test_start_ts();
+    auto week_times = tr::get_week_times(ts);
+    auto far_ts = week_times.second + 3 * 7 * 24 * 3600 + 600 + 5;
+    replay_results_t results;
+    tr::replay replay(results.sink);
+    std::vector<char> feed;
+    tr::append_event(feed, tr::event_type_t::user_registered, ts, 10, 0,
+                     "user");
+    tr::append_event(feed, tr::event_type_t::user_connected, ts, 10);
+    tr::append_event(feed, tr::event_type_t::user_deal_won, ts, 10, 5.);
+    tr::append_event(feed, tr::event_type_t::user_deal_won, far_ts, 10, 2.);
+    run(feed, replay);
+
+    auto& minutes = replay.report().minutes;
+    ASSERT_EQ(minutes.size(), (week_times.second - ts) / 60 + 1);
+    ASSERT_EQ(minutes.back().minute_ts, far_ts - 5);
+    ASSERT_EQ(minutes.back().events, 1);
+    ASSERT_EQ(minutes.back().results, 1);
+    // новая неделя: в рейтинге только сделка из нее
+    ASSERT_EQ(results.results.back().amount, 2.);
+    ASSERT_EQ(results.results.back().ts, far_ts - 5 + 61);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
@@ -4,6 +4,15 @@
 #include "traders_rating/service.h"
 #include "traders_rating/utilities.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 namespace tr = ::traders_rating;
 
 struct test_get_rating_result {
@@ -60,9 +69,84 @@ TEST(MinuteRatingTest, OnUserDealWon) {
     auto ts = time(nullptr);
     auto minute_ts = tr::get_minute_times(ts);
     tr::minute_rating rating(minute_ts.first, minute_ts.second);
-    rating.on_user_deal_won(ts, 100, 105.1);
-    ASSERT_EQ((*rating.begin()).first, 100);
-    ASSERT_EQ((*rating.begin()).second, 105.1);
+    rating.on_user_deal_won(ts, 0, 100, 105.1);
+    ASSERT_EQ((*rating.begin()).user_id, 100);
+    ASSERT_EQ((*rating.begin()).amount, 105.1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(MinuteRatingTest, Reset) {
+  try {
+    tr::minute_rating rating(60, 120, 100);
+    auto capacity = rating.capacity();
+    ASSERT_GE(capacity, 100);
+    rating.on_user_deal_won(60, 1, 1, 1.);
+    rating.on_user_deal_won(61, 1, 1, 2.);
+    rating.on_user_deal_won(61, 2, 2, 3.);
+    // вне минуты
+    rating.on_user_deal_won(120, 3, 3, 3.);
+    ASSERT_EQ(rating.size(), 2);
+    rating.reset(120, 180);
+    ASSERT_EQ(rating.size(), 0);
+    ASSERT_EQ(rating.capacity(), capacity);
+    ASSERT_EQ(rating.start_ts(), 120);
+    rating.on_user_deal_won(120, 3, 3, 3.);
+    ASSERT_EQ((*rating.begin()).user_id, 3);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(MinuteRatingTest, SortByIndex) {
+  try {
+    tr::minute_rating rating(60, 120);
+    rating.on_user_deal_won(60, 5, 50, 1.);
+    rating.on_user_deal_won(60, 2, 20, 2.);
+    rating.on_user_deal_won(61, 9, 90, 3.);
+    rating.on_user_deal_won(62, 2, 20, 4.);
+    rating.sort_by_index();
+    std::vector<tr::user_index_t> indices;
+    for (const auto& entry : rating) {
+      indices.push_back(entry.index);
+    }
+    ASSERT_TRUE(indices == (std::vector<tr::user_index_t>{2, 5, 9}));
+    ASSERT_EQ((*rating.begin()).amount, 6.);
+    // сделки после упорядочивания попадают в запись своего пользователя
+    rating.on_user_deal_won(63, 9, 90, 1.);
+    ASSERT_EQ(rating.size(), 3);
+    ASSERT_EQ((*(rating.end() - 1)).amount, 4.);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(MinuteRatingPoolTest, Recycle) {
+  try {
+    auto pool = tr::minute_rating_pool::create(1000, 1);
+    tr::minute_rating* second_ptr = nullptr;
+    {
+      auto first = pool->acquire(0, 60);
+      auto second = pool->acquire(60, 120);
+      ASSERT_EQ(pool->allocated(), 2);
+      ASSERT_GE(first->capacity(), 1000);
+      second->on_user_deal_won(70, 0, 1, 1.);
+      second_ptr = second.get();
+    }
+    // second освобождена первой и осталась в пуле, first удалена:
+    // в пуле не больше max_free минут
+    ASSERT_EQ(pool->allocated(), 1);
+    ASSERT_EQ(pool->free_size(), 1);
+    auto third = pool->acquire(120, 180);
+    ASSERT_EQ(pool->free_size(), 0);
+    ASSERT_EQ(third->start_ts(), 120);
+    ASSERT_EQ(third->finish_ts(), 180);
+    ASSERT_EQ(third->size(), 0);
+    ASSERT_EQ(third.get(), second_ptr);
   }
   catch (std::exception& e) {
     FAIL() << e.what();
@@ -76,7 +160,8 @@ TEST(WeekRatingTest, Create) {
     test_get_rating_result result;
 
     tr::week_rating rating(week_ts.first, week_ts.second,
-                           [](std::vector<tr::user_id_t>&) {}, result.callback);
+                           [](std::vector<tr::user_index_t>&) {},
+                           result.callback);
     ASSERT_EQ(rating.started(), false);
     ASSERT_EQ(rating.finished(), false);
   }
@@ -90,7 +175,7 @@ struct WeekRatingFixture : public ::testing::Test {
   void create_rating() {
     start_ts = time(nullptr);
     week_ts = tr::get_week_times(start_ts);
-    callback = [](std::vector<tr::user_id_t>&) {};
+    callback = [](std::vector<tr::user_index_t>&) {};
     rating.reset(new tr::week_rating(week_ts.first, week_ts.second, callback,
                                      result.callback));
   }
@@ -98,7 +183,7 @@ struct WeekRatingFixture : public ::testing::Test {
   void create_rating(time_t ts, tr::time_function_t time_function) {
     start_ts = ts;
     week_ts = tr::get_week_times(start_ts);
-    callback = [](std::vector<tr::user_id_t>& connected) {
+    callback = [](std::vector<tr::user_index_t>& connected) {
       connected.clear();
       connected.push_back(10);
       connected.push_back(20);
@@ -186,10 +271,10 @@ TEST_F(WeekRatingFixture, OnMinute) {
     auto minute_ts = tr::get_minute_times(deal_ts);
     tr::minute_rating_uptr m_rating(
         new tr::minute_rating(minute_ts.first, minute_ts.second));
-    m_rating->on_user_deal_won(deal_ts, 10, 10.0);
-    m_rating->on_user_deal_won(deal_ts, 20, 5.2);
-    m_rating->on_user_deal_won(deal_ts, 30, 0.01);
-    m_rating->on_user_deal_won(deal_ts, 10, 20.0);
+    m_rating->on_user_deal_won(deal_ts, 10, 10, 10.0);
+    m_rating->on_user_deal_won(deal_ts, 20, 20, 5.2);
+    m_rating->on_user_deal_won(deal_ts, 30, 30, 0.01);
+    m_rating->on_user_deal_won(deal_ts, 10, 10, 20.0);
     rating->on_minute(std::move(m_rating));
     rating_posted = true;
 
@@ -198,9 +283,10 @@ TEST_F(WeekRatingFixture, OnMinute) {
     const tr::rating_result_t& user_10 = result.trading_results[10];
     ASSERT_EQ(user_10.user_id, 10);
     ASSERT_EQ(user_10.amount, 30.0);
+    ASSERT_EQ(user_10.rank, 1);
     ASSERT_EQ(user_10.above_users.size(), 0);
     ASSERT_EQ(user_10.below_users.size(), 2);
-    auto user_10_top_users_itr = user_10.top_users.begin();
+    auto user_10_top_users_itr = user_10.top_users->begin();
     ASSERT_EQ(user_10_top_users_itr->first, 30.);
     ASSERT_TRUE(user_10_top_users_itr->second ==
                 tr::rating_result_t::user_set_t{10});
@@ -218,12 +304,15 @@ TEST_F(WeekRatingFixture, OnMinute) {
     const tr::rating_result_t& user_20 = result.trading_results[20];
     ASSERT_EQ(user_20.user_id, 20);
     ASSERT_EQ(user_20.amount, 5.2);
+    ASSERT_EQ(user_20.rank, 2);
+    ASSERT_EQ(user_20.top_users, user_10.top_users);
     ASSERT_EQ(user_20.above_users.size(), 1);
     ASSERT_EQ(user_20.below_users.size(), 1);
 
     const tr::rating_result_t& user_30 = result.trading_results[30];
     ASSERT_EQ(user_30.user_id, 30);
     ASSERT_EQ(user_30.amount, 0.01);
+    ASSERT_EQ(user_30.rank, 3);
     ASSERT_EQ(user_30.above_users.size(), 2);
     ASSERT_EQ(user_30.below_users.size(), 0);
 
@@ -234,6 +323,769 @@ TEST_F(WeekRatingFixture, OnMinute) {
   }
 }
 
+TEST_F(WeekRatingFixture, OnMinuteFlat) {
+  try {
+    auto start_ts = time(nullptr);
+    std::atomic_bool rating_posted(false);
+    auto time_function = [&](time_t*) {
+      auto current_ts = time(nullptr);
+      if (current_ts > start_ts + 1 && rating_posted) {
+        return current_ts + 60;
+      }
+      return current_ts;
+    };
+    std::unordered_map<tr::user_id_t, tr::flat_rating_result_t> results;
+    tr::upload_flat_result_callback flat_callback =
+        [&](const tr::flat_rating_result_t& res) {
+          results[res.user_id] = res;
+        };
+    week_ts = tr::get_week_times(start_ts);
+    rating.reset(new tr::week_rating(
+        week_ts.first, week_ts.second,
+        [](std::vector<tr::user_index_t>& connected) {
+          connected.push_back(10);
+          connected.push_back(20);
+          connected.push_back(30);
+        },
+        flat_callback, time_function));
+    rating->start();
+
+    auto deal_ts = time(nullptr);
+    auto minute_ts = tr::get_minute_times(deal_ts);
+    tr::minute_rating_uptr m_rating(
+        new tr::minute_rating(minute_ts.first, minute_ts.second));
+    m_rating->on_user_deal_won(deal_ts, 10, 10, 10.0);
+    m_rating->on_user_deal_won(deal_ts, 20, 20, 5.2);
+    m_rating->on_user_deal_won(deal_ts, 30, 30, 5.2);
+    rating->on_minute(std::move(m_rating));
+    rating_posted = true;
+
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    rating->stop();
+    ASSERT_EQ(results.size(), 3);
+    const auto& user_20 = results[20];
+    ASSERT_EQ(user_20.rank, 2);
+    ASSERT_EQ(user_20.top_size, 3);
+    ASSERT_EQ(user_20.top[0].user_id, 10);
+    ASSERT_EQ(user_20.top[2].user_id, 30);
+    ASSERT_EQ(user_20.top[2].rank, 3);
+    ASSERT_EQ(user_20.above_size, 1);
+    ASSERT_EQ(user_20.above[0].user_id, 10);
+    ASSERT_EQ(user_20.below_size, 1);
+    ASSERT_EQ(user_20.below[0].user_id, 30);
+    ASSERT_EQ(user_20.below[0].amount, 5.2);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+#if !defined TRADERS_RATING_DOUBLE_AMOUNT
+TEST(WeekRatingTest, ExactTies) {
+  try {
+    // равные обороты, набранные разными сделками, - одна сумма:
+    // порядок в рейтинге по user_id
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    std::vector<tr::flat_rating_result_t> results;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [](std::vector<tr::user_index_t>& connected) {
+          connected.push_back(0);
+          connected.push_back(1);
+        },
+        tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              results.push_back(res);
+            }));
+    tr::minute_rating minute(minute_ts.first, minute_ts.second);
+    minute.on_user_deal_won(minute_ts.first, 0, 20, 0.1);
+    minute.on_user_deal_won(minute_ts.first, 1, 10, 0.3);
+    minute.on_user_deal_won(minute_ts.first + 1, 0, 20, 0.2);
+    rating.update_week_rating(minute);
+    ASSERT_EQ(rating.send_rating(), 2);
+    ASSERT_EQ(results[0].user_id, 20);
+    ASSERT_EQ(results[0].amount, results[1].amount);
+    ASSERT_EQ(results[0].rank, 2);
+    ASSERT_EQ(results[1].rank, 1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+#endif
+
+TEST(WeekRatingTest, PacedDelivery) {
+  try {
+    // часы модели: рассылка минуты идет тремя частями по секундам,
+    // часть пользователя - user_index % 3
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    std::atomic<time_t> now(minute_ts.first + 10);
+    std::mutex mt;
+    std::vector<tr::flat_rating_result_t> results;
+    tr::rating_sink sink(tr::upload_flat_result_callback(
+        [&](const tr::flat_rating_result_t& res) {
+          std::lock_guard<std::mutex> lk(mt);
+          results.push_back(res);
+        }));
+    tr::delivery_config_t delivery;
+    delivery.window = 3;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [](std::vector<tr::user_index_t>& connected) {
+          for (tr::user_index_t index = 0; index < 7; ++index) {
+            connected.push_back(index);
+          }
+        },
+        sink, [&](time_t*) { return now.load(); }, tr::wait_config_t(),
+        delivery);
+    auto wait_results = [&](size_t n) {
+      for (int i = 0; i < 300; ++i) {
+        {
+          std::lock_guard<std::mutex> lk(mt);
+          if (results.size() >= n) {
+            return results.size();
+          }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      std::lock_guard<std::mutex> lk(mt);
+      return results.size();
+    };
+    rating.start();
+    // поток должен прочитать часы до их перевода
+    while (!rating.started()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // пользователь 6 без выигрышей сообщений не получает
+    tr::minute_rating_uptr minute(
+        new tr::minute_rating(minute_ts.first, minute_ts.second));
+    for (tr::user_index_t index = 0; index < 6; ++index) {
+      minute->on_user_deal_won(minute_ts.first, index, 100 + index, 1. + index);
+    }
+    rating.on_minute(std::move(minute));
+
+    std::vector<size_t> counts;
+    for (time_t second = 1; second <= 3; ++second) {
+      now = minute_ts.second + second;
+      counts.push_back(wait_results(2 * second));
+    }
+    rating.stop();
+    ASSERT_EQ(counts, (std::vector<size_t>{2, 4, 6}));
+
+    std::lock_guard<std::mutex> lk(mt);
+    std::vector<tr::user_id_t> users;
+    for (size_t i = 0; i < results.size(); ++i) {
+      users.push_back(results[i].user_id);
+      ASSERT_EQ(results[i].ts, minute_ts.second + 1 + i / 2);
+      ASSERT_EQ(results[i].top_size, 6);
+    }
+    ASSERT_EQ(users,
+              (std::vector<tr::user_id_t>{100, 103, 101, 104, 102, 105}));
+    auto stats = rating.delivery_stats();
+    ASSERT_EQ(stats.minutes, 1);
+    ASSERT_EQ(stats.messages, 6);
+    ASSERT_EQ(stats.last_peak, 2);
+    ASSERT_EQ(stats.peak_to_average(), 20.);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, PacedDeliveryFoldBetweenSlices) {
+  try {
+    // между первой и второй частью рассылки сворачивается следующая
+    // минута: каждая часть собирается из одного состояния рейтинга
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    auto next_minute_ts = tr::get_minute_times(minute_ts.first + 60);
+    std::atomic<time_t> now(minute_ts.first + 10);
+    std::mutex mt;
+    std::vector<tr::flat_rating_result_t> results;
+    tr::rating_sink sink(tr::upload_flat_result_callback(
+        [&](const tr::flat_rating_result_t& res) {
+          std::lock_guard<std::mutex> lk(mt);
+          results.push_back(res);
+        }));
+    tr::delivery_config_t delivery;
+    delivery.window = 3;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [](std::vector<tr::user_index_t>& connected) {
+          for (tr::user_index_t index = 0; index < 6; ++index) {
+            connected.push_back(index);
+          }
+        },
+        sink, [&](time_t*) { return now.load(); }, tr::wait_config_t(),
+        delivery);
+    auto wait_results = [&](size_t n) {
+      for (int i = 0; i < 300; ++i) {
+        {
+          std::lock_guard<std::mutex> lk(mt);
+          if (results.size() >= n) {
+            return results.size();
+          }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      std::lock_guard<std::mutex> lk(mt);
+      return results.size();
+    };
+    rating.start();
+    while (!rating.started()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    tr::minute_rating_uptr minute(
+        new tr::minute_rating(minute_ts.first, minute_ts.second));
+    for (tr::user_index_t index = 0; index < 6; ++index) {
+      minute->on_user_deal_won(minute_ts.first, index, 100 + index, 1. + index);
+    }
+    rating.on_minute(std::move(minute));
+
+    now = minute_ts.second + 1;
+    ASSERT_EQ(wait_results(2), 2);
+    // пользователь 101 из второй части выходит на первое место
+    minute.reset(
+        new tr::minute_rating(next_minute_ts.first, next_minute_ts.second));
+    minute->on_user_deal_won(next_minute_ts.first, 1, 101, 100.);
+    rating.on_minute(std::move(minute));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (time_t second = 2; second <= 3; ++second) {
+      now = minute_ts.second + second;
+      ASSERT_EQ(wait_results(2 * second), 2 * second);
+    }
+    rating.stop();
+
+    std::lock_guard<std::mutex> lk(mt);
+    for (const auto& res : results) {
+      ASSERT_EQ(res.top_size, 6);
+      ASSERT_LE(res.rank, res.top_size);
+      ASSERT_EQ(res.top[res.rank - 1].user_id, res.user_id);
+      ASSERT_EQ(res.top[res.rank - 1].rank, res.rank);
+      ASSERT_EQ(res.top[res.rank - 1].amount, res.amount);
+      if (res.above_size > 0) {
+        ASSERT_EQ(res.above[res.above_size - 1].user_id,
+                  res.top[res.rank - 2].user_id);
+      }
+      if (res.below_size > 0) {
+        ASSERT_EQ(res.below[0].user_id, res.top[res.rank].user_id);
+      }
+    }
+    // первая часть ушла до свертки, остальные - после
+    ASSERT_EQ(results[0].top[0].user_id, 105);
+    ASSERT_EQ(results[2].user_id, 101);
+    ASSERT_EQ(results[2].rank, 1);
+    ASSERT_EQ(results[4].top[0].user_id, 101);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, DeltaDelivery) {
+  try {
+    // разностные сообщения, наложенные на прошлые, дают полные
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    auto connected = [](std::vector<tr::user_index_t>& users) {
+      for (tr::user_index_t index = 0; index < 4; ++index) {
+        users.push_back(index);
+      }
+    };
+    std::unordered_map<tr::user_id_t, tr::flat_rating_result_t> full, state;
+    std::vector<tr::flat_rating_result_t> deltas;
+    tr::week_rating full_rating(
+        week_ts.first, week_ts.second, connected,
+        tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              full[res.user_id] = res;
+            }));
+    tr::delivery_config_t delivery;
+    delivery.delta = true;
+    tr::week_rating delta_rating(
+        week_ts.first, week_ts.second, connected,
+        tr::rating_sink(tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              deltas.push_back(res);
+              tr::apply_rating_result(res, state[res.user_id]);
+            })),
+        &time, tr::wait_config_t(), delivery);
+    auto on_minute = [&](tr::user_index_t index, tr::amount_t amount) {
+      tr::minute_rating minute(minute_ts.first, minute_ts.second);
+      minute.on_user_deal_won(minute_ts.first, index, 100 + index, amount);
+      full_rating.update_week_rating(minute);
+      delta_rating.update_week_rating(minute);
+    };
+    auto same_state = [&]() {
+      for (const auto& p : full) {
+        const auto& f = p.second;
+        const auto& d = state[p.first];
+        if (f.amount != d.amount || f.rank != d.rank ||
+            f.top_size != d.top_size || f.above_size != d.above_size ||
+            f.below_size != d.below_size ||
+            tr::fingerprint(f.top.data(), f.top_size) !=
+                tr::fingerprint(d.top.data(), d.top_size) ||
+            tr::fingerprint(f.above.data(), f.above_size) !=
+                tr::fingerprint(d.above.data(), d.above_size) ||
+            tr::fingerprint(f.below.data(), f.below_size) !=
+                tr::fingerprint(d.below.data(), d.below_size)) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    for (tr::user_index_t index = 0; index < 3; ++index) {
+      on_minute(index, 3. - index);
+    }
+    full_rating.send_rating();
+    ASSERT_EQ(delta_rating.send_rating(), 3);
+    for (const auto& res : deltas) {
+      ASSERT_EQ(res.sections, tr::section_all);
+    }
+    ASSERT_TRUE(same_state());
+
+    // без изменений сообщений нет
+    deltas.clear();
+    full_rating.send_rating();
+    ASSERT_EQ(delta_rating.send_rating(), 0);
+    ASSERT_TRUE(same_state());
+
+    // пользователь 102 вырос, но остался третьим
+    on_minute(2, 0.5);
+    full_rating.send_rating();
+    ASSERT_EQ(delta_rating.send_rating(), 3);
+    ASSERT_EQ(deltas[2].user_id, 102);
+    ASSERT_EQ(deltas[2].sections, tr::section_user | tr::section_top);
+    ASSERT_EQ(deltas[1].sections, tr::section_top | tr::section_below);
+    ASSERT_EQ(deltas[1].top_size, 3);
+    ASSERT_EQ(deltas[1].above_size, 0);
+    ASSERT_TRUE(same_state());
+
+    // новый пользователь 103 первый: меняется все у всех
+    deltas.clear();
+    on_minute(3, 10.);
+    full_rating.send_rating();
+    ASSERT_EQ(delta_rating.send_rating(), 4);
+    ASSERT_TRUE(same_state());
+
+    // при подключении - полное сообщение, к которому дальше идут
+    // разности
+    deltas.clear();
+    delta_rating.on_user_connected(1);
+    ASSERT_EQ(delta_rating.send_connected(), 1);
+    ASSERT_EQ(deltas[0].user_id, 101);
+    ASSERT_EQ(deltas[0].sections, tr::section_all);
+    ASSERT_EQ(delta_rating.send_rating(), 0);
+
+    auto stats = delta_rating.delivery_stats();
+    ASSERT_EQ(stats.minutes, 5);
+    ASSERT_EQ(stats.messages, 10);
+    ASSERT_EQ(stats.connect_messages, 1);
+    ASSERT_EQ(stats.unchanged, 3 + 4);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, ParallelDelivery) {
+  try {
+    // сообщения пула потоков совпадают с собранными последовательно
+    const tr::user_index_t users = 5000;
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    auto connected = [&](std::vector<tr::user_index_t>& indices) {
+      for (tr::user_index_t index = 0; index < users; ++index) {
+        indices.push_back(index);
+      }
+    };
+    tr::minute_rating minute(minute_ts.first, minute_ts.second);
+    for (tr::user_index_t index = 0; index < users; index += 2) {
+      minute.on_user_deal_won(minute_ts.first, index, 100 + index,
+                              1. + index % 37);
+    }
+
+    std::unordered_map<tr::user_id_t, tr::flat_rating_result_t> sequential;
+    tr::week_rating sequential_rating(
+        week_ts.first, week_ts.second, connected,
+        tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              sequential[res.user_id] = res;
+            }));
+    sequential_rating.update_week_rating(minute);
+    ASSERT_EQ(sequential_rating.send_rating(), users / 2);
+
+    std::unordered_map<tr::user_id_t, tr::flat_rating_result_t> parallel;
+    size_t batches = 0;
+    tr::delivery_config_t delivery;
+    delivery.workers = 4;
+    tr::week_rating parallel_rating(
+        week_ts.first, week_ts.second, connected,
+        tr::rating_sink(
+            tr::upload_batch_callback(
+                [&](const tr::flat_rating_result_t* results, size_t count) {
+                  ++batches;
+                  for (size_t i = 0; i < count; ++i) {
+                    parallel[results[i].user_id] = results[i];
+                  }
+                }),
+            64),
+        &time, tr::wait_config_t(), delivery);
+    parallel_rating.update_week_rating(minute);
+    ASSERT_EQ(parallel_rating.send_rating(), users / 2);
+    ASSERT_EQ(parallel.size(), users / 2);
+    // буферы частей уходят в rating_sink без перекладывания
+    ASSERT_EQ(batches, (users / 2 + 511) / 512);
+    for (const auto& p : sequential) {
+      const auto& s = p.second;
+      const auto& r = parallel[p.first];
+      ASSERT_EQ(r.rank, s.rank);
+      ASSERT_EQ(r.amount, s.amount);
+      ASSERT_EQ(r.top_size, s.top_size);
+      ASSERT_EQ(r.above_size, s.above_size);
+      ASSERT_EQ(r.below_size, s.below_size);
+      ASSERT_EQ(tr::fingerprint(r.above.data(), r.above_size),
+                tr::fingerprint(s.above.data(), s.above_size));
+      ASSERT_EQ(tr::fingerprint(r.below.data(), r.below_size),
+                tr::fingerprint(s.below.data(), s.below_size));
+    }
+    ASSERT_EQ(parallel_rating.delivery_stats().messages, users / 2);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, ConnectRating) {
+  try {
+    // рейтинг при подключении - по текущему индексу, без публикации
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    std::vector<tr::flat_rating_result_t> results;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [](std::vector<tr::user_index_t>&) {},
+        tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              results.push_back(res);
+            }));
+    tr::minute_rating minute(minute_ts.first, minute_ts.second);
+    minute.on_user_deal_won(minute_ts.first, 0, 100, 1.);
+    minute.on_user_deal_won(minute_ts.first, 1, 101, 2.);
+    rating.update_week_rating(minute);
+
+    rating.on_user_connected(0);
+    // без оборота за неделю сообщения нет
+    rating.on_user_connected(5);
+    ASSERT_EQ(rating.send_connected(), 1);
+    ASSERT_EQ(rating.send_connected(), 0);
+    ASSERT_EQ(results[0].user_id, 100);
+    ASSERT_EQ(results[0].rank, 2);
+    ASSERT_EQ(results[0].top_size, 2);
+    ASSERT_EQ(results[0].above_size, 1);
+    ASSERT_EQ(results[0].sections, tr::section_all);
+    ASSERT_EQ(rating.delivery_stats().connect_messages, 1);
+    ASSERT_EQ(rating.delivery_stats().messages, 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, ConnectRatingBeforeMinuteEnd) {
+  try {
+    // часы стоят в середине минуты: публикаций нет, но подключившийся
+    // получает рейтинг от потока недели
+    auto week_ts = tr::get_week_times(time(nullptr));
+    static time_t model_ts;
+    model_ts = week_ts.first + 3600 + 30;
+    auto minute_ts = tr::get_minute_times(model_ts);
+    std::mutex mt;
+    std::vector<tr::flat_rating_result_t> results;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [](std::vector<tr::user_index_t>&) {},
+        tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              std::lock_guard<std::mutex> lk(mt);
+              results.push_back(res);
+            }),
+        [](time_t*) { return model_ts; });
+    tr::minute_rating minute(minute_ts.first, minute_ts.second);
+    minute.on_user_deal_won(minute_ts.first, 3, 103, 7.);
+    rating.update_week_rating(minute);
+    rating.start();
+    rating.on_user_connected(3);
+    size_t received = 0;
+    for (int i = 0; i < 1000 && received == 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      std::lock_guard<std::mutex> lk(mt);
+      received = results.size();
+    }
+    rating.stop();
+    ASSERT_EQ(received, 1);
+    ASSERT_EQ(results[0].user_id, 103);
+    ASSERT_EQ(results[0].rank, 1);
+    ASSERT_EQ(rating.delivery_stats().minutes, 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, ConnectRatingFromSnapshot) {
+  try {
+    // со снимками рейтинг подключившемуся отправляется в потоке
+    // вызывающего, в том числе пока другой поток сворачивает минуты
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    std::mutex results_mt;
+    std::vector<tr::flat_rating_result_t> results;
+    std::vector<tr::user_index_t> connected{0};
+    tr::delivery_config_t delivery;
+    delivery.snapshots = true;
+    delivery.delta = true;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [&](std::vector<tr::user_index_t>& indices) {
+          indices = connected;
+        },
+        tr::rating_sink(tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              std::lock_guard<std::mutex> lk(results_mt);
+              results.push_back(res);
+            })),
+        &time, tr::wait_config_t(), delivery);
+    tr::minute_rating minute(minute_ts.first, minute_ts.second);
+    minute.on_user_deal_won(minute_ts.first, 0, 100, 1.);
+    minute.on_user_deal_won(minute_ts.first, 1, 101, 2.);
+    rating.update_week_rating(minute);
+    ASSERT_EQ(rating.send_rating(), 1);
+    ASSERT_EQ(rating.send_rating(), 0);
+    results.clear();
+
+    rating.on_user_connected(0);
+    ASSERT_EQ(results.size(), 1);
+    ASSERT_EQ(results[0].user_id, 100);
+    ASSERT_EQ(results[0].rank, 2);
+    ASSERT_EQ(results[0].top_size, 2);
+    ASSERT_EQ(results[0].sections, tr::section_all);
+    // пользователя без оборота нет в снимке - ему отвечает поток недели
+    rating.on_user_connected(5);
+    ASSERT_EQ(results.size(), 1);
+    ASSERT_EQ(rating.send_connected(), 0);
+    ASSERT_EQ(rating.delivery_stats().connect_messages, 1);
+    // после ответа по снимку разности идут к нему: без изменений
+    // сообщения нет, потом - только изменившиеся секции
+    ASSERT_EQ(rating.send_rating(), 0);
+    minute.reset(minute_ts.first, minute_ts.second);
+    minute.on_user_deal_won(minute_ts.first, 1, 101, 1.);
+    rating.update_week_rating(minute);
+    ASSERT_EQ(rating.send_rating(), 1);
+    ASSERT_EQ(results.back().user_id, 100);
+    ASSERT_EQ(results.back().sections,
+              tr::section_top | tr::section_above);
+    rating.on_user_connected(0);
+    ASSERT_EQ(rating.send_rating(), 0);
+
+    const tr::user_index_t users = 20000;
+    std::atomic_bool finish(false);
+    std::thread folder([&]() {
+      tr::minute_rating big(minute_ts.first, minute_ts.second);
+      for (uint32_t m = 0; !finish && m < 1000; ++m) {
+        big.reset(minute_ts.first, minute_ts.second);
+        for (tr::user_index_t index = 0; index < users; ++index) {
+          big.on_user_deal_won(minute_ts.first, index, 100 + index, 1.);
+        }
+        rating.update_week_rating(big);
+      }
+    });
+    results.clear();
+    for (int i = 0; i < 1000; ++i) {
+      rating.on_user_connected(i % 2);
+    }
+    finish = true;
+    folder.join();
+    ASSERT_EQ(results.size(), 1000);
+    for (size_t i = 0; i < results.size(); ++i) {
+      ASSERT_EQ(results[i].user_id, 100 + i % 2);
+      ASSERT_EQ(results[i].sections, tr::section_all);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, SparseAndDenseFold) {
+  try {
+    // минута, изменяющая большую часть индекса, перестраивает его,
+    // заметная часть - сворачивается пачкой, редкая - по одному
+    // пользователю; рейтинг один и тот же, в том числе при сортировке
+    // пулом потоков
+    const tr::user_index_t users = 40000;
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    for (uint32_t workers : {1, 4}) {
+      std::unordered_map<tr::user_id_t, uint64_t> ranks;
+      tr::delivery_config_t delivery;
+      delivery.workers = workers;
+      tr::week_rating rating(
+          week_ts.first, week_ts.second,
+          [&](std::vector<tr::user_index_t>& indices) {
+            for (tr::user_index_t index = 0; index < users; ++index) {
+              indices.push_back(index);
+            }
+          },
+          tr::rating_sink(tr::upload_flat_result_callback(
+              [&](const tr::flat_rating_result_t& res) {
+                ranks[res.user_id] = res.rank;
+              })),
+          &time, tr::wait_config_t(), delivery);
+      std::vector<double> amounts(users, 0.);
+      tr::minute_rating minute(minute_ts.first, minute_ts.second);
+      auto check = [&]() {
+        ranks.clear();
+        ASSERT_EQ(rating.send_rating(), users);
+        std::vector<tr::user_index_t> order;
+        for (tr::user_index_t index = 0; index < users; ++index) {
+          order.push_back(index);
+        }
+        std::sort(order.begin(), order.end(),
+                  [&](tr::user_index_t lhs, tr::user_index_t rhs) {
+          return tr::rating_index::before(amounts[lhs], 100 + lhs,
+                                          amounts[rhs], 100 + rhs);
+        });
+        for (size_t i = 0; i < order.size(); ++i) {
+          ASSERT_EQ(ranks[100 + order[i]], i + 1);
+        }
+      };
+
+      // все пользователи вразброс дважды, десятая часть, 10 пользователей
+      for (tr::user_index_t count : {users, users, users / 10, 10u}) {
+        minute.reset(minute_ts.first, minute_ts.second);
+        for (tr::user_index_t i = 0; i < count; ++i) {
+          tr::user_index_t index = users - 1 - i * 7 % users;
+          double amount = 1. + (index * 13 + count) % 50;
+          minute.on_user_deal_won(minute_ts.first, index, 100 + index,
+                                  amount);
+          amounts[index] += amount;
+        }
+        rating.update_week_rating(minute);
+        check();
+      }
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WeekRatingTest, Snapshot) {
+  try {
+    // снимок после каждой минуты совпадает с рассылкой; читатель в
+    // другом потоке видит только целые снимки
+    const tr::user_index_t users = 2000;
+    auto week_ts = tr::get_week_times(time(nullptr));
+    auto minute_ts = tr::get_minute_times(week_ts.first + 3600);
+    std::unordered_map<tr::user_id_t, tr::flat_rating_result_t> sent;
+    tr::delivery_config_t delivery;
+    delivery.snapshots = true;
+    tr::week_rating rating(
+        week_ts.first, week_ts.second,
+        [&](std::vector<tr::user_index_t>& indices) {
+          for (tr::user_index_t index = 0; index < users + 1; ++index) {
+            indices.push_back(index);
+          }
+        },
+        tr::rating_sink(tr::upload_flat_result_callback(
+            [&](const tr::flat_rating_result_t& res) {
+              sent[res.user_id] = res;
+            })),
+        &time, tr::wait_config_t(), delivery);
+    rating.read_snapshot([](const tr::rating_snapshot& snapshot) {
+      ASSERT_EQ(snapshot.version(), 0);
+      ASSERT_EQ(snapshot.size(), 0);
+    });
+
+    std::atomic_bool finish(false);
+    std::atomic<uint64_t> broken(0);
+    std::thread reader([&]() {
+      std::vector<tr::rating_entry_t> entries(users);
+      uint64_t last = 0;
+      while (!finish) {
+        rating.read_snapshot([&](const tr::rating_snapshot& snapshot) {
+          size_t n = snapshot.range(0, users, entries.data());
+          if (snapshot.version() < last || n != snapshot.size()) {
+            ++broken;
+          }
+          last = snapshot.version();
+          for (size_t i = 1; i < n; ++i) {
+            if (!tr::rating_index::before(
+                    entries[i - 1].amount, entries[i - 1].user_id,
+                    entries[i].amount, entries[i].user_id)) {
+              ++broken;
+            }
+          }
+        });
+      }
+    });
+
+    tr::minute_rating minute(minute_ts.first, minute_ts.second);
+    const uint64_t minutes = 20;
+    for (uint64_t m = 1; m <= minutes; ++m) {
+      minute.reset(minute_ts.first, minute_ts.second);
+      for (tr::user_index_t index = 0; index < users; index += 1 + m % 3) {
+        minute.on_user_deal_won(minute_ts.first, index, 100 + index,
+                                1. + (index * 7 + m) % 11);
+      }
+      rating.update_week_rating(minute);
+      rating.read_snapshot([&](const tr::rating_snapshot& snapshot) {
+        ASSERT_EQ(snapshot.version(), m);
+        ASSERT_EQ(snapshot.ts(), minute_ts.second);
+      });
+    }
+    finish = true;
+    reader.join();
+    ASSERT_EQ(broken, 0);
+
+    ASSERT_EQ(rating.send_rating(), users);
+    rating.read_snapshot([&](const tr::rating_snapshot& snapshot) {
+      ASSERT_EQ(snapshot.size(), users);
+      // пользователь без оборота
+      ASSERT_EQ(snapshot.position(users), tr::rating_snapshot::npos);
+      tr::flat_rating_result_t res;
+      ASSERT_FALSE(snapshot.get_result(users, 0, res));
+      for (tr::user_index_t index = 0; index < users; ++index) {
+        const tr::flat_rating_result_t& expected = sent[100 + index];
+        ASSERT_TRUE(snapshot.get_result(index, expected.ts, res));
+        ASSERT_EQ(snapshot.position(index) + 1, expected.rank);
+        ASSERT_EQ(res.rank, expected.rank);
+        ASSERT_EQ(res.amount, expected.amount);
+        ASSERT_EQ(res.top_size, expected.top_size);
+        ASSERT_EQ(res.above_size, expected.above_size);
+        ASSERT_EQ(res.below_size, expected.below_size);
+        for (uint32_t i = 0; i < res.above_size; ++i) {
+          ASSERT_EQ(res.above[i].user_id, expected.above[i].user_id);
+        }
+        for (uint32_t i = 0; i < res.below_size; ++i) {
+          ASSERT_EQ(res.below[i].user_id, expected.below[i].user_id);
+        }
+      }
+    });
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
 struct ServiceFixture : public ::testing::Test {
   ServiceFixture() : minute_passed(0) {}
 
@@ -242,7 +1094,9 @@ struct ServiceFixture : public ::testing::Test {
     minute_passed = 0;
   }
 
-  void create_service(tr::time_function_t param) {
+  void create_service(tr::time_function_t param,
+                      const tr::service_config_t& config =
+                          tr::service_config_t()) {
     start_ts = time(nullptr);
     test_ts = start_ts;
     start_minute_pair = tr::get_minute_times(start_ts);
@@ -250,7 +1104,7 @@ struct ServiceFixture : public ::testing::Test {
     minute_passed = 0;
     time_function = param;
 
-    service_.reset(new tr::service(result.callback, time_function));
+    service_.reset(new tr::service(result.callback, time_function, config));
   }
 
   void set_minute_passed(int number) {
@@ -328,6 +1182,93 @@ TEST_F(ServiceFixture, OnUserRenamed) {
   }
 }
 
+TEST_F(ServiceFixture, OnEvents) {
+  try {
+    create_service();
+    service_->start();
+    std::vector<char> feed;
+    tr::append_event(feed, tr::event_type_t::user_registered, 0, 100, 0,
+                     "user #100");
+    tr::append_event(feed, tr::event_type_t::user_connected, 0, 100);
+    tr::append_event(feed, tr::event_type_t::user_registered, 0, 200, 0,
+                     "user #200");
+    uint64_t events = 0;
+    tr::parse_events(feed.data(), feed.size(), 256,
+                     [this](const tr::event_record_t* const* records,
+                            size_t count) {
+                       service_->on_events(records, count);
+                     },
+                     events);
+    ASSERT_EQ(events, 3);
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ASSERT_TRUE(service_->is_user_registered(100));
+    ASSERT_TRUE(service_->is_user_connected(100));
+    ASSERT_TRUE(service_->is_user_registered(200));
+    ASSERT_FALSE(service_->is_user_connected(200));
+    service_->stop();
+    service_.reset();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ServiceFixture, BadDealAmount) {
+  try {
+    create_service();
+    service_->start();
+    service_->on_user_registered(100, "user #100");
+    // сумма не представима в amount_t: исключение, команда не ставится
+    ASSERT_ANY_THROW(service_->on_user_deal_won(time(nullptr), 100,
+                                                std::nan("")));
+    tr::event_record_t event;
+    std::memset(&event, 0, sizeof(event));
+    event.type = tr::event_type_t::user_deal_won;
+    event.user_id = 100;
+    event.amount = 1e300;
+    const tr::event_record_t* events[] = {&event};
+    ASSERT_THROW(service_->on_events(events, 1), std::invalid_argument);
+    service_->on_user_connected(100);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ASSERT_TRUE(service_->is_user_connected(100));
+    ASSERT_EQ(service_->processed_cmds(), 2);
+    service_->stop();
+    service_.reset();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(ServiceTest, WaitStrategies) {
+  try {
+    for (auto strategy :
+         {tr::wait_strategy_t::busy_spin, tr::wait_strategy_t::spin_yield,
+          tr::wait_strategy_t::spin_park, tr::wait_strategy_t::blocking}) {
+      test_get_rating_result result;
+      tr::service_config_t config;
+      config.wait.strategy = strategy;
+      config.wait.park_timeout = std::chrono::milliseconds(10000);
+      tr::service srv(result.callback, &time, config);
+      srv.start();
+      srv.on_user_registered(100, "user #100");
+      auto start = std::chrono::steady_clock::now();
+      while (!srv.is_user_registered(100) &&
+             std::chrono::steady_clock::now() - start <
+                 std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      ASSERT_TRUE(srv.is_user_registered(100));
+      srv.stop();
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
 TEST_F(ServiceFixture, OnUserConnectedDisconnected) {
   try {
     create_service();
@@ -353,6 +1294,183 @@ TEST_F(ServiceFixture, OnUserConnectedDisconnected) {
   }
 }
 
+TEST_F(ServiceFixture, ConnectUnregisteredTrader) {
+  try {
+    // у незарегистрированного трейдера со сделками есть индекс, но
+    // подключиться и получить рейтинг он не может
+    create_service(std::bind(&ServiceFixture::test_time_function, this,
+                             std::placeholders::_1));
+    service_->start();
+    service_->on_user_registered(100, "user #100");
+    service_->on_user_deal_won(time_function(nullptr), 100, 10);
+    service_->on_user_deal_won(time_function(nullptr), 200, 20);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    set_minute_passed(1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    ASSERT_EQ(result.trading_results.size(), 0);
+
+    service_->on_user_connected(200);
+    service_->on_user_connected(100);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ASSERT_FALSE(service_->is_user_connected(200));
+    ASSERT_TRUE(service_->is_user_connected(100));
+    ASSERT_EQ(service_->delivery_stats().connect_messages, 1);
+    ASSERT_EQ(result.trading_results.size(), 1);
+    ASSERT_EQ(result.trading_results.count(100), 1);
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ServiceFixture, DoubleConnect) {
+  try {
+    // повторное подключение уже подключенного сообщения не вызывает
+    create_service(std::bind(&ServiceFixture::test_time_function, this,
+                             std::placeholders::_1));
+    service_->start();
+    service_->on_user_registered(100, "user #100");
+    service_->on_user_deal_won(time_function(nullptr), 100, 10);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    set_minute_passed(1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+
+    service_->on_user_connected(100);
+    service_->on_user_connected(100);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ASSERT_TRUE(service_->is_user_connected(100));
+    ASSERT_EQ(service_->delivery_stats().connect_messages, 1);
+
+    // после отключения подключение снова новое
+    result.trading_results.clear();
+    service_->on_user_disconnected(100);
+    service_->on_user_connected(100);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ASSERT_EQ(service_->delivery_stats().connect_messages, 2);
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ServiceFixture, GetRatingWhileIngesting) {
+  try {
+    // get_rating читает снимок без блокировок сервиса, пока поток
+    // сервиса принимает команды, а поток недели сворачивает минуты
+    tr::service_config_t config;
+    config.delivery.snapshots = true;
+    create_service(std::bind(&ServiceFixture::test_time_function, this,
+                             std::placeholders::_1),
+                   config);
+    service_->start();
+    const tr::user_id_t users = 100;
+    for (tr::user_id_t id = 100; id < 100 + users; ++id) {
+      service_->on_user_registered(id, "user");
+      service_->on_user_deal_won(time_function(nullptr), id, id);
+    }
+    tr::flat_rating_result_t res;
+    ASSERT_FALSE(service_->get_rating(100, res));
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    set_minute_passed(1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    ASSERT_TRUE(service_->get_rating(100, res));
+    ASSERT_EQ(res.user_id, 100);
+    ASSERT_EQ(res.rank, users);
+    ASSERT_EQ(res.amount, 100);
+    ASSERT_FALSE(service_->get_rating(99, res));
+
+    std::atomic_bool finish(false);
+    std::atomic<uint64_t> found(0), broken(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+      readers.emplace_back([&, r]() {
+        tr::flat_rating_result_t res;
+        for (tr::user_id_t i = r; !finish; ++i) {
+          tr::user_id_t id = 100 + i % (2 * users);
+          if (!service_->get_rating(id, res)) {
+            continue;
+          }
+          ++found;
+          if (res.user_id != id || res.rank == 0 ||
+              res.rank > 2 * users || res.top_size == 0) {
+            ++broken;
+          }
+        }
+      });
+    }
+    // новые пользователи и сделки, пока читатели работают
+    for (tr::user_id_t id = 100; id < 100 + 2 * users; ++id) {
+      if (id >= 100 + users) {
+        service_->on_user_registered(id, "user");
+      }
+      service_->on_user_deal_won(time_function(nullptr), id, 1000);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    set_minute_passed(2);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    finish = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    ASSERT_GT(found, 0);
+    ASSERT_EQ(broken, 0);
+    ASSERT_TRUE(service_->get_rating(100 + users, res));
+    ASSERT_EQ(res.amount, 1000);
+    ASSERT_TRUE(service_->get_rating(100, res));
+    ASSERT_EQ(res.amount, 1100);
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ServiceFixture, WeekRolloverAndRestart) {
+  try {
+    // прошедшие недели освобождаются, пока get_rating читает снимки
+    tr::service_config_t config;
+    config.delivery.snapshots = true;
+    create_service(std::bind(&ServiceFixture::test_time_function, this,
+                             std::placeholders::_1),
+                   config);
+    service_->start();
+    service_->on_user_registered(100, "user #100");
+    service_->on_user_deal_won(time_function(nullptr), 100, 10);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    set_minute_passed(1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    tr::flat_rating_result_t res;
+    ASSERT_TRUE(service_->get_rating(100, res));
+
+    std::atomic_bool finish(false);
+    std::thread reader([&]() {
+      tr::flat_rating_result_t res;
+      while (!finish) {
+        service_->get_rating(100, res);
+      }
+    });
+    const int week_minutes = 7 * 24 * 60;
+    for (int week = 1; week <= 3; ++week) {
+      set_minute_passed(week * week_minutes + 1);
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    ASSERT_FALSE(service_->get_rating(100, res));
+    // повторный start() после смены недель
+    service_->stop();
+    service_->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    service_->stop();
+    finish = true;
+    reader.join();
+    ASSERT_FALSE(service_->get_rating(100, res));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
 TEST_F(ServiceFixture, OnUserDealWon1) {
   try {
     using namespace tr;
@@ -404,14 +1522,15 @@ TEST_F(ServiceFixture, OnUserDealWon1) {
     const auto& res31 = result.trading_results[user_id];
     ASSERT_EQ(res31.user_id, user_id);
     ASSERT_EQ(res31.amount, 1001);
-    ASSERT_EQ(res31.top_users.begin()->first, 2000);
-    ASSERT_TRUE(res31.top_users.begin()->second ==
+    ASSERT_EQ(res31.rank, 2);
+    ASSERT_EQ(res31.top_users->begin()->first, 2000);
+    ASSERT_TRUE(res31.top_users->begin()->second ==
                 rating_result_t::user_set_t{user_id + 1});
 
     const auto& res32 = result.trading_results[user_id + 1];
     ASSERT_EQ(res32.user_id, user_id + 1);
     ASSERT_EQ(res32.amount, 2000);
-    ASSERT_TRUE(res32.top_users.begin()->second ==
+    ASSERT_TRUE(res32.top_users->begin()->second ==
                 rating_result_t::user_set_t{user_id + 1});
 
     service_->stop();
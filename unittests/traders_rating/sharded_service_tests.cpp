@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/sharded_service.h"
+#include "traders_rating/utilities.h"
+
+#include <limits>
+#include <unordered_map>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+struct sharded_rating_results {
+  sharded_rating_results()
+      : callback(std::bind(&sharded_rating_results::upload, this,
+                           std::placeholders::_1)) {}
+  void upload(const tr::rating_result_t& trading_result) {
+    trading_results[trading_result.user_id] = trading_result;
+  }
+  std::unordered_map<tr::user_id_t, tr::rating_result_t> trading_results;
+  tr::upload_result_callback callback;
+};
+
+}  // namespace
+
+struct ShardedServiceFixture : public ::testing::Test {
+  ShardedServiceFixture() : minute_passed(0) {}
+
+  void create_service(size_t shards) {
+    test_ts = time(nullptr);
+    start_minute_ts = tr::get_minute_times(test_ts).first;
+    time_function = std::bind(&ShardedServiceFixture::test_time_function,
+                              this, std::placeholders::_1);
+    tr::sharded_service_config_t config;
+    config.shards = shards;
+    config.cmd_queue_capacity = 1024;
+    service_.reset(
+        new tr::sharded_service(result.callback, time_function, config));
+  }
+
+  void set_minute_passed(int number) {
+    minute_passed = number;
+    test_ts = time(nullptr);
+  }
+
+  time_t test_time_function(time_t*) {
+    auto diff_ts = time(nullptr) - test_ts;
+    return start_minute_ts + 60 * minute_passed + diff_ts;
+  }
+
+  time_t start_minute_ts, test_ts;
+  tr::time_function_t time_function;
+  std::atomic_int minute_passed;
+  sharded_rating_results result;
+  std::unique_ptr<tr::sharded_service> service_;
+};
+
+TEST_F(ShardedServiceFixture, StartStop) {
+  try {
+    create_service(4);
+    ASSERT_EQ(service_->shards(), 4);
+    service_->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ShardedServiceFixture, OnUserConnectedDisconnected) {
+  try {
+    create_service(3);
+    service_->start();
+    for (tr::user_id_t user_id = 1; user_id <= 10; ++user_id) {
+      service_->on_user_registered(user_id, "user");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    service_->on_user_connected(5);
+    service_->on_user_connected(50);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for (tr::user_id_t user_id = 1; user_id <= 10; ++user_id) {
+      ASSERT_TRUE(service_->is_user_registered(user_id));
+    }
+    ASSERT_TRUE(service_->is_user_connected(5));
+    ASSERT_FALSE(service_->is_user_connected(50));
+    service_->on_user_disconnected(5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_FALSE(service_->is_user_connected(5));
+    ASSERT_EQ(service_->processed_cmds(), 13);
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ShardedServiceFixture, BadDealAmount) {
+  try {
+    create_service(2);
+    service_->start();
+    ASSERT_ANY_THROW(service_->on_user_deal_won(
+        time(nullptr), 1, std::numeric_limits<double>::infinity()));
+    service_->on_user_registered(1, "user");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_TRUE(service_->is_user_registered(1));
+    ASSERT_EQ(service_->processed_cmds(), 1);
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST_F(ShardedServiceFixture, MergedRating) {
+  try {
+    create_service(4);
+    service_->start();
+    const tr::user_id_t total_users = 30;
+    for (tr::user_id_t user_id = 1; user_id <= total_users; ++user_id) {
+      service_->on_user_registered(user_id, "user");
+      service_->on_user_connected(user_id);
+      service_->on_user_deal_won(time_function(nullptr), user_id,
+                                 10. * user_id);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    set_minute_passed(1);
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+
+    ASSERT_EQ(result.trading_results.size(), total_users);
+    const auto& res = result.trading_results[15];
+    ASSERT_EQ(res.amount, 150.);
+    ASSERT_EQ(res.rank, 16);
+    ASSERT_EQ(res.top_users->size(), 10);
+    ASSERT_EQ(res.top_users->begin()->first, 300.);
+    ASSERT_EQ(res.top_users->rbegin()->first, 210.);
+    ASSERT_EQ(res.above_users.size(), 10);
+    ASSERT_EQ(res.above_users.begin()->first, 250.);
+    ASSERT_EQ(res.above_users.rbegin()->first, 160.);
+    ASSERT_EQ(res.below_users.size(), 10);
+    ASSERT_EQ(res.below_users.begin()->first, 140.);
+    ASSERT_EQ(res.below_users.rbegin()->first, 50.);
+
+    const auto& top = result.trading_results[30];
+    ASSERT_EQ(top.rank, 1);
+    ASSERT_EQ(top.above_users.size(), 0);
+    ASSERT_EQ(top.below_users.size(), 10);
+    service_->stop();
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
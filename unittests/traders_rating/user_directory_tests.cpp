@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/user_directory.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(UserDirectoryTest, DenseIndices) {
+  try {
+    tr::user_directory users;
+    ASSERT_EQ(users.find(1000), tr::user_directory::npos);
+    ASSERT_EQ(users.register_user(1000, "a"), 0);
+    ASSERT_EQ(users.insert(7), 1);
+    ASSERT_EQ(users.register_user(1ull << 40, "b"), 2);
+    ASSERT_EQ(users.insert(1000), 0);
+    ASSERT_EQ(users.size(), 3);
+    ASSERT_EQ(users.user_id(2), 1ull << 40);
+    ASSERT_EQ(users.find(7), 1);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(UserDirectoryTest, RegisterRename) {
+  try {
+    tr::user_directory users;
+    // индекс от сделки еще не регистрация
+    users.insert(1);
+    ASSERT_FALSE(users.is_registered(1));
+    ASSERT_EQ(users.find_name(1), nullptr);
+    users.register_user(1, "first");
+    users.register_user(1, "second");
+    ASSERT_TRUE(users.is_registered(1));
+    ASSERT_EQ(users.name(0), "first");
+    *users.find_name(1) = "renamed";
+    ASSERT_EQ(users.name(users.find(1)), "renamed");
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(UserDirectoryTest, ConnectDisconnect) {
+  try {
+    tr::user_directory users;
+    ASSERT_FALSE(users.connect(1));
+    for (tr::user_id_t id = 1; id <= 4; ++id) {
+      users.register_user(id * 10, "");
+      ASSERT_TRUE(users.connect(id * 10));
+    }
+    users.connect(10);
+    ASSERT_EQ(users.connected().count(), 4);
+    users.disconnect(20);
+    users.disconnect(20);
+    users.disconnect(99);
+    ASSERT_FALSE(users.is_connected(20));
+    ASSERT_TRUE(users.is_connected(40));
+    std::vector<tr::user_index_t> indices;
+    users.connected().append_to(indices);
+    std::vector<tr::user_id_t> connected;
+    for (auto index : indices) {
+      connected.push_back(users.user_id(index));
+    }
+    std::sort(connected.begin(), connected.end());
+    ASSERT_EQ(connected, (std::vector<tr::user_id_t>{10, 30, 40}));
+    users.disconnect(40);
+    users.disconnect(10);
+    users.disconnect(30);
+    ASSERT_EQ(users.connected().count(), 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
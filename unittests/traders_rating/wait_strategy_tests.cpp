@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/wait_strategy.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace tr = ::traders_rating;
+
+namespace {
+
+const tr::wait_strategy_t strategies[] = {
+    tr::wait_strategy_t::busy_spin, tr::wait_strategy_t::spin_yield,
+    tr::wait_strategy_t::spin_park, tr::wait_strategy_t::blocking};
+
+tr::wait_config_t make_config(tr::wait_strategy_t strategy) {
+  tr::wait_config_t config;
+  config.strategy = strategy;
+  config.spin_count = 10;
+  // пробуждение должно прийти от производителя, а не по таймауту
+  config.park_timeout = std::chrono::milliseconds(10000);
+  return config;
+}
+
+}  // namespace
+
+TEST(IdleWaiterTest, Notify) {
+  try {
+    for (auto strategy : strategies) {
+      tr::idle_waiter waiter(make_config(strategy));
+      std::atomic<int> produced(0);
+      const int total = 1000;
+      std::thread consumer([&]() {
+        int consumed = 0;
+        while (consumed < total) {
+          if (produced.load() > consumed) {
+            ++consumed;
+            waiter.reset();
+            continue;
+          }
+          waiter.idle([&]() { return produced.load() > consumed; });
+        }
+      });
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < total; ++i) {
+        produced.fetch_add(1);
+        waiter.notify();
+        if (i % 100 == 0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+      consumer.join();
+      ASSERT_LT(std::chrono::steady_clock::now() - start,
+                std::chrono::seconds(5));
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(IdleWaiterTest, ParkTimeout) {
+  try {
+    for (auto strategy :
+         {tr::wait_strategy_t::spin_park, tr::wait_strategy_t::blocking}) {
+      auto config = make_config(strategy);
+      config.spin_count = 0;
+      config.park_timeout = std::chrono::milliseconds(20);
+      tr::idle_waiter waiter(config);
+      auto start = std::chrono::steady_clock::now();
+      waiter.idle([]() { return false; });
+      ASSERT_GE(std::chrono::steady_clock::now() - start,
+                std::chrono::milliseconds(10));
+      ASSERT_EQ(waiter.wakeups(), 0);
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(IdleWaiterTest, ReadyBeforePark) {
+  try {
+    auto config = make_config(tr::wait_strategy_t::blocking);
+    tr::idle_waiter waiter(config);
+    // работа уже есть - поток не засыпает
+    auto start = std::chrono::steady_clock::now();
+    waiter.idle([]() { return true; });
+    ASSERT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::seconds(1));
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+
+#include "traders_rating/worker_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace tr = ::traders_rating;
+
+TEST(WorkerPoolTest, RunsEachTaskOnce) {
+  try {
+    tr::worker_pool pool(4);
+    ASSERT_EQ(pool.size(), 4);
+    for (size_t tasks : {0, 1, 3, 1000}) {
+      std::vector<std::atomic<int>> runs(tasks);
+      for (auto& r : runs) {
+        r = 0;
+      }
+      pool.run(tasks, [&](size_t task, size_t worker) {
+        ASSERT_LT(worker, 4);
+        ++runs[task];
+      });
+      for (size_t i = 0; i < tasks; ++i) {
+        ASSERT_EQ(runs[i], 1);
+      }
+    }
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WorkerPoolTest, StealsFromBusyWorker) {
+  try {
+    // задачи первого диапазона долгие: остальные исполнители
+    // забирают их у исполнителя 0
+    tr::worker_pool pool(4);
+    std::vector<size_t> worker_of(64);
+    pool.run(worker_of.size(), [&](size_t task, size_t worker) {
+      worker_of[task] = worker;
+      if (task < 16) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    });
+    size_t stolen = 0;
+    for (size_t task = 0; task < 16; ++task) {
+      stolen += worker_of[task] != 0 ? 1 : 0;
+    }
+    ASSERT_GT(stolen, 0);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}
+
+TEST(WorkerPoolTest, RethrowsTaskError) {
+  try {
+    tr::worker_pool pool(3);
+    std::atomic<size_t> done(0);
+    ASSERT_THROW(pool.run(100,
+                          [&](size_t task, size_t) {
+                            if (task == 50) {
+                              throw std::runtime_error("task");
+                            }
+                            ++done;
+                          }),
+                 std::runtime_error);
+    ASSERT_EQ(done, 99);
+    // пул пригоден после ошибки
+    pool.run(10, [&](size_t, size_t) { ++done; });
+    ASSERT_EQ(done, 109);
+  }
+  catch (std::exception& e) {
+    FAIL() << e.what();
+  }
+}